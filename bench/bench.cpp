@@ -0,0 +1,375 @@
+#include "bench.hpp"
+
+#include <pip/context.hpp>
+#include <pip/decl.hpp>
+#include <pip/action.hpp>
+#include <pip/expr.hpp>
+#include <pip/type.hpp>
+#include <pip/translator.hpp>
+#include <pip/resolver.hpp>
+#include <pip/type_checker.hpp>
+#include <pip/table.hpp>
+#include <pip/evaluator.hpp>
+#include <pip/pcap.hpp>
+#include <pip/decode.hpp>
+#include <pip/flow_cache.hpp>
+#include <pip/megaflow.hpp>
+
+#include <sexpr/syntax.hpp>
+#include <sexpr/context.hpp>
+#include <sexpr/parser.hpp>
+
+#include <cc/input.hpp>
+#include <cc/output.hpp>
+#include <cc/diagnostics.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// Microbenchmarks for the evaluator.
+//
+// usage: pip-bench [<pcap-file> [<pip-program>...]]
+//
+// Without arguments, only the synthetic microbenchmarks are run. With a
+// capture (see pcapgen), each program is also evaluated over every packet
+// of the capture. All inputs are generated from fixed seeds.
+
+using namespace pip;
+
+namespace
+{
+  // The number of distinct keys used by the lookup benchmarks.
+  const std::size_t key_counts[] = {16, 1024, 65536};
+
+  // Builds a single table of kind `kind` that copies `width` bits of the
+  // frame into the key register and matches them against `keys`.
+  program_decl*
+  make_program(context& cxt, const std::vector<expr*>& keys,
+               rule_kind kind = rk_exact, std::size_t width = 16)
+  {
+    auto i32 = [&](int n) { return cxt.make_int_expr(new int_type(32), n); };
+    action_seq prep {
+      cxt.make_copy_action(cxt.make_bitfield_expr(as_packet, i32(96), i32(width)),
+                           cxt.make_bitfield_expr(as_key, i32(0), i32(width)),
+                           i32(width)),
+      cxt.make_match_action(),
+    };
+    rule_seq rules;
+    std::uint32_t index = 0;
+    for (expr* k : keys) {
+      rule* r = new rule(kind, k, action_seq {cxt.make_drop_action()});
+      r->index = index++;
+      rules.push_back(r);
+    }
+    auto t = new table_decl(cxt.get_symbol("t0"), kind,
+                            std::move(prep), std::move(rules));
+    program_decl* prog = new program_decl(decl_seq {t});
+    build_tables(prog);
+    return prog;
+  }
+
+  // Returns a random key of `width` bits.
+  key_value
+  random_key(bench::random& rng, std::size_t width)
+  {
+    key_value k;
+    for (std::size_t pos = 0; pos < width; pos += 64)
+      k.insert(pos, std::min<std::size_t>(width - pos, 64), rng());
+    return k;
+  }
+
+  // Times the lookup of `probes` in the table of `prog`.
+  void
+  time_lookup(const std::string& name, program_decl* prog,
+              const std::vector<key_value>& probes)
+  {
+    const table_engine& engine = *prog->entry->engine;
+    std::size_t found = 0;
+    bench::run(name, 1 << 20, [&](std::size_t i) {
+      found += engine.lookup(probes[i % probes.size()]) != nullptr;
+    });
+    bench::keep(found);
+  }
+
+  // Exact tables, with the engine selected by key width: direct arrays
+  // at 8 and 16 bits, a paged array at 24, and hash tables above.
+  void
+  bench_exact_table(context& cxt)
+  {
+    const struct { std::size_t width; const char* engine; } cases[] = {
+      {8, "direct"}, {16, "direct"}, {24, "paged"}, {32, "hash"},
+      {64, "hash"}, {128, "hash"}, {512, "hash"},
+    };
+    for (const auto& c : cases) {
+      for (std::size_t n : key_counts) {
+        if (c.width < 64 && n > (std::size_t(1) << c.width) / 2)
+          continue;
+        bench::random rng(n + c.width);
+        std::vector<key_value> keys;
+        std::vector<expr*> exprs;
+        for (std::size_t i = 0; i < n; ++i) {
+          keys.push_back(random_key(rng, c.width));
+          exprs.push_back(cxt.make_key_expr(new int_type(c.width), expr_seq {}, keys.back()));
+        }
+        program_decl* prog = make_program(cxt, exprs, rk_exact, c.width);
+
+        // Half of the probes hit.
+        std::vector<key_value> probes;
+        for (const key_value& k : keys)
+          probes.push_back(rng.below(2) ? k : random_key(rng, c.width));
+
+        time_lookup("exact lookup (" + std::string(c.engine) + "), " +
+                    std::to_string(c.width) + "-bit key, " +
+                    std::to_string(n) + " keys", prog, probes);
+        delete prog;
+      }
+    }
+  }
+
+  // Range, wildcard and prefix tables over 32-bit keys. These engines
+  // scan their rules in order, so they are timed with fewer rules.
+  void
+  bench_scanned_tables(context& cxt)
+  {
+    const std::size_t width = 32;
+    for (std::size_t n : {16, 256}) {
+      bench::random rng(n);
+      std::vector<expr*> ranges, wilds, prefixes;
+      for (std::size_t i = 0; i < n; ++i) {
+        int lo = rng() & 0x7fffffff;
+        ranges.push_back(cxt.make_range_expr(new int_type(width), lo, lo + int(rng.below(1 << 16))));
+
+        // Wildcards have random don't-care bits; prefixes have don't-care
+        // bits below a random prefix length.
+        int val = rng();
+        int mask = rng() & rng();
+        wilds.push_back(cxt.make_wild_expr(new int_type(width), val & ~mask, mask));
+        std::uint32_t suffix = std::uint32_t(~0u) >> rng.below(width);
+        prefixes.push_back(cxt.make_wild_expr(new int_type(width), val & ~suffix, suffix));
+      }
+
+      std::vector<key_value> probes;
+      for (std::size_t i = 0; i < 1024; ++i)
+        probes.push_back(random_key(rng, width));
+
+      const struct { rule_kind kind; std::vector<expr*>* keys; const char* name; } cases[] = {
+        {rk_range, &ranges, "range"},
+        {rk_wildcard, &wilds, "wildcard"},
+        {rk_prefix, &prefixes, "prefix"},
+      };
+      for (const auto& c : cases) {
+        program_decl* prog = make_program(cxt, *c.keys, c.kind, width);
+        time_lookup(std::string(c.name) + " lookup, 32-bit key, " +
+                    std::to_string(n) + " rules", prog, probes);
+        delete prog;
+      }
+    }
+  }
+
+  void
+  bench_flow_cache(context& cxt)
+  {
+    for (std::size_t n : key_counts) {
+      std::vector<expr*> keys;
+      for (std::uint64_t k = 0; k < std::min<std::size_t>(n, 65536); ++k)
+        keys.push_back(cxt.make_int_expr(new int_type(16), k));
+      program_decl* prog = make_program(cxt, keys);
+      flow_cache cache(prog, 2 * n);
+
+      // Insert every flow, then probe them in a shuffled order.
+      std::vector<std::uint64_t> hashes;
+      std::vector<unsigned char> frames(n * 64);
+      for (std::size_t i = 0; i < n; ++i) {
+        unsigned char* f = &frames[i * 64];
+        f[12] = i >> 8;
+        f[13] = i;
+        cache.signature().extract(f, 64, 0, 0, cache.key());
+        hashes.push_back(cache.hash());
+        cache.insert(hashes.back(), nullptr, flow_trace());
+      }
+      bench::random rng(n);
+      std::vector<std::size_t> order;
+      for (std::size_t i = 0; i < n; ++i)
+        order.push_back(rng.below(n));
+
+      std::size_t found = 0;
+      bench::run("flow cache extract+lookup, " + std::to_string(n) + " flows",
+                 1 << 20, [&](std::size_t i) {
+        std::size_t k = order[i % n];
+        cache.signature().extract(&frames[k * 64], 64, 0, 0, cache.key());
+        found += cache.lookup(cache.hash()) != nullptr;
+      });
+      bench::keep(found);
+      delete prog;
+    }
+  }
+
+  void
+  bench_megaflows()
+  {
+    // Megaflows over a 16-byte key with an increasing number of distinct
+    // masks. Lookup cost grows with the number of subtables probed.
+    const std::size_t length = 16;
+    for (std::size_t masks : {1, 4, 16}) {
+      tuple_space ts(length, 1 << 16);
+      bench::random rng(masks);
+      std::vector<std::vector<unsigned char>> keys;
+      for (std::size_t m = 0; m < masks; ++m) {
+        std::vector<unsigned char> mask(length, 0);
+        mask[m % length] = 0xff;
+        mask[(m + 1) % length] = 0xf0 | m;
+        for (int i = 0; i < 256; ++i) {
+          std::vector<unsigned char> key(length);
+          for (auto& b : key)
+            b = rng();
+          ts.insert(key.data(), mask.data(), flow_trace());
+          keys.push_back(key);
+        }
+      }
+
+      std::size_t found = 0;
+      bench::run("megaflow lookup, " + std::to_string(masks) + " subtables",
+                 1 << 18, [&](std::size_t i) {
+        found += ts.lookup(keys[i % keys.size()].data()) != nullptr;
+      });
+      bench::keep(found);
+    }
+  }
+
+  void
+  bench_key_extraction()
+  {
+    std::vector<unsigned char> frames(1024 * 64);
+    bench::random rng(42);
+    for (auto& b : frames)
+      b = rng();
+
+    std::uint64_t sum = 0;
+    bench::run("decode eth.type", 1 << 22, [&](std::size_t i) {
+      sum += cap::ethernet_ethertype(&frames[(i % 1024) * 64]);
+    });
+    bench::run("decode eth.dst", 1 << 22, [&](std::size_t i) {
+      sum += cap::ethernet_dst_mac(&frames[(i % 1024) * 64]);
+    });
+    bench::run("hash 16-byte flow key", 1 << 22, [&](std::size_t i) {
+      sum += hash_key(&frames[(i % 1024) * 64], 16);
+    });
+    bench::keep(sum);
+  }
+
+  // Parses, translates, resolves and checks a pip program, and builds its
+  // tables. Returns nullptr and prints diagnostics on error.
+  program_decl*
+  load_program(context& cxt, cc::diagnostic_manager& diags,
+               cc::input_manager& inputs, cc::symbol_table& syms,
+               const char* path)
+  {
+    try {
+      const cc::file& input = inputs.add_file(path);
+      sexpr::context sexpr(diags, inputs, syms);
+      sexpr::parser parse(sexpr, input);
+      sexpr::expr* e = parse();
+
+      translator trans(cxt);
+      decl* prog = trans(e);
+
+      resolver resolve(cxt);
+      resolve(prog);
+
+      type_checker types(cxt, static_cast<program_decl*>(prog));
+      types.check();
+      build_tables(static_cast<program_decl*>(prog));
+      return static_cast<program_decl*>(prog);
+    }
+    catch (cc::diagnosable_error& err) {
+      diags.emit(err);
+    }
+    catch (std::exception& err) {
+      std::cerr << path << ": " << err.what() << '\n';
+    }
+    return nullptr;
+  }
+
+  // Times reading the capture alone and reading plus evaluating each packet
+  // with `prog`. The evaluator's trace output is discarded while timing.
+  void
+  bench_pipeline(context& cxt, program_decl* prog, const char* program,
+                 const char* capture)
+  {
+    using clock = std::chrono::steady_clock;
+
+    std::size_t packets = 0;
+    auto start = clock::now();
+    {
+      cap::file in(capture);
+      cap::packet pkt;
+      while (in.get(pkt))
+        ++packets;
+    }
+    auto read = clock::now() - start;
+
+    std::size_t failed = 0;
+    std::size_t unsupported = 0;
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    start = clock::now();
+    {
+      cap::file in(capture);
+      cap::packet pkt;
+      while (in.get(pkt)) {
+        try {
+          evaluator eval(cxt, prog, pkt, 1);
+          eval.run();
+          if (eval.is_unsupported())
+            ++unsupported;
+        }
+        catch (std::exception&) {
+          ++failed;
+        }
+      }
+    }
+    auto total = clock::now() - start;
+    std::cout.rdbuf(out);
+    std::cout.clear();
+
+    if (!packets)
+      return;
+    std::chrono::duration<double, std::nano> eval_ns = total - read;
+    std::cout << "pipeline " << program << ": "
+              << eval_ns.count() / packets << " ns/packet over "
+              << packets << " packets";
+    if (failed)
+      std::cout << " (" << failed << " failed)";
+    if (unsupported)
+      std::cout << " (" << unsupported << " not TCP or UDP, not evaluated)";
+    std::cout << '\n';
+  }
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  cc::output_device error = std::cerr;
+  cc::diagnostic_manager diags;
+  cc::input_manager inputs;
+  cc::symbol_table syms;
+  context cxt(diags, inputs, syms);
+
+  bench_exact_table(cxt);
+  bench_scanned_tables(cxt);
+  bench_flow_cache(cxt);
+  bench_megaflows();
+  bench_key_extraction();
+
+  if (argc > 2) {
+    for (int i = 2; i < argc; ++i) {
+      if (program_decl* prog = load_program(cxt, diags, inputs, syms, argv[i]))
+        bench_pipeline(cxt, prog, argv[i], argv[1]);
+    }
+  }
+
+  if (diags.error_count())
+    print(diags.get_diagnostics(), inputs, error);
+  return 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace pip
+{
+namespace bench
+{
+  /// Prevents the compiler from optimizing away a computed value.
+  template<typename T>
+  inline void
+  keep(const T& value)
+  {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  /// Runs `fn` for `reps` repetitions of `iters` iterations each and
+  /// reports the median time per iteration. The median is far less
+  /// sensitive to scheduling noise than the mean.
+  template<typename F>
+  void
+  run(const std::string& name, std::size_t iters, F fn, int reps = 7)
+  {
+    using clock = std::chrono::steady_clock;
+
+    // Warm up caches and branch predictors.
+    for (std::size_t i = 0; i < iters / 10 + 1; ++i)
+      fn(i);
+
+    std::vector<double> samples;
+    for (int r = 0; r < reps; ++r) {
+      auto start = clock::now();
+      for (std::size_t i = 0; i < iters; ++i)
+        fn(i);
+      auto stop = clock::now();
+      std::chrono::duration<double, std::nano> ns = stop - start;
+      samples.push_back(ns.count() / iters);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    std::cout << std::left << std::setw(48) << name
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << samples[samples.size() / 2] << " ns/op"
+              << "  (min " << samples.front()
+              << ", max " << samples.back() << ")\n";
+  }
+
+  /// A small, fast, reproducible random number generator (splitmix64).
+  /// Benchmarks must not depend on the platform's std distributions.
+  class random
+  {
+  public:
+    explicit random(std::uint64_t seed)
+      : state(seed)
+    { }
+
+    std::uint64_t operator()()
+    {
+      std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+    }
+
+    /// Returns a value in [0, n).
+    std::uint64_t below(std::uint64_t n) { return (*this)() % n; }
+
+    /// Returns a value in [0, 1).
+    double uniform() { return ((*this)() >> 11) / 9007199254740992.0; }
+
+  private:
+    std::uint64_t state;
+  };
+
+} // namespace bench
+} // namespace pip
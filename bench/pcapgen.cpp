@@ -0,0 +1,310 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Synthesizes pcap captures for benchmarking the evaluator. Every run with
+// the same options produces a byte-identical file.
+//
+// usage: pcapgen [options]
+//   -o <file>             Output file (default: synthetic.pcap)
+//   --packets <n>         Number of packets (default: 100000)
+//   --flows <n>           Number of distinct 5-tuples (default: 1024)
+//   --size <min>[:<max>]  Frame size in bytes, uniform in [min, max]
+//                         (default: 64)
+//   --mix <p>=<w>,...     Protocol weights over tcp, udp and icmp
+//                         (default: tcp=1). The evaluator does not
+//                         run programs on icmp packets, so pipeline
+//                         benchmarks should use tcp and udp only.
+//   --zipf <s>            Zipf exponent of the flow popularity; 0 gives
+//                         uniformly popular flows (default: 0)
+//   --rate <pps>          Packets per second, for timestamps
+//                         (default: 1000000)
+//   --seed <n>            Random seed (default: 1)
+
+using namespace pip;
+
+namespace
+{
+  enum protocol : std::uint8_t
+  {
+    proto_icmp = 1,
+    proto_tcp = 6,
+    proto_udp = 17,
+  };
+
+  struct flow
+  {
+    protocol proto;
+    std::uint8_t src_mac[6];
+    std::uint8_t dst_mac[6];
+    std::uint32_t src_addr;
+    std::uint32_t dst_addr;
+    std::uint16_t src_port;
+    std::uint16_t dst_port;
+  };
+
+  struct options
+  {
+    std::string output = "synthetic.pcap";
+    std::size_t packets = 100000;
+    std::size_t flows = 1024;
+    std::size_t min_size = 64;
+    std::size_t max_size = 64;
+    double tcp = 1;
+    double udp = 0;
+    double icmp = 0;
+    double zipf = 0;
+    double rate = 1000000;
+    std::uint64_t seed = 1;
+  };
+
+  // Returns the argument following `flag`, or nullptr if absent.
+  const char*
+  find_arg(const std::vector<std::string>& args, const char* flag)
+  {
+    auto it = std::find(args.begin(), args.end(), flag);
+    if (it == args.end())
+      return nullptr;
+    if (it + 1 == args.end())
+      throw std::runtime_error(std::string("missing value for ") + flag);
+    return (it + 1)->c_str();
+  }
+
+  options
+  parse(int argc, char* argv[])
+  {
+    std::vector<std::string> args(argv, argv + argc);
+    options opts;
+    if (const char* s = find_arg(args, "-o"))
+      opts.output = s;
+    if (const char* s = find_arg(args, "--packets"))
+      opts.packets = std::stoull(s);
+    if (const char* s = find_arg(args, "--flows"))
+      opts.flows = std::max<std::size_t>(std::stoull(s), 1);
+    if (const char* s = find_arg(args, "--size")) {
+      std::string size = s;
+      auto colon = size.find(':');
+      opts.min_size = std::stoull(size.substr(0, colon));
+      opts.max_size = colon == std::string::npos
+        ? opts.min_size
+        : std::stoull(size.substr(colon + 1));
+    }
+    if (const char* s = find_arg(args, "--mix")) {
+      opts.tcp = opts.udp = opts.icmp = 0;
+      std::stringstream ss(s);
+      std::string item;
+      while (std::getline(ss, item, ',')) {
+        auto eq = item.find('=');
+        if (eq == std::string::npos)
+          throw std::runtime_error("invalid protocol mix: " + item);
+        std::string name = item.substr(0, eq);
+        double weight = std::stod(item.substr(eq + 1));
+        if (name == "tcp")
+          opts.tcp = weight;
+        else if (name == "udp")
+          opts.udp = weight;
+        else if (name == "icmp")
+          opts.icmp = weight;
+        else
+          throw std::runtime_error("unknown protocol: " + name);
+      }
+    }
+    if (const char* s = find_arg(args, "--zipf"))
+      opts.zipf = std::stod(s);
+    if (const char* s = find_arg(args, "--rate"))
+      opts.rate = std::stod(s);
+    if (const char* s = find_arg(args, "--seed"))
+      opts.seed = std::stoull(s);
+
+    // Ethernet + IPv4 + TCP is the largest header stack we generate.
+    if (opts.min_size < 54 || opts.max_size < opts.min_size || opts.max_size > 65535)
+      throw std::runtime_error("frame sizes must satisfy 54 <= min <= max <= 65535");
+    if (opts.tcp + opts.udp + opts.icmp <= 0)
+      throw std::runtime_error("protocol mix must have a positive weight");
+    return opts;
+  }
+
+  std::vector<flow>
+  make_flows(const options& opts, bench::random& rng)
+  {
+    double total = opts.tcp + opts.udp + opts.icmp;
+    std::vector<flow> flows(opts.flows);
+    for (flow& f : flows) {
+      double p = rng.uniform() * total;
+      f.proto = p < opts.tcp ? proto_tcp
+              : p < opts.tcp + opts.udp ? proto_udp
+              : proto_icmp;
+      for (int i = 0; i < 6; ++i) {
+        f.src_mac[i] = rng();
+        f.dst_mac[i] = rng();
+      }
+      // Locally administered, unicast.
+      f.src_mac[0] = (f.src_mac[0] & 0xfc) | 0x02;
+      f.dst_mac[0] = (f.dst_mac[0] & 0xfc) | 0x02;
+      f.src_addr = 0x0a000000 | (rng() & 0xffffff);
+      f.dst_addr = 0x0a000000 | (rng() & 0xffffff);
+      f.src_port = 1024 + rng.below(64512);
+      f.dst_port = rng.below(1024);
+    }
+    return flows;
+  }
+
+  // The cumulative distribution of flow popularity.
+  std::vector<double>
+  make_cdf(const options& opts)
+  {
+    std::vector<double> cdf(opts.flows);
+    double sum = 0;
+    for (std::size_t i = 0; i < opts.flows; ++i) {
+      sum += 1.0 / std::pow(double(i + 1), opts.zipf);
+      cdf[i] = sum;
+    }
+    for (double& c : cdf)
+      c /= sum;
+    return cdf;
+  }
+
+  void
+  put16(std::uint8_t* p, std::uint16_t v)
+  {
+    p[0] = v >> 8;
+    p[1] = v;
+  }
+
+  void
+  put32(std::uint8_t* p, std::uint32_t v)
+  {
+    put16(p, v >> 16);
+    put16(p + 2, v);
+  }
+
+  std::uint16_t
+  ones_complement_sum(const std::uint8_t* p, std::size_t n)
+  {
+    std::uint32_t sum = 0;
+    for (std::size_t i = 0; i + 1 < n; i += 2)
+      sum += (p[i] << 8) | p[i + 1];
+    if (n & 1)
+      sum += p[n - 1] << 8;
+    while (sum >> 16)
+      sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+  }
+
+  // Builds a frame of `size` bytes for flow `f` into `buf`.
+  void
+  build_frame(const flow& f, std::size_t size, std::uint16_t id, std::uint8_t* buf)
+  {
+    std::memset(buf, 0, size);
+
+    // Ethernet.
+    std::memcpy(buf, f.dst_mac, 6);
+    std::memcpy(buf + 6, f.src_mac, 6);
+    put16(buf + 12, 0x0800);
+
+    // IPv4.
+    std::uint8_t* ip = buf + 14;
+    ip[0] = 0x45;
+    put16(ip + 2, size - 14);
+    put16(ip + 4, id);
+    ip[8] = 64;
+    ip[9] = f.proto;
+    put32(ip + 12, f.src_addr);
+    put32(ip + 16, f.dst_addr);
+    put16(ip + 10, ones_complement_sum(ip, 20));
+
+    // Transport. Transport checksums are left zero.
+    std::uint8_t* l4 = ip + 20;
+    switch (f.proto) {
+    case proto_tcp:
+      put16(l4, f.src_port);
+      put16(l4 + 2, f.dst_port);
+      put32(l4 + 4, id);
+      l4[12] = 5 << 4;
+      l4[13] = 0x10; // ACK
+      put16(l4 + 14, 65535);
+      break;
+    case proto_udp:
+      put16(l4, f.src_port);
+      put16(l4 + 2, f.dst_port);
+      put16(l4 + 4, size - 34);
+      break;
+    case proto_icmp:
+      l4[0] = 8; // echo request
+      put16(l4 + 6, id);
+      put16(l4 + 2, ones_complement_sum(l4, size - 34));
+      break;
+    }
+  }
+
+  template<typename T>
+  void
+  write_raw(std::ostream& os, T v)
+  {
+    os.write(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  options opts;
+  try {
+    opts = parse(argc, argv);
+  }
+  catch (std::exception& err) {
+    std::cerr << "pcapgen: " << err.what() << '\n';
+    return 1;
+  }
+
+  bench::random rng(opts.seed);
+  std::vector<flow> flows = make_flows(opts, rng);
+  std::vector<double> cdf = make_cdf(opts);
+
+  std::ofstream out(opts.output, std::ios::binary);
+  if (!out) {
+    std::cerr << "pcapgen: cannot open " << opts.output << '\n';
+    return 1;
+  }
+
+  // The pcap file header, in host byte order.
+  write_raw<std::uint32_t>(out, 0xa1b2c3d4);
+  write_raw<std::uint16_t>(out, 2);
+  write_raw<std::uint16_t>(out, 4);
+  write_raw<std::int32_t>(out, 0);
+  write_raw<std::uint32_t>(out, 0);
+  write_raw<std::uint32_t>(out, 65535);
+  write_raw<std::uint32_t>(out, 1); // LINKTYPE_ETHERNET
+
+  std::vector<std::uint8_t> frame(opts.max_size);
+  double interval = 1e6 / opts.rate;
+  for (std::size_t i = 0; i < opts.packets; ++i) {
+    std::size_t n = std::lower_bound(cdf.begin(), cdf.end(), rng.uniform()) - cdf.begin();
+    const flow& f = flows[std::min(n, flows.size() - 1)];
+    std::size_t size = opts.min_size + rng.below(opts.max_size - opts.min_size + 1);
+    build_frame(f, size, i, frame.data());
+
+    std::uint64_t usec = i * interval;
+    write_raw<std::uint32_t>(out, usec / 1000000);
+    write_raw<std::uint32_t>(out, usec % 1000000);
+    write_raw<std::uint32_t>(out, size);
+    write_raw<std::uint32_t>(out, size);
+    out.write(reinterpret_cast<const char*>(frame.data()), size);
+  }
+
+  if (!out) {
+    std::cerr << "pcapgen: error writing " << opts.output << '\n';
+    return 1;
+  }
+  return 0;
+}
@@ -18,6 +18,10 @@ namespace pip
       return "copy";
     case ak_set:
       return "set";
+    case ak_meter:
+      return "meter";
+    case ak_conntrack:
+      return "conntrack";
     case ak_write:
       return "write";
     case ak_clear:
@@ -30,6 +34,8 @@ namespace pip
       return "goto";
     case ak_output:
       return "output";
+    case ak_group:
+      return "group";
     }
   }
   
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <pip/syntax.hpp>
+#include <pip/checksum.hpp>
 
 namespace pip
 {
@@ -14,6 +15,12 @@ namespace pip
     ak_copy,
     ak_set,
 
+    // Metering
+    ak_meter,
+
+    // Connection tracking
+    ak_conntrack,
+
     // Action list
     ak_write,
     ak_clear,
@@ -23,6 +30,7 @@ namespace pip
     ak_match,
     ak_goto,
     ak_output,
+    ak_group,
   };
 
   /// The base class of all actions.
@@ -56,6 +64,9 @@ namespace pip
     expr* src;
     expr* dst;
     int_expr* n;
+
+    /// The checksums covering the destination (see mark_checksums).
+    std::uint8_t checksums = cs_dynamic;
   };
 
   /// Set a value of a packet field.
@@ -69,6 +80,33 @@ namespace pip
 
     expr* f;
     expr* v;
+
+    /// The checksums covering the destination (see mark_checksums).
+    std::uint8_t checksums = cs_dynamic;
+  };
+
+  /// Apply the packet to a meter. Depending on the band applied to the
+  /// packet, it may be dropped or its DSCP remarked.
+  struct meter_action : action
+  {
+    meter_action(expr* m)
+      : action(ak_meter), meter(m)
+    { }
+
+    /// A reference to the meter.
+    expr* meter;
+  };
+
+  /// Look up the packet's connection, advance its state, and set the
+  /// ct_state register. If `commit` is true, a new connection is added to
+  /// the connection table; otherwise it is only classified.
+  struct conntrack_action : action
+  {
+    conntrack_action(bool commit)
+      : action(ak_conntrack), commit(commit)
+    { }
+
+    bool commit;
   };
 
   /// Write an action to the action list.
@@ -129,6 +167,18 @@ namespace pip
   };
 
 
+  /// Execute the buckets of a group.
+  struct group_action : action
+  {
+    group_action(expr* g)
+      : action(ak_group), group(g)
+    { }
+
+    /// A reference to the group.
+    expr* group;
+  };
+
+
 // -------------------------------------------------------------------------- //
 // Operations
 
@@ -170,6 +220,20 @@ namespace cc
     has_kind(const node* n) { return get_node_kind(n) == pip::ak_set; }
   };
 
+  template<>
+  struct node_info<pip::meter_action>
+  {
+    static bool
+    has_kind(const node* n) { return get_node_kind(n) == pip::ak_meter; }
+  };
+
+  template<>
+  struct node_info<pip::conntrack_action>
+  {
+    static bool
+    has_kind(const node* n) { return get_node_kind(n) == pip::ak_conntrack; }
+  };
+
   template<>
   struct node_info<pip::write_action>
   {
@@ -212,4 +276,11 @@ namespace cc
     has_kind(const node* n) { return get_node_kind(n) == pip::ak_output; }
   };
 
+  template<>
+  struct node_info<pip::group_action>
+  {
+    static bool
+    has_kind(const node* n) { return get_node_kind(n) == pip::ak_group; }
+  };
+
 } // namespace cc
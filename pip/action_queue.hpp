@@ -0,0 +1,113 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+
+namespace pip
+{
+  /// The sequence of actions being evaluated for a packet.
+  ///
+  /// The queue is a fixed-capacity ring of actions stored inline, followed
+  /// by a span of actions that is executed in place. Loading a table or a
+  /// rule copies its actions into the ring, so the queue does not depend
+  /// on a rule that is removed while it executes. Replaying a trace, which
+  /// may be longer than the ring, sets the span instead. Actions are only
+  /// appended when the span is empty, and prepended before it.
+  ///
+  /// No operation allocates. Exceeding the capacity of the ring throws
+  /// std::runtime_error.
+  class action_queue
+  {
+  public:
+    /// The capacity of the ring, a power of 2.
+    static constexpr std::size_t capacity = 256;
+
+    bool empty() const { return head == tail && span_next == span_end; }
+
+    /// Removes every action.
+    void
+    clear()
+    {
+      head = tail = 0;
+      span_next = span_end = nullptr;
+    }
+
+    /// Returns and removes the first action.
+    const action*
+    pop_front()
+    {
+      if (head != tail)
+        return ring[head++ & mask];
+      return *span_next++;
+    }
+
+    /// Appends an action.
+    void
+    push_back(const action* a)
+    {
+      assert(span_next == span_end);
+      reserve(1);
+      ring[tail++ & mask] = a;
+    }
+
+    /// Appends the actions in [first, last).
+    template<typename I>
+    void
+    append(I first, I last)
+    {
+      assert(span_next == span_end);
+      reserve(last - first);
+      for (; first != last; ++first)
+        ring[tail++ & mask] = *first;
+    }
+
+    /// Inserts the actions in [first, last) before the first action.
+    template<typename I>
+    void
+    prepend(I first, I last)
+    {
+      reserve(last - first);
+      while (last != first)
+        ring[--head & mask] = *--last;
+    }
+
+    /// Replaces the contents of the queue with the span [first, last),
+    /// which must outlive its execution.
+    void
+    assign_span(const action* const* first, const action* const* last)
+    {
+      head = tail = 0;
+      span_next = first;
+      span_end = last;
+    }
+
+  private:
+    static constexpr std::size_t mask = capacity - 1;
+
+    void
+    reserve(std::size_t n)
+    {
+      if (tail - head + n > capacity) {
+        std::stringstream ss;
+        ss << "More than " << capacity << " actions queued for a packet";
+        throw std::runtime_error(ss.str());
+      }
+    }
+
+    const action* ring[capacity];
+
+    // The ring holds the actions [head, tail), modulo its capacity. The
+    // counters wrap around together.
+    std::size_t head = 0;
+    std::size_t tail = 0;
+
+    // The span executed after the ring.
+    const action* const* span_next = nullptr;
+    const action* const* span_end = nullptr;
+  };
+
+} // namespace pip
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Kernels for reading and writing bitfields of frames and registers.
+//
+// Frame fields are big-endian: bit 0 of a frame is the most significant
+// bit of its first byte, and a field of n bits is read as an n-bit
+// unsigned integer. A field of up to 64 bits is moved with one unaligned
+// 64-bit load (and one store), a byte swap, a shift, and a mask; a field
+// that straddles nine bytes takes one more byte. Near the end of a frame,
+// where a full word cannot be loaded, the bytes are moved one at a time.
+//
+// The kernels do not check their arguments: the type checker proves that
+// every field of a program fits its register and its frame.
+
+namespace pip
+{
+  /// Loads 8 bytes at `p` as a big-endian integer.
+  inline std::uint64_t
+  load_be64(const unsigned char* p)
+  {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof v);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+  }
+
+  /// Stores `v` at `p` as 8 big-endian bytes.
+  inline void
+  store_be64(unsigned char* p, std::uint64_t v)
+  {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    std::memcpy(p, &v, sizeof v);
+  }
+
+  /// Returns a mask of the low `n` bits, for 0 <= n <= 64.
+  inline std::uint64_t
+  low_bits(std::size_t n)
+  {
+    return n < 64 ? (std::uint64_t(1) << n) - 1 : ~std::uint64_t(0);
+  }
+
+  namespace detail
+  {
+    // Loads up to 8 bytes at `p`, of which `k` are in the frame, as the
+    // high bytes of a big-endian word.
+    inline std::uint64_t
+    load_be64(const unsigned char* p, std::size_t k)
+    {
+      if (k >= 8)
+        return pip::load_be64(p);
+      std::uint64_t v = 0;
+      for (std::size_t i = 0; i < k; ++i)
+        v |= std::uint64_t(p[i]) << (56 - 8 * i);
+      return v;
+    }
+
+    // Stores the high `k` bytes of the big-endian word `v` at `p`.
+    inline void
+    store_be64(unsigned char* p, std::size_t k, std::uint64_t v)
+    {
+      if (k >= 8)
+        return pip::store_be64(p, v);
+      for (std::size_t i = 0; i < k; ++i)
+        p[i] = v >> (56 - 8 * i);
+    }
+  } // namespace detail
+
+  /// Returns the `n`-bit field at bit `pos` of the `size`-byte frame `p`,
+  /// where 0 < n <= 64.
+  inline std::uint64_t
+  extract_bits(const unsigned char* p, std::size_t size, std::size_t pos, std::size_t n)
+  {
+    std::size_t byte = pos / CHAR_BIT;
+    std::size_t off = pos % CHAR_BIT;
+    std::uint64_t v = detail::load_be64(p + byte, size - byte) << off;
+    if (off + n > 64)
+      v |= p[byte + 8] >> (CHAR_BIT - off);
+    return v >> (64 - n);
+  }
+
+  /// Writes the low `n` bits of `value` to the field at bit `pos` of the
+  /// `size`-byte frame `p`, where 0 < n <= 64.
+  inline void
+  insert_bits(unsigned char* p, std::size_t size, std::size_t pos, std::size_t n,
+              std::uint64_t value)
+  {
+    std::size_t byte = pos / CHAR_BIT;
+    std::size_t off = pos % CHAR_BIT;
+
+    // The field and its mask, aligned to the top of the word.
+    std::uint64_t field = value << (64 - n);
+    std::uint64_t mask = ~std::uint64_t(0) << (64 - n);
+
+    std::uint64_t w = detail::load_be64(p + byte, size - byte);
+    w = (w & ~(mask >> off)) | (field >> off);
+    detail::store_be64(p + byte, size - byte, w);
+
+    // The bits shifted out of the word go to the ninth byte.
+    if (off + n > 64) {
+      std::uint8_t m = (mask << (64 - off)) >> 56;
+      std::uint8_t b = (field << (64 - off)) >> 56;
+      p[byte + 8] = (p[byte + 8] & ~m) | (b & m);
+    }
+  }
+
+  /// Copies `n` bits at bit `pos` of `src` to bit `pos` of `dst`. Each of
+  /// `dst` and `src` points to the byte holding its first bit.
+  inline void
+  copy_bits(unsigned char* dst, const unsigned char* src, std::size_t pos, std::size_t n)
+  {
+    std::size_t off = pos % CHAR_BIT;
+    if (off) {
+      std::size_t k = n < CHAR_BIT - off ? n : CHAR_BIT - off;
+      std::uint8_t m = (0xff >> off) & (0xff << (CHAR_BIT - off - k));
+      *dst = (*dst & ~m) | (*src & m);
+      ++dst;
+      ++src;
+      n -= k;
+    }
+    std::memcpy(dst, src, n / CHAR_BIT);
+    if (n % CHAR_BIT) {
+      std::uint8_t m = 0xff << (CHAR_BIT - n % CHAR_BIT);
+      dst[n / CHAR_BIT] = (dst[n / CHAR_BIT] & ~m) | (src[n / CHAR_BIT] & m);
+    }
+  }
+
+  /// Returns the `n`-bit field at bit `pos` of a register, counting from
+  /// its least significant bit.
+  inline std::uint64_t
+  register_bits(std::uint64_t reg, std::size_t pos, std::size_t n)
+  {
+    return (reg >> pos) & low_bits(n);
+  }
+
+  /// Returns `dst` with its bits [pos, pos + n) replaced by those of `src`.
+  inline std::uint64_t
+  merge_bits(std::uint64_t src, std::uint64_t dst, std::size_t pos, std::size_t n)
+  {
+    std::uint64_t mask = low_bits(n) << pos;
+    return (dst & ~mask) | (src & mask);
+  }
+
+  /// Returns the `N`-bit field at bit `Pos` of the `size`-byte frame `p`.
+  /// With the field fixed, the shifts and masks fold to constants.
+  template<std::size_t Pos, std::size_t N>
+  inline std::uint64_t
+  extract_bits(const unsigned char* p, std::size_t size)
+  {
+    static_assert(N > 0 && N <= 64, "a field has 1 to 64 bits");
+    return extract_bits(p, size, Pos, N);
+  }
+
+  /// Writes the low `N` bits of `value` to the field at bit `Pos` of the
+  /// `size`-byte frame `p`.
+  template<std::size_t Pos, std::size_t N>
+  inline void
+  insert_bits(unsigned char* p, std::size_t size, std::uint64_t value)
+  {
+    static_assert(N > 0 && N <= 64, "a field has 1 to 64 bits");
+    insert_bits(p, size, Pos, N, value);
+  }
+
+} // namespace pip
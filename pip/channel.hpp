@@ -0,0 +1,62 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+
+#include <cstdint>
+#include <deque>
+
+namespace pip
+{
+  /// The reason a rule was removed.
+  enum removed_reason
+  {
+    rr_idle_timeout,
+    rr_hard_timeout,
+  };
+
+  /// Notifies the controller that a rule has been removed from a table.
+  struct flow_removed
+  {
+    table_decl* table;
+    pip::rule* rule;
+    removed_reason reason;
+
+    /// The time of removal (in ns of packet time).
+    std::uint64_t time;
+
+    /// The time (in ns) for which the rule was installed.
+    std::uint64_t duration;
+
+    /// The packets and bytes that selected the rule.
+    std::uint64_t packets;
+    std::uint64_t bytes;
+  };
+
+  /// The messages sent from the pipeline to the controller. Messages are
+  /// queued in the order sent until the controller receives them.
+  class controller_channel
+  {
+  public:
+    /// Queues a message for the controller.
+    void send(const flow_removed& m) { removed.push_back(m); }
+
+    /// Removes the oldest message into `m`. Returns false if there are no
+    /// messages.
+    bool
+    receive(flow_removed& m)
+    {
+      if (removed.empty())
+        return false;
+      m = removed.front();
+      removed.pop_front();
+      return true;
+    }
+
+    /// Returns true if there are no messages.
+    bool empty() const { return removed.empty(); }
+
+  private:
+    std::deque<flow_removed> removed;
+  };
+
+} // namespace pip
@@ -0,0 +1,242 @@
+#include "checksum.hpp"
+#include "action.hpp"
+#include "decl.hpp"
+#include "expr.hpp"
+#include "type.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <netinet/in.h>
+
+namespace pip
+{
+  namespace
+  {
+    // Frame offsets of the fields covered by checksums.
+    constexpr std::size_t ipv4_first = 14;
+    constexpr std::size_t ipv4_last = 34;
+    constexpr std::size_t ipv4_check = 24;
+    constexpr std::size_t ipv4_length = 16;
+    constexpr std::size_t ipv4_protocol = 23;
+    constexpr std::size_t ipv4_addrs = 26;
+    constexpr std::size_t tcp_first = 34;
+    constexpr std::size_t tcp_check = 50;
+    constexpr std::size_t tcp_min = 54;
+
+    inline bool
+    overlaps(std::size_t first, std::size_t last, std::size_t lo, std::size_t hi)
+    {
+      return first < hi && lo < last;
+    }
+
+    // Returns true if byte i of a frame is covered by checksum c.
+    inline bool
+    covers(checksum_set c, std::size_t i)
+    {
+      if (c == cs_ipv4)
+        return i >= ipv4_first && i < ipv4_last && (i < ipv4_check || i >= ipv4_check + 2);
+      if (i == tcp_check || i == tcp_check + 1)
+        return false;
+      return i == ipv4_length || i == ipv4_length + 1 || i == ipv4_protocol ||
+             i >= ipv4_addrs;
+    }
+
+    // Returns the 16-bit word at byte i, with the bytes not covered by c
+    // taken as zero.
+    inline std::uint16_t
+    covered_word(checksum_set c, const unsigned char* p, std::size_t n, std::size_t i)
+    {
+      std::uint16_t hi = i < n && covers(c, i) ? p[i] : 0;
+      std::uint16_t lo = i + 1 < n && covers(c, i + 1) ? p[i + 1] : 0;
+      return hi << 8 | lo;
+    }
+
+    inline std::uint16_t
+    load16(const unsigned char* p)
+    {
+      return p[0] << 8 | p[1];
+    }
+
+    inline void
+    store16(unsigned char* p, std::uint16_t v)
+    {
+      p[0] = v >> 8;
+      p[1] = v & 0xff;
+    }
+  } // namespace
+
+  std::uint8_t
+  covering_checksums(std::size_t first, std::size_t last)
+  {
+    std::uint8_t cs = cs_none;
+    if (overlaps(first, last, ipv4_first, ipv4_last) &&
+        !overlaps(first, last, ipv4_check, ipv4_check + 2))
+      cs |= cs_ipv4;
+    if ((overlaps(first, last, ipv4_length, ipv4_length + 2) ||
+         overlaps(first, last, ipv4_protocol, ipv4_protocol + 1) ||
+         last > ipv4_addrs) &&
+        !overlaps(first, last, tcp_check, tcp_check + 2))
+      cs |= cs_tcp;
+    return cs;
+  }
+
+  std::uint8_t
+  frame_checksums(const unsigned char* p, std::size_t n)
+  {
+    if (n < ipv4_last || load16(p + 12) != 0x0800 || p[ipv4_first] != 0x45)
+      return cs_none;
+    std::uint8_t cs = cs_ipv4;
+
+    // Only the first fragment carries the TCP header.
+    bool first_fragment = (load16(p + 20) & 0x1fff) == 0;
+    if (p[ipv4_protocol] == IPPROTO_TCP && n >= tcp_min && first_fragment)
+      cs |= cs_tcp;
+    return cs;
+  }
+
+  std::uint16_t
+  ones_sum(const unsigned char* p, std::size_t n)
+  {
+    // Sum native 32-bit words into a wide accumulator; the loop has no
+    // carries to propagate, so it vectorizes. The sum is independent of
+    // byte order up to a final swap (RFC 1071).
+    std::uint64_t acc = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      std::uint32_t w;
+      std::memcpy(&w, p + i, 4);
+      acc += w;
+    }
+    if (i + 2 <= n) {
+      std::uint16_t w;
+      std::memcpy(&w, p + i, 2);
+      acc += w;
+      i += 2;
+    }
+    if (i < n) {
+      unsigned char b[2] = {p[i], 0};
+      std::uint16_t w;
+      std::memcpy(&w, b, 2);
+      acc += w;
+    }
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    acc = (acc & 0xffffffff) + (acc >> 32);
+    return ntohs(ones_add(acc & 0xffff, acc >> 16));
+  }
+
+  std::size_t
+  checksum_offset(checksum_set c)
+  {
+    return c == cs_ipv4 ? ipv4_check : tcp_check;
+  }
+
+  void
+  update_checksums(unsigned char* p, std::size_t n, std::uint8_t cs,
+                   std::size_t first, std::size_t last,
+                   const unsigned char* old)
+  {
+    for (checksum_set c : {cs_ipv4, cs_tcp}) {
+      if (!(cs & c))
+        continue;
+      unsigned char* field = p + checksum_offset(c);
+      std::uint16_t sum = ~load16(field);
+      for (std::size_t i = first; i < last; i += 2) {
+        std::uint16_t was = covered_word(c, old - first, std::min(last, n), i);
+        std::uint16_t now = covered_word(c, p, n, i);
+        if (was != now)
+          sum = ones_add(ones_add(sum, std::uint16_t(~was)), now);
+      }
+      store16(field, ~sum);
+    }
+  }
+
+  void
+  recompute_checksums(unsigned char* p, std::size_t n, std::uint8_t cs)
+  {
+    if (cs & cs_ipv4) {
+      store16(p + ipv4_check, 0);
+      store16(p + ipv4_check, ~ones_sum(p + ipv4_first, ipv4_last - ipv4_first));
+    }
+    if (cs & cs_tcp) {
+      std::size_t total = load16(p + ipv4_length);
+      std::size_t segment = total - (ipv4_last - ipv4_first);
+      if (total < tcp_min - ipv4_first || tcp_first + segment > n)
+        return;
+      store16(p + tcp_check, 0);
+      std::uint16_t sum = ones_sum(p + ipv4_addrs, 8);
+      sum = ones_add(sum, IPPROTO_TCP);
+      sum = ones_add(sum, segment);
+      sum = ones_add(sum, ones_sum(p + tcp_first, segment));
+      store16(p + tcp_check, ~sum);
+    }
+  }
+
+  namespace
+  {
+    // Marks the checksums covering the destination of each action.
+    void
+    mark(action* a)
+    {
+      switch (get_kind(a)) {
+      case ak_set: {
+        auto s = cast<set_action>(a);
+        auto f = static_cast<bitfield_expr*>(s->f);
+        auto v = static_cast<int_expr*>(s->v);
+        std::size_t pos = static_cast<int_expr*>(f->pos)->val;
+        std::size_t len = static_cast<int_type*>(v->ty)->width;
+        s->checksums = covering_checksums(pos / 8, (pos + len + 7) / 8);
+        break;
+      }
+      case ak_copy: {
+        auto c = cast<copy_action>(a);
+        auto dst = static_cast<bitfield_expr*>(c->dst);
+        std::size_t pos = static_cast<int_expr*>(dst->pos)->val;
+        std::size_t len = static_cast<int_expr*>(dst->len)->val;
+        if (dst->as == as_packet)
+          c->checksums = covering_checksums(pos / 8, (pos + len + 7) / 8);
+        else if (dst->as == as_header)
+          c->checksums = cs_dynamic;
+        else
+          c->checksums = cs_none;
+        break;
+      }
+      case ak_write:
+        mark(cast<write_action>(a)->act);
+        break;
+      default:
+        break;
+      }
+    }
+
+    void
+    mark(action_seq& as)
+    {
+      for (action* a : as)
+        mark(a);
+    }
+  } // namespace
+
+  void
+  mark_checksums(program_decl* prog)
+  {
+    for (decl* d : prog->decls) {
+      switch (get_kind(d)) {
+      case dk_table: {
+        table_decl* t = cast<table_decl>(d);
+        mark(t->prep);
+        for (rule* r : t->rules)
+          mark(r->acts);
+        break;
+      }
+      case dk_group:
+        for (group_bucket& b : cast<group_decl>(d)->buckets)
+          mark(b.acts);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+
+} // namespace pip
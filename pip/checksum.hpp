@@ -0,0 +1,79 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pip
+{
+  /// A set of header checksums. As elsewhere, frames are Ethernet/IPv4
+  /// with no IPv4 options.
+  enum checksum_set : std::uint8_t
+  {
+    cs_none = 0,
+
+    /// The IPv4 header checksum.
+    cs_ipv4 = 1,
+
+    /// The TCP checksum, which also covers the addresses, protocol, and
+    /// length of the IPv4 header.
+    cs_tcp = 2,
+
+    /// The checksums depend on the decode offset and are determined when
+    /// the write executes.
+    cs_dynamic = 0x80,
+  };
+
+  /// The largest write, in bytes, whose checksums are updated in place.
+  /// Checksums covering larger writes are recomputed once at egress.
+  constexpr std::size_t max_fixup_bytes = 32;
+
+  /// Returns the checksums that cover any byte in [first, last) of a frame.
+  /// A write that touches the checksum field itself is taken to set it,
+  /// so that checksum is excluded.
+  std::uint8_t covering_checksums(std::size_t first, std::size_t last);
+
+  /// Returns the checksums present in the `n`-byte frame `p`.
+  std::uint8_t frame_checksums(const unsigned char* p, std::size_t n);
+
+  /// Returns the one's-complement sum of `n` bytes, in host order.
+  std::uint16_t ones_sum(const unsigned char* p, std::size_t n);
+
+  /// Returns the one's-complement sum of `a` and `b`.
+  inline std::uint16_t
+  ones_add(std::uint32_t a, std::uint32_t b)
+  {
+    std::uint32_t s = a + b;
+    s = (s & 0xffff) + (s >> 16);
+    return (s & 0xffff) + (s >> 16);
+  }
+
+  /// Returns the checksum `check` updated for the replacement of the
+  /// 16-bit word `old_word` with `new_word` (RFC 1624, eqn. 3).
+  inline std::uint16_t
+  checksum_replace(std::uint16_t check, std::uint16_t old_word, std::uint16_t new_word)
+  {
+    return ~ones_add(ones_add(std::uint16_t(~check), std::uint16_t(~old_word)), new_word);
+  }
+
+  /// Updates the checksums in `cs` of the `n`-byte frame `p` after bytes
+  /// [first, last) changed from `old` to their current value. The range
+  /// must start and end on a 16-bit boundary of the frame, and `old` holds
+  /// its previous contents.
+  void update_checksums(unsigned char* p, std::size_t n, std::uint8_t cs,
+                        std::size_t first, std::size_t last,
+                        const unsigned char* old);
+
+  /// Recomputes the checksums in `cs` of the `n`-byte frame `p`. The TCP
+  /// checksum is only recomputed if the whole segment was captured.
+  void recompute_checksums(unsigned char* p, std::size_t n, std::uint8_t cs);
+
+  /// Returns the byte offset of the field holding checksum `c`.
+  std::size_t checksum_offset(checksum_set c);
+
+  /// Determines the checksums covering the destination of each set and
+  /// copy action in the program.
+  void mark_checksums(program_decl* prog);
+
+} // namespace pip
@@ -0,0 +1,30 @@
+#include "clock.hpp"
+
+namespace pip
+{
+  static double
+  calibrate()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    // Spin for 10ms and compare the elapsed cycles to elapsed time.
+    std::uint64_t t0 = monotonic_ns();
+    std::uint64_t c0 = read_cycles();
+    std::uint64_t t1;
+    do
+      t1 = monotonic_ns();
+    while (t1 - t0 < 10000000);
+    std::uint64_t c1 = read_cycles();
+    return double(t1 - t0) / double(c1 - c0);
+#else
+    return 1.0;
+#endif
+  }
+
+  double
+  ns_per_cycle()
+  {
+    static const double ratio = calibrate();
+    return ratio;
+  }
+
+} // namespace pip
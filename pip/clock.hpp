@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#endif
+
+namespace pip
+{
+  /// Returns the value of a cheap, monotonic cycle counter. On x86 this is
+  /// the time stamp counter; elsewhere it is CLOCK_MONOTONIC in nanoseconds.
+  inline std::uint64_t
+  read_cycles()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return std::uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+  }
+
+  /// Returns CLOCK_MONOTONIC in nanoseconds.
+  inline std::uint64_t
+  monotonic_ns()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return std::uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  /// Returns the number of nanoseconds per cycle of read_cycles(). The
+  /// ratio is calibrated against CLOCK_MONOTONIC on first use, which
+  /// takes about 10 milliseconds.
+  double ns_per_cycle();
+
+} // namespace pip
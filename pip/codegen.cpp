@@ -19,6 +19,12 @@ generator::generate()
     case dk_table:
       generate_table_decl(static_cast<table_decl*>(d));
       break;
+    case dk_meter:
+      generate_meter_decl(static_cast<meter_decl*>(d));
+      break;
+    case dk_group:
+      generate_group_decl(static_cast<group_decl*>(d));
+      break;
     default:
       throw std::runtime_error("Invalid declaration.");
     }
@@ -52,6 +58,75 @@ generator::generate_table_decl(table_decl* t)
   code << ")\n";
 }
 
+void
+generator::generate_meter_decl(meter_decl* m)
+{
+  code << "(meter " << *m->id << " ";
+  switch(m->unit)
+  {
+  case mu_pps:
+    code << "pps\n";
+    break;
+  case mu_kbps:
+    code << "kbps\n";
+    break;
+  }
+
+  code << " (bands ";
+  for(const meter_band& b : m->bands)
+  {
+    switch(b.kind)
+    {
+    case bk_drop:
+      code << "(band drop " << b.rate << " " << b.burst << ") ";
+      break;
+    case bk_dscp_remark:
+      code << "(band dscp_remark " << b.rate << " " << b.burst << " "
+           << b.prec_level << ") ";
+      break;
+    }
+  }
+  code << ")\n";
+
+  code << ")\n";
+}
+
+void
+generator::generate_group_decl(group_decl* g)
+{
+  code << "(group " << *g->id << " ";
+  switch(g->kind)
+  {
+  case gk_all:
+    code << "all\n";
+    break;
+  case gk_select:
+    code << "select\n";
+    break;
+  case gk_indirect:
+    code << "indirect\n";
+    break;
+  case gk_fast_failover:
+    code << "fast_failover\n";
+    break;
+  }
+
+  code << " (buckets\n";
+  for(group_bucket& b : g->buckets)
+  {
+    code << "(bucket ";
+    if(b.watch_port != no_watch_port)
+      code << "watch " << b.watch_port << " ";
+    else if(b.weight != 1)
+      code << "weight " << b.weight << " ";
+    generate_action_seq(b.acts);
+    code << ")\n";
+  }
+  code << ")\n";
+
+  code << ")\n";
+}
+
 // Sequences
 void
 generator::generate_action_seq(action_seq& as)
@@ -94,6 +169,12 @@ generator::generate_action(action* a)
   case ak_set:
     generate_set_action(static_cast<set_action*>(a));
     break;
+  case ak_meter:
+    generate_meter_action(static_cast<meter_action*>(a));
+    break;
+  case ak_conntrack:
+    generate_conntrack_action(static_cast<conntrack_action*>(a));
+    break;
   case ak_write:
     generate_write_action(static_cast<write_action*>(a));
     break;
@@ -112,6 +193,9 @@ generator::generate_action(action* a)
   case ak_output:
     generate_output_action(static_cast<output_action*>(a));
     break;
+  case ak_group:
+    generate_group_action(static_cast<group_action*>(a));
+    break;
   }
 }
 
@@ -140,6 +224,8 @@ address_space_to_string(address_space as)
     return std::string("ingress_port");
   case as_physical_port:
     return std::string("physical_port");
+  case as_ct_state:
+    return std::string("ct_state");
   }
 }
   
@@ -163,6 +249,20 @@ generator::generate_set_action(set_action* a)
   code << ") ";
 }
 
+void
+generator::generate_meter_action(meter_action* a)
+{
+  code << "(meter ";
+  generate_expr(a->meter);
+  code << ") ";
+}
+
+void
+generator::generate_conntrack_action(conntrack_action* a)
+{
+  code << (a->commit ? "(conntrack commit) " : "(conntrack) ");
+}
+
 void
 generator::generate_write_action(write_action* a)
 {
@@ -205,6 +305,14 @@ generator::generate_output_action(output_action* a)
   code << ") ";
 }
 
+void
+generator::generate_group_action(group_action* a)
+{
+  code << "(group ";
+  generate_expr(a->group);
+  code << ") ";
+}
+
 
 // Expressions
 void
@@ -228,6 +336,8 @@ generator::generate_expr(expr* e)
     return generate_port_expr(static_cast<port_expr*>(e));
   case ek_bitfield:
     return generate_bitfield_expr(static_cast<bitfield_expr*>(e));
+  case ek_key:
+    return generate_key_expr(static_cast<key_expr*>(e));
   }
 }
 
@@ -290,12 +400,23 @@ generator::generate_bitfield_expr(bitfield_expr* e)
   code << ") ";
 }
 
+void
+generator::generate_key_expr(key_expr* e)
+{
+  code << "(key ";
+  for(expr* f : e->fields)
+    generate_expr(f);
+  code << ") ";
+}
+
 // Misc
 void
 generator::generate_rule(rule* r)
 {
   code << "(rule ";
   generate_expr(r->key);
+  if(r->idle_timeout || r->hard_timeout)
+    code << "(timeouts " << r->idle_timeout << " " << r->hard_timeout << ") ";
   generate_action_seq(r->acts);
   code << ") ";
 }
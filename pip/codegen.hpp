@@ -21,6 +21,8 @@ public:
 private:
   // Declarations
   void generate_table_decl(table_decl* t);
+  void generate_meter_decl(meter_decl* m);
+  void generate_group_decl(group_decl* g);
 
   // Sequences
   void generate_action_seq(action_seq& as);
@@ -32,12 +34,15 @@ private:
   void generate_advance_action(advance_action* a);
   void generate_copy_action(copy_action* a);
   void generate_set_action(set_action* a);
+  void generate_meter_action(meter_action* a);
+  void generate_conntrack_action(conntrack_action* a);
   void generate_write_action(write_action* a);
   void generate_clear_action(clear_action* a);
   void generate_drop_action(drop_action* a);
   void generate_match_action(match_action* a);
   void generate_goto_action(goto_action* a);
   void generate_output_action(output_action* a);
+  void generate_group_action(group_action* a);
 
   // Expressions
   void generate_expr(expr* e);
@@ -49,6 +54,7 @@ private:
   void generate_port_expr(port_expr* e);
   void generate_miss_expr(miss_expr* e);
   void generate_bitfield_expr(bitfield_expr* e);
+  void generate_key_expr(key_expr* e);
 
   // Misc
   void generate_rule(rule* r);
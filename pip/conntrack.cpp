@@ -0,0 +1,328 @@
+#include "conntrack.hpp"
+#include "flow_cache.hpp"
+#include "bitfield.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include <netinet/in.h>
+
+namespace pip
+{
+  constexpr std::size_t conntrack_table::default_shards;
+  constexpr std::uint64_t conntrack_table::tick_ns;
+
+  namespace
+  {
+    // TCP flags.
+    constexpr std::uint8_t tcp_fin = 0x01;
+    constexpr std::uint8_t tcp_syn = 0x02;
+    constexpr std::uint8_t tcp_rst = 0x04;
+    constexpr std::uint8_t tcp_ack = 0x10;
+
+    constexpr std::uint64_t seconds = 1000000000;
+
+    // Returns the first tick at or after the time `ns`.
+    inline std::uint64_t
+    to_tick(std::uint64_t ns)
+    {
+      return (ns + conntrack_table::tick_ns - 1) / conntrack_table::tick_ns;
+    }
+
+    inline std::uint32_t
+    timer_id(std::uint32_t slot, std::uint8_t gen)
+    {
+      return slot << 8 | gen;
+    }
+  } // namespace
+
+  std::size_t
+  conn_hash::operator()(const conn_key& k) const
+  {
+    unsigned char buf[13];
+    std::memcpy(buf, k.addr, 8);
+    std::memcpy(buf + 8, k.port, 4);
+    buf[12] = k.proto;
+    return hash_key(buf, sizeof buf);
+  }
+
+  std::uint64_t
+  conntrack_table::timeout(conn_state s)
+  {
+    switch (s) {
+    case cn_syn_sent:
+      return 120 * seconds;
+    case cn_syn_recv:
+      return 60 * seconds;
+    case cn_established:
+      return 432000 * seconds;
+    case cn_fin_wait:
+    case cn_time_wait:
+      return 120 * seconds;
+    case cn_close:
+      return 10 * seconds;
+    case cn_udp_unreplied:
+      return 30 * seconds;
+    case cn_udp_replied:
+      return 180 * seconds;
+    }
+    return 0;
+  }
+
+  conntrack_table::conntrack_table(std::size_t capacity, std::size_t n)
+    : nshards(std::max<std::size_t>(n, 1))
+  {
+    limit = std::max<std::size_t>(capacity / nshards, 1);
+
+    // Over-allocate by one line so that the shards can be aligned.
+    storage.reset(new unsigned char[nshards * sizeof(shard) + cache_line_size]);
+    auto base = reinterpret_cast<std::uintptr_t>(storage.get());
+    std::size_t pad = (cache_line_size - base % cache_line_size) % cache_line_size;
+    shards = reinterpret_cast<shard*>(storage.get() + pad);
+    for (std::size_t i = 0; i < nshards; ++i)
+      new (&shards[i]) shard;
+  }
+
+  conntrack_table::~conntrack_table()
+  {
+    for (std::size_t i = 0; i < nshards; ++i)
+      shards[i].~shard();
+  }
+
+  std::uint32_t
+  conntrack_table::track(const unsigned char* p, std::size_t n,
+                         std::uint64_t now, bool commit)
+  {
+    // Only the first fragment of an IPv4 packet (without options) carries
+    // the ports.
+    if (n < 38 || extract_bits<96, 16>(p, n) != 0x0800 || p[14] != 0x45 ||
+        extract_bits<163, 13>(p, n) != 0)
+      return ct_trk | ct_inv;
+    std::uint8_t proto = p[23];
+    if (proto != IPPROTO_TCP && proto != IPPROTO_UDP)
+      return ct_trk | ct_inv;
+    if (proto == IPPROTO_TCP && n < 48)
+      return ct_trk | ct_inv;
+
+    std::uint32_t src = extract_bits<208, 32>(p, n);
+    std::uint32_t dst = extract_bits<240, 32>(p, n);
+    std::uint16_t sport = extract_bits<272, 16>(p, n);
+    std::uint16_t dport = extract_bits<288, 16>(p, n);
+    bool src_first = src < dst || (src == dst && sport <= dport);
+
+    conn_key key;
+    key.addr[0] = src_first ? src : dst;
+    key.addr[1] = src_first ? dst : src;
+    key.port[0] = src_first ? sport : dport;
+    key.port[1] = src_first ? dport : sport;
+    key.proto = proto;
+    std::uint8_t flags = proto == IPPROTO_TCP ? p[47] : 0;
+    bool syn_only = (flags & (tcp_syn | tcp_ack | tcp_rst)) == tcp_syn;
+
+    std::size_t h = conn_hash()(key);
+    shard& s = shard_for(h);
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    auto iter = s.index.find(key);
+    if (iter != s.index.end() && s.slab[iter->second].expires <= now) {
+      // Timed out, but its timer has not yet fired.
+      release(s, iter->second);
+      iter = s.index.end();
+    }
+
+    if (iter == s.index.end()) {
+      if (proto == IPPROTO_TCP && !syn_only)
+        return ct_trk | ct_inv;
+      if (!commit)
+        return ct_trk | ct_new;
+      if (s.index.size() >= limit) {
+        ++s.refused;
+        return ct_trk | ct_new;
+      }
+
+      std::uint32_t slot;
+      if (!s.unused.empty()) {
+        slot = s.unused.back();
+        s.unused.pop_back();
+      }
+      else {
+        slot = s.slab.size();
+        s.slab.emplace_back();
+        s.slab.back().gen = 0;
+      }
+      entry& e = s.slab[slot];
+      e.key = key;
+      e.state = proto == IPPROTO_TCP ? cn_syn_sent : cn_udp_unreplied;
+      e.orig_first = src_first;
+      e.fin[0] = e.fin[1] = false;
+      e.used = true;
+      e.expires = now + timeout(e.state);
+      e.armed = 0;
+      s.index.emplace(key, slot);
+
+      // An idle wheel may lag far behind; catch it up so the timer lands
+      // within its range.
+      if (s.wheel.size() == 0)
+        s.wheel.advance(now / tick_ns, [](const timer_wheel::timer&) { });
+      arm(s, slot);
+      return ct_trk | ct_new;
+    }
+
+    std::uint32_t slot = iter->second;
+    entry& e = s.slab[slot];
+    bool reply = src_first != e.orig_first;
+    bool valid = true;
+
+    switch (e.state) {
+    case cn_udp_unreplied:
+      if (reply)
+        e.state = cn_udp_replied;
+      break;
+    case cn_udp_replied:
+      break;
+    default:
+      if (flags & tcp_rst) {
+        e.state = cn_close;
+        break;
+      }
+      if (syn_only && (e.state == cn_time_wait || e.state == cn_close)) {
+        // The ports are being reused for a new connection.
+        e.state = cn_syn_sent;
+        e.orig_first = src_first;
+        e.fin[0] = e.fin[1] = false;
+        reply = false;
+        break;
+      }
+      switch (e.state) {
+      case cn_syn_sent:
+        if (reply && (flags & (tcp_syn | tcp_ack)) == (tcp_syn | tcp_ack))
+          e.state = cn_syn_recv;
+        else if (reply || !syn_only)
+          valid = false;
+        break;
+      case cn_syn_recv:
+        if (!reply && (flags & (tcp_syn | tcp_ack)) == tcp_ack)
+          e.state = cn_established;
+        else if (flags & tcp_syn && !(reply ? flags & tcp_ack : syn_only))
+          valid = false;
+        break;
+      case cn_established:
+      case cn_fin_wait:
+        if (flags & tcp_syn) {
+          valid = false;
+          break;
+        }
+        if (flags & tcp_fin)
+          e.fin[reply] = true;
+        if (e.fin[0] && e.fin[1])
+          e.state = cn_time_wait;
+        else if (e.fin[0] || e.fin[1])
+          e.state = cn_fin_wait;
+        break;
+      case cn_time_wait:
+        break;
+      case cn_close:
+        valid = false;
+        break;
+      default:
+        break;
+      }
+      break;
+    }
+
+    std::uint32_t state = ct_trk;
+    if (reply)
+      state |= ct_rpl;
+    if (!valid)
+      return state | ct_inv;
+
+    bool replied = e.state != cn_syn_sent && e.state != cn_udp_unreplied;
+    state |= replied ? ct_est : ct_new;
+
+    // Renew the connection. Its timer only needs to move if the new
+    // timeout is sooner.
+    e.expires = now + timeout(e.state);
+    if (to_tick(e.expires) < e.armed)
+      arm(s, slot);
+    return state;
+  }
+
+  // Sets a timer for the expiry of a connection.
+  void
+  conntrack_table::arm(shard& s, std::uint32_t slot)
+  {
+    entry& e = s.slab[slot];
+    std::uint64_t tick = to_tick(e.expires);
+    s.wheel.schedule(timer_id(slot, e.gen), tick);
+    e.armed = std::max(e.armed, tick);
+  }
+
+  void
+  conntrack_table::release(shard& s, std::uint32_t slot)
+  {
+    entry& e = s.slab[slot];
+    s.index.erase(e.key);
+    e.used = false;
+    ++e.gen;
+    s.unused.push_back(slot);
+  }
+
+  void
+  conntrack_table::expire(shard& s, const timer_wheel::timer& tm, std::uint64_t now)
+  {
+    std::uint32_t slot = tm.id >> 8;
+    entry& e = s.slab[slot];
+    if (!e.used || e.gen != std::uint8_t(tm.id))
+      return;
+    if (e.expires <= now) {
+      release(s, slot);
+      return;
+    }
+
+    // Reschedule, unless a timer is already set for the new expiry.
+    if (e.armed <= s.wheel.now())
+      e.armed = 0;
+    if (to_tick(e.expires) < e.armed || e.armed == 0)
+      arm(s, slot);
+  }
+
+  void
+  conntrack_table::advance(std::uint64_t now)
+  {
+    // Timers only fire on tick boundaries.
+    if (now / tick_ns == current)
+      return;
+    current = now / tick_ns;
+    for (std::size_t i = 0; i < nshards; ++i) {
+      shard& s = shards[i];
+      std::lock_guard<std::mutex> guard(s.lock);
+      s.wheel.advance(now / tick_ns, [this, &s, now](const timer_wheel::timer& tm) {
+        expire(s, tm, now);
+      });
+    }
+  }
+
+  std::size_t
+  conntrack_table::size() const
+  {
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < nshards; ++i) {
+      std::lock_guard<std::mutex> guard(shards[i].lock);
+      n += shards[i].index.size();
+    }
+    return n;
+  }
+
+  std::uint64_t
+  conntrack_table::refused() const
+  {
+    std::uint64_t n = 0;
+    for (std::size_t i = 0; i < nshards; ++i) {
+      std::lock_guard<std::mutex> guard(shards[i].lock);
+      n += shards[i].refused;
+    }
+    return n;
+  }
+
+} // namespace pip
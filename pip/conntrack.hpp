@@ -0,0 +1,177 @@
+#pragma once
+
+#include <pip/stats.hpp>
+#include <pip/timeout.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace pip
+{
+  /// The bits of the ct_state register.
+  enum ct_state_bits : std::uint32_t
+  {
+    /// The packet starts a connection, or belongs to one that has not yet
+    /// seen a reply.
+    ct_new = 0x01,
+
+    /// The packet belongs to a connection that has seen a reply.
+    ct_est = 0x02,
+
+    /// The packet flows in the reply direction.
+    ct_rpl = 0x08,
+
+    /// The packet is not valid for the state of its connection, or it
+    /// cannot be tracked.
+    ct_inv = 0x10,
+
+    /// The packet has been through connection tracking.
+    ct_trk = 0x20,
+  };
+
+  /// The protocol state of a connection.
+  enum conn_state : std::uint8_t
+  {
+    cn_syn_sent,
+    cn_syn_recv,
+    cn_established,
+    cn_fin_wait,
+    cn_time_wait,
+    cn_close,
+    cn_udp_unreplied,
+    cn_udp_replied,
+  };
+
+  /// Identifies a connection. The endpoints are kept in a canonical order,
+  /// so both directions of a connection have the same key.
+  struct conn_key
+  {
+    std::uint32_t addr[2];
+    std::uint16_t port[2];
+    std::uint8_t proto;
+
+    bool
+    operator==(const conn_key& k) const
+    {
+      return addr[0] == k.addr[0] && addr[1] == k.addr[1] &&
+             port[0] == k.port[0] && port[1] == k.port[1] &&
+             proto == k.proto;
+    }
+  };
+
+  struct conn_hash
+  {
+    std::size_t operator()(const conn_key& k) const;
+  };
+
+  /// Tracks TCP and UDP connections over IPv4.
+  ///
+  /// Connections are spread over shards by the hash of their key. Each
+  /// shard is guarded by its own lock and kept on its own cache lines, so
+  /// workers tracking different connections rarely contend.
+  ///
+  /// A TCP connection follows the SYN, SYN-ACK, ACK handshake and the
+  /// FIN exchange of each direction; an RST closes it. A connection is
+  /// established once the handshake completes; a UDP connection once a
+  /// reply is seen. Only a SYN without ACK can start a TCP connection, so
+  /// connections picked up mid-stream are invalid.
+  ///
+  /// Each state has a timeout, renewed by each packet. Expiry runs on
+  /// packet time, as with rule timeouts: every connection has a timer in
+  /// its shard's timing wheel, and a timer that fires for a connection
+  /// that has seen traffic is rescheduled. Renewing a connection does not
+  /// touch its timer.
+  class conntrack_table
+  {
+  public:
+    /// The default number of shards.
+    static constexpr std::size_t default_shards = 64;
+
+    /// The length of a timer tick, in nanoseconds.
+    static constexpr std::uint64_t tick_ns = 100000000;
+
+    /// Creates a table holding up to `capacity` connections.
+    conntrack_table(std::size_t capacity = 1 << 20,
+                    std::size_t shards = default_shards);
+    ~conntrack_table();
+
+    conntrack_table(const conntrack_table&) = delete;
+    conntrack_table& operator=(const conntrack_table&) = delete;
+
+    /// Tracks the packet in the `n`-byte frame `p`, arriving at `now` (in
+    /// ns), and returns its ct_state. If `commit` is true, a packet that
+    /// validly starts a connection adds it to the table; otherwise the
+    /// packet is only classified. This may be called concurrently.
+    std::uint32_t track(const unsigned char* p, std::size_t n,
+                        std::uint64_t now, bool commit);
+
+    /// Removes the connections that have timed out by `now` (in ns). This
+    /// must not be called concurrently with itself.
+    void advance(std::uint64_t now);
+
+    /// Returns the number of connections.
+    std::size_t size() const;
+
+    /// Returns the number of connections not committed because the table
+    /// was full.
+    std::uint64_t refused() const;
+
+    /// Returns the timeout, in ns, of a connection in state `s`.
+    static std::uint64_t timeout(conn_state s);
+
+  private:
+    struct entry
+    {
+      conn_key key;
+      conn_state state;
+
+      /// True if the originator is endpoint 0 of the key.
+      bool orig_first;
+
+      /// True if the direction (originator, reply) has sent a FIN.
+      bool fin[2];
+
+      /// Incremented each time the slot is reused, so that timers set for
+      /// a previous connection are ignored.
+      std::uint8_t gen;
+
+      bool used;
+
+      /// The time at which the connection times out.
+      std::uint64_t expires;
+
+      /// The tick of the latest timer set for the connection.
+      std::uint64_t armed;
+    };
+
+    struct alignas(cache_line_size) shard
+    {
+      std::mutex lock;
+      std::unordered_map<conn_key, std::uint32_t, conn_hash> index;
+      std::vector<entry> slab;
+      std::vector<std::uint32_t> unused;
+      timer_wheel wheel;
+      std::uint64_t refused = 0;
+    };
+
+    shard& shard_for(std::size_t hash) { return shards[(hash >> 32) % nshards]; }
+
+    void arm(shard& s, std::uint32_t slot);
+    void release(shard& s, std::uint32_t slot);
+    void expire(shard& s, const timer_wheel::timer& tm, std::uint64_t now);
+
+    /// The maximum number of connections in each shard.
+    std::size_t limit;
+
+    std::unique_ptr<unsigned char[]> storage;
+    shard* shards;
+    std::size_t nshards;
+
+    /// The tick last advanced to.
+    std::uint64_t current = 0;
+  };
+
+} // namespace pip
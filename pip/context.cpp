@@ -93,6 +93,13 @@ namespace pip
     expression_pool.emplace_back(new bitfield_expr(new loc_type, space, pos, len));
     return expression_pool.back();
   }
+
+  expr*
+  context::make_key_expr(type* t, const expr_seq& fields, const key_value& value)
+  {
+    expression_pool.emplace_back(new key_expr(t, fields, value));
+    return expression_pool.back();
+  }
   
   action*
   context::make_advance_action(expr* amount)
@@ -115,6 +122,20 @@ namespace pip
     return action_pool.back();
   }
 
+  action*
+  context::make_meter_action(expr* m)
+  {
+    action_pool.emplace_back(new meter_action(m));
+    return action_pool.back();
+  }
+
+  action*
+  context::make_conntrack_action(bool commit)
+  {
+    action_pool.emplace_back(new conntrack_action(commit));
+    return action_pool.back();
+  }
+
   action*
   context::make_write_action(action* act)
   {
@@ -155,7 +176,14 @@ namespace pip
   {
     action_pool.emplace_back(new output_action(p));
     return action_pool.back();
-  }  
+  }
+
+  action*
+  context::make_group_action(expr* g)
+  {
+    action_pool.emplace_back(new group_action(g));
+    return action_pool.back();
+  }
 }
   
   
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <pip/syntax.hpp>
+#include <pip/key.hpp>
 
 #include <cc/diagnostics.hpp>
 #include <cc/factory.hpp>
@@ -42,16 +43,20 @@ namespace pip
     expr* make_port_expr(type* t, expr* port_num);
     expr* make_port_expr(type* t, symbol* port_name);
     expr* make_bitfield_expr(address_space space, expr* pos, expr* len);
+    expr* make_key_expr(type* t, const expr_seq& fields, const key_value& value);
 
     action* make_advance_action(expr* amount);
     action* make_copy_action(expr* src, expr* dst, expr* n);
     action* make_set_action(expr* f, expr* v);
+    action* make_meter_action(expr* m);
+    action* make_conntrack_action(bool commit);
     action* make_write_action(action* act);
     action* make_clear_action();
     action* make_drop_action();
     action* make_match_action();
     action* make_goto_action(expr* table);
     action* make_output_action(expr* p);
+    action* make_group_action(expr* g);
     
   private:
     /// The diagnostic manager.
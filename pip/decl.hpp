@@ -1,8 +1,10 @@
 #pragma once
 
 #include <pip/syntax.hpp>
-#include <functional>
-#include <unordered_set>
+#include <pip/table.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace pip
 {
@@ -12,6 +14,7 @@ namespace pip
     dk_program,
     dk_table,
     dk_meter,
+    dk_group,
   };
 
   // Kinds of matching strategies.
@@ -61,6 +64,18 @@ namespace pip
 
     /// A list of declarations.
     decl_seq decls;
+
+    /// The smallest frame, in bytes, in which every packet and header
+    /// access of the program is in bounds. Set by the type checker.
+    std::size_t min_frame_size = 0;
+
+    /// The tables of the program, indexed by table_decl::index. Set by
+    /// build_tables, so that evaluation need not search the declarations.
+    std::vector<table_decl*> tables;
+
+    /// The table at which evaluation starts, the first declared. Set by
+    /// build_tables.
+    table_decl* entry = nullptr;
   };
 
   /// Represents a match in a table. This is a key/value pair where the key
@@ -85,6 +100,17 @@ namespace pip
 
     /// The list of actions to be executed.
     action_seq acts;
+
+    /// The program-wide index of the rule, used to address per-rule state.
+    std::uint32_t index = 0;
+
+    /// The number of seconds without a match after which the rule is
+    /// removed, or 0 if the rule never idles out.
+    std::uint32_t idle_timeout = 0;
+
+    /// The number of seconds after which the rule is removed, or 0 if the
+    /// rule is permanent.
+    std::uint32_t hard_timeout = 0;
   };
 
 
@@ -117,18 +143,105 @@ namespace pip
     /// The content of the action table.
     rule_seq rules;
 
-    /// A hash table to match keys for exact-match tables
-    std::unordered_set<std::uint64_t, std::hash<std::uint64_t>> key_table;
+    /// The lookup structure of the table, built from its rules by
+    /// build_tables.
+    std::unique_ptr<table_engine> engine;
+
+    /// The program-wide index of the table, used to address per-table state.
+    std::uint32_t index = 0;
   };
 
-  /// A flow metering device.
-  ///
-  /// \todo Implement this?
+  // Units of meter rates and bursts.
+  enum meter_unit : int
+  {
+    mu_pps,
+    mu_kbps,
+  };
+
+  // Kinds of meter bands.
+  enum band_kind : int
+  {
+    bk_drop,
+    bk_dscp_remark,
+  };
+
+  /// A meter band. A band applies to packets that exceed its rate. Rates
+  /// are in packets per second or kilobits per second, and bursts are in
+  /// packets or kilobits, according to the unit of the meter.
+  struct meter_band
+  {
+    band_kind kind;
+    std::uint64_t rate;
+    std::uint64_t burst;
+
+    /// For dscp_remark bands, the amount by which the drop precedence of
+    /// the packet is increased.
+    std::uint32_t prec_level;
+  };
+
+  using band_seq = std::vector<meter_band>;
+
+  /// A flow metering device. Packets applied to a meter are measured
+  /// against the rate of each band. Of the bands whose rate is exceeded,
+  /// the band with the highest rate is applied to the packet.
   struct meter_decl : decl
   {
-    meter_decl(symbol* id)
-      : decl(dk_meter, id)
+    meter_decl(symbol* id, meter_unit u, band_seq&& bs)
+      : decl(dk_meter, id), unit(u), bands(std::move(bs))
     { }
+
+    /// The unit of band rates and bursts.
+    meter_unit unit;
+
+    /// The bands of the meter.
+    band_seq bands;
+
+    /// The program-wide index of the meter, used to address meter state.
+    std::uint32_t index = 0;
+  };
+
+  // Kinds of groups.
+  enum group_kind : int
+  {
+    gk_all,
+    gk_select,
+    gk_indirect,
+    gk_fast_failover,
+  };
+
+  /// Indicates that a bucket does not watch a port.
+  constexpr std::int32_t no_watch_port = -1;
+
+  /// A bucket of a group: a list of actions, a weight used by select
+  /// groups, and a port whose liveness determines the liveness of the
+  /// bucket.
+  struct group_bucket
+  {
+    std::uint32_t weight = 1;
+    std::int32_t watch_port = no_watch_port;
+    action_seq acts;
+  };
+
+  using bucket_seq = std::vector<group_bucket>;
+
+  /// A group of action buckets. An all group executes every bucket, a
+  /// select group executes one bucket chosen by a hash of the packet's
+  /// 5-tuple, an indirect group executes its only bucket, and a
+  /// fast-failover group executes the first live bucket.
+  struct group_decl : decl
+  {
+    group_decl(symbol* id, group_kind k, bucket_seq&& bs)
+      : decl(dk_group, id), kind(k), buckets(std::move(bs))
+    { }
+
+    /// The kind of group.
+    group_kind kind;
+
+    /// The buckets of the group.
+    bucket_seq buckets;
+
+    /// The program-wide index of the group, used to address group state.
+    std::uint32_t index = 0;
   };
 
 // -------------------------------------------------------------------------- //
@@ -169,4 +282,11 @@ namespace cc
     has_kind(const node* n) { return get_node_kind(n) == pip::dk_meter; }
   };
 
+  template<>
+  struct node_info<pip::group_decl>
+  {
+    static bool
+    has_kind(const node* n) { return get_node_kind(n) == pip::dk_group; }
+  };
+
 } // namespace cc
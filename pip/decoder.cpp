@@ -37,6 +37,15 @@ decoder::decode_named_field(named_field_expr* field) const
   if(*(field->field) == "ipv4.dst")
     return ipv4_dst_addr();
 
+  if(*(field->field) == "ipv6.len")
+    return ipv6_len();
+  if(*(field->field) == "ipv6.protocol")
+    return ipv6_protocol();
+  if(*(field->field) == "ipv6.src")
+    return ipv6_src_addr();
+  if(*(field->field) == "ipv6.dst")
+    return ipv6_dst_addr();
+
   if(*(field->field) == "tcp.src")
     return tcp_src_port();
   if(*(field->field) == "tcp.dst")
@@ -164,10 +173,34 @@ decoder::ipv4_dst_addr() const
 bitfield_expr* 
 decoder::ipv6_len() const
 {
-  expr* pos = cxt.make_int_expr(new int_type(128), (size_ethernet + 2) * 8);
-  expr* len = cxt.make_int_expr(new int_type(128), 16);
+  expr* pos = cxt.make_int_expr(new int_type(32), (size_ethernet + 4) * 8);
+  expr* len = cxt.make_int_expr(new int_type(32), 16);
+  return static_cast<bitfield_expr*>(cxt.make_bitfield_expr(as_packet, pos, len));
+}
+
+bitfield_expr*
+decoder::ipv6_protocol() const
+{
+  expr* pos = cxt.make_int_expr(new int_type(32), (size_ethernet + 6) * 8);
+  expr* len = cxt.make_int_expr(new int_type(32), 8);
   return static_cast<bitfield_expr*>(cxt.make_bitfield_expr(as_packet, pos, len));
+}
 
+// The addresses are 128 bits wide; they are matched in the key register.
+bitfield_expr*
+decoder::ipv6_src_addr() const
+{
+  expr* pos = cxt.make_int_expr(new int_type(32), (size_ethernet + 8) * 8);
+  expr* len = cxt.make_int_expr(new int_type(32), 128);
+  return static_cast<bitfield_expr*>(cxt.make_bitfield_expr(as_packet, pos, len));
+}
+
+bitfield_expr*
+decoder::ipv6_dst_addr() const
+{
+  expr* pos = cxt.make_int_expr(new int_type(32), (size_ethernet + 24) * 8);
+  expr* len = cxt.make_int_expr(new int_type(32), 128);
+  return static_cast<bitfield_expr*>(cxt.make_bitfield_expr(as_packet, pos, len));
 }
 
 bitfield_expr*
@@ -0,0 +1,308 @@
+#include "device.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace pip
+{
+namespace cap
+{
+  namespace
+  {
+    [[noreturn]] void
+    io_error(const char* what, const char* name)
+    {
+      std::stringstream ss;
+      ss << what << " '" << name << "': " << std::strerror(errno);
+      throw std::runtime_error(ss.str());
+    }
+
+    /// The offset of the frame data in a transmit frame.
+    constexpr std::size_t tx_offset = TPACKET3_HDRLEN - sizeof(sockaddr_ll);
+
+    /// The link type of Ethernet.
+    constexpr std::uint32_t linktype_ethernet = 1;
+
+    std::uint32_t
+    load_status(const volatile std::uint32_t* p)
+    {
+      return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    void
+    store_status(volatile std::uint32_t* p, std::uint32_t s)
+    {
+      __atomic_store_n(p, s, __ATOMIC_RELEASE);
+    }
+
+    tpacket3_hdr*
+    tx_header(unsigned char* frame)
+    {
+      return reinterpret_cast<tpacket3_hdr*>(frame);
+    }
+  } // namespace
+
+  device::device(const char* name, const device_config& cfg)
+    : id(cfg.id), name(name),
+      block_size(cfg.block_size), block_count(cfg.block_count),
+      frame_size(cfg.frame_size), frame_count(cfg.frame_count)
+  {
+    unsigned index = ::if_nametoindex(name);
+    if (!index)
+      io_error("cannot find interface", name);
+
+    fd = ::socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd < 0)
+      io_error("cannot open packet socket for", name);
+
+    try {
+      int version = TPACKET_V3;
+      if (::setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof version) < 0)
+        io_error("cannot use TPACKET_V3 on", name);
+
+      // Frames sent by this socket are not received again. Older kernels
+      // lack the option; those frames are skipped in get() instead.
+      int ignore = 1;
+      ::setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore, sizeof ignore);
+
+      tpacket_req3 rx {};
+      rx.tp_block_size = block_size;
+      rx.tp_block_nr = block_count;
+      rx.tp_frame_size = frame_size;
+      rx.tp_frame_nr = block_size / frame_size * block_count;
+      rx.tp_retire_blk_tov = cfg.block_timeout;
+      rx.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+      if (::setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &rx, sizeof rx) < 0)
+        io_error("cannot create receive ring for", name);
+
+      // The transmit ring has whole frames in blocks of the same size as
+      // those of the receive ring.
+      std::uint32_t per_block = block_size / frame_size;
+      frame_count = (frame_count + per_block - 1) / per_block * per_block;
+      tpacket_req3 tx {};
+      tx.tp_block_size = block_size;
+      tx.tp_block_nr = frame_count / per_block;
+      tx.tp_frame_size = frame_size;
+      tx.tp_frame_nr = frame_count;
+      if (::setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &tx, sizeof tx) < 0)
+        io_error("cannot create transmit ring for", name);
+
+      std::size_t rx_size = std::size_t(block_size) * block_count;
+      map_size = rx_size + std::size_t(block_size) * tx.tp_block_nr;
+      void* p = ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_LOCKED | MAP_POPULATE, fd, 0);
+      if (p == MAP_FAILED)
+        p = ::mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED)
+        io_error("cannot map rings of", name);
+      map = static_cast<unsigned char*>(p);
+      tx_ring = map + rx_size;
+
+      sockaddr_ll addr {};
+      addr.sll_family = AF_PACKET;
+      addr.sll_protocol = htons(ETH_P_ALL);
+      addr.sll_ifindex = index;
+      if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+        io_error("cannot bind to", name);
+
+      // Joining the group after binding spreads only this interface's
+      // packets across its members.
+      if (cfg.fanout >= 0) {
+        int arg = (cfg.fanout & 0xffff)
+                | (PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16;
+        if (::setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof arg) < 0)
+          io_error("cannot join fanout group on", name);
+      }
+    }
+    catch (...) {
+      if (map)
+        ::munmap(map, map_size);
+      ::close(fd);
+      throw;
+    }
+  }
+
+  device::~device()
+  {
+    try {
+      flush();
+    }
+    catch (...) {
+      // Frames still queued are lost.
+    }
+    ::munmap(map, map_size);
+    ::close(fd);
+  }
+
+  // Returns the current block to the kernel and moves to the next.
+  void
+  device::release_block()
+  {
+    store_status(&current->hdr.bh1.block_status, TP_STATUS_KERNEL);
+    current = nullptr;
+    block = (block + 1) % block_count;
+  }
+
+  bool
+  device::get(packet& p)
+  {
+    for (;;) {
+      if (!current) {
+        auto* b = reinterpret_cast<tpacket_block_desc*>(map + std::size_t(block) * block_size);
+        if (!(load_status(&b->hdr.bh1.block_status) & TP_STATUS_USER))
+          return false;
+        current = b;
+        remaining = b->hdr.bh1.num_pkts;
+        next_packet = reinterpret_cast<const unsigned char*>(b) + b->hdr.bh1.offset_to_first_pkt;
+      }
+
+      // The block holding the previous packet is released only now, so
+      // that the packet stays valid until this call.
+      if (remaining == 0) {
+        release_block();
+        continue;
+      }
+
+      auto* h = reinterpret_cast<const tpacket3_hdr*>(next_packet);
+      next_packet += h->tp_next_offset;
+      --remaining;
+
+      auto* ll = reinterpret_cast<const sockaddr_ll*>(
+        reinterpret_cast<const unsigned char*>(h) + TPACKET_ALIGN(sizeof(tpacket3_hdr)));
+      if (ll->sll_pkttype == PACKET_OUTGOING)
+        continue;
+
+      hdr.caplen = h->tp_snaplen;
+      hdr.len = h->tp_len;
+      hdr.ts.tv_sec = h->tp_sec;
+      hdr.ts.tv_usec = h->tp_nsec;
+      p.hdr = &hdr;
+      p.buf = reinterpret_cast<const unsigned char*>(h) + h->tp_mac;
+      p.iface = id;
+      p.link = linktype_ethernet;
+      p.ns = std::uint64_t(h->tp_sec) * 1000000000 + h->tp_nsec;
+      return true;
+    }
+  }
+
+  void
+  device::wait(int timeout)
+  {
+    pollfd pfd { fd, POLLIN, 0 };
+    ::poll(&pfd, 1, timeout);
+  }
+
+  // Returns the next free frame of the transmit ring, or nullptr if the
+  // frame is too long. When the ring is full, the queued frames are sent
+  // and this waits for a frame to be freed.
+  unsigned char*
+  device::reserve(std::uint32_t len)
+  {
+    if (len > frame_size - tx_offset) {
+      ++tx_oversized;
+      return nullptr;
+    }
+
+    unsigned char* f = tx_ring + std::size_t(frame) * frame_size;
+    while (load_status(&tx_header(f)->tp_status) & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) {
+      flush();
+      pollfd pfd { fd, POLLOUT, 0 };
+      ::poll(&pfd, 1, 1);
+    }
+    return f;
+  }
+
+  void
+  device::commit(unsigned char* f, std::uint32_t len)
+  {
+    tpacket3_hdr* h = tx_header(f);
+    h->tp_len = len;
+    h->tp_snaplen = len;
+    h->tp_next_offset = 0;
+    store_status(&h->tp_status, TP_STATUS_SEND_REQUEST);
+    frame = (frame + 1) % frame_count;
+    ++tx_pending;
+    ++tx_frames;
+  }
+
+  void
+  device::send(const unsigned char* data, std::uint32_t len)
+  {
+    if (unsigned char* f = reserve(len)) {
+      std::memcpy(f + tx_offset, data, len);
+      commit(f, len);
+    }
+  }
+
+  void
+  device::send(const frame_view& v)
+  {
+    if (unsigned char* f = reserve(v.size)) {
+      v.copy(f + tx_offset);
+      commit(f, v.size);
+    }
+  }
+
+  void
+  device::flush()
+  {
+    if (!tx_pending)
+      return;
+    while (::sendto(fd, nullptr, 0, MSG_DONTWAIT, nullptr, 0) < 0) {
+      if (errno == EINTR)
+        continue;
+      // The frames left in the ring are sent by the next flush.
+      if (errno == EAGAIN || errno == ENOBUFS)
+        return;
+      std::stringstream ss;
+      ss << "cannot transmit: " << std::strerror(errno);
+      throw std::runtime_error(ss.str());
+    }
+    tx_pending = 0;
+  }
+
+  std::uint64_t
+  device::drops()
+  {
+    // Reading the statistics resets them.
+    tpacket_stats_v3 st {};
+    socklen_t len = sizeof st;
+    if (::getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0)
+      dropped += st.tp_drops;
+    return dropped;
+  }
+
+  bool
+  device::link_up() const
+  {
+    ifreq ifr {};
+    std::strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+    if (::ioctl(fd, SIOCGIFFLAGS, &ifr) < 0)
+      return false;
+    return (ifr.ifr_flags & (IFF_UP | IFF_RUNNING)) == (IFF_UP | IFF_RUNNING);
+  }
+
+  void
+  wait(const std::vector<std::unique_ptr<device>>& devs, int timeout)
+  {
+    std::vector<pollfd> fds;
+    fds.reserve(devs.size());
+    for (const auto& d : devs)
+      fds.push_back(pollfd { d->descriptor(), POLLIN, 0 });
+    ::poll(fds.data(), fds.size(), timeout);
+  }
+
+} // namespace cap
+} // namespace pip
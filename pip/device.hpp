@@ -0,0 +1,155 @@
+#pragma once
+
+#include <pip/pcap.hpp>
+#include <pip/replica.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct tpacket_block_desc;
+
+namespace pip
+{
+namespace cap
+{
+  /// The configuration of a live device.
+  struct device_config
+  {
+    /// The size of each block of the receive ring, a multiple of the
+    /// page size.
+    std::uint32_t block_size = 1 << 20;
+
+    /// The number of blocks of the receive ring.
+    std::uint32_t block_count = 64;
+
+    /// The longest time, in milliseconds, that the kernel holds a
+    /// partially filled block before handing it to the reader.
+    std::uint32_t block_timeout = 1;
+
+    /// The size of each frame of the transmit ring.
+    std::uint32_t frame_size = 2048;
+
+    /// The number of frames of the transmit ring.
+    std::uint32_t frame_count = 4096;
+
+    /// The fanout group to join, or -1 to receive every packet of the
+    /// interface. Packets are spread across the members of a group by a
+    /// hash of their flow. The kernel limits a group to the sockets of
+    /// one interface, so each interface needs its own group.
+    int fanout = -1;
+
+    /// The interface ID recorded in each received packet.
+    std::uint32_t id = 0;
+  };
+
+  /// A live network interface, read and written through an AF_PACKET
+  /// socket with TPACKET_V3 memory-mapped rings.
+  ///
+  /// The kernel fills the receive ring a block at a time, and get()
+  /// walks the packets of a ready block in place without a system call.
+  /// A packet is valid until the next call to get(), after which its
+  /// block may be returned to the kernel. Frames are copied into the
+  /// transmit ring by send() and transmitted together by flush().
+  ///
+  /// A device is used by a single worker. To spread an interface across
+  /// several workers, open one device per worker with the same fanout
+  /// group, so that each has its own rings.
+  ///
+  /// Devices need CAP_NET_RAW. They can be tested locally over a veth
+  /// pair, with one end in a network namespace:
+  ///
+  ///   ip netns add pip-test
+  ///   ip link add veth0 type veth peer name veth1 netns pip-test
+  ///   ip link set veth0 up
+  ///   ip -n pip-test link set veth1 up
+  ///
+  /// pip reads and writes veth0, while traffic is sent and captured on
+  /// veth1 from inside the namespace.
+  class device
+  {
+  public:
+    device(const char* name, const device_config& cfg = device_config());
+    ~device();
+
+    device(const device&) = delete;
+    device& operator=(const device&) = delete;
+
+    /// Gets the next received packet, if one is ready. Returns false if
+    /// there is none. Does not block.
+    bool get(packet& p);
+
+    /// Blocks until a packet may be ready or `timeout` milliseconds
+    /// have passed.
+    void wait(int timeout);
+
+    /// Queues the `len`-byte frame for transmission.
+    void send(const unsigned char* frame, std::uint32_t len);
+
+    /// Queues a replica for transmission.
+    void send(const frame_view& frame);
+
+    /// Transmits the queued frames.
+    void flush();
+
+    /// Returns the socket descriptor, for polling.
+    int descriptor() const { return fd; }
+
+    /// Returns the number of frames queued for transmission.
+    std::uint64_t sent() const { return tx_frames; }
+
+    /// Returns the number of frames too long for a transmit frame.
+    std::uint64_t oversized() const { return tx_oversized; }
+
+    /// Returns the number of packets dropped by the kernel because the
+    /// receive ring was full.
+    std::uint64_t drops();
+
+    /// Returns true if the interface is up and has a carrier.
+    bool link_up() const;
+
+  private:
+    unsigned char* reserve(std::uint32_t len);
+    void commit(unsigned char* frame, std::uint32_t len);
+    void release_block();
+
+    int fd = -1;
+    std::uint32_t id;
+    std::string name;
+
+    /// The mapping of both rings: the receive ring, then the transmit
+    /// ring.
+    unsigned char* map = nullptr;
+    std::size_t map_size = 0;
+
+    /// The receive ring.
+    std::uint32_t block_size;
+    std::uint32_t block_count;
+    std::uint32_t block = 0;
+    tpacket_block_desc* current = nullptr;
+    const unsigned char* next_packet = nullptr;
+    std::uint32_t remaining = 0;
+
+    /// The transmit ring.
+    unsigned char* tx_ring;
+    std::uint32_t frame_size;
+    std::uint32_t frame_count;
+    std::uint32_t frame = 0;
+    std::uint32_t tx_pending = 0;
+    std::uint64_t tx_frames = 0;
+    std::uint64_t tx_oversized = 0;
+
+    /// The header of the current packet.
+    pcap_pkthdr hdr;
+
+    std::uint64_t dropped = 0;
+  };
+
+  /// Blocks until a packet may be ready on any of `devs`, or `timeout`
+  /// milliseconds have passed.
+  void wait(const std::vector<std::unique_ptr<device>>& devs, int timeout);
+
+} // namespace cap
+} // namespace pip
@@ -17,8 +17,9 @@ namespace pip
       case dk_table:
         return dump_decl(cast<table_decl>(d));
       case dk_meter:
-        // FIXME: Implement me?
-        break;
+        return dump_decl(cast<meter_decl>(d));
+      case dk_group:
+        return dump_decl(cast<group_decl>(d));
     }
     throw std::logic_error("invalid declaration");
   }
@@ -44,6 +45,23 @@ namespace pip
     dump_matches("rules", t->rules);
   }
 
+  void
+  dumper::dump_decl(const meter_decl* m)
+  {
+    dump_guard g(*this, m, "meter");
+  }
+
+  void
+  dumper::dump_decl(const group_decl* g)
+  {
+    dump_guard g1(*this, g, "group", false);
+    indent();
+    print_newline();
+    for (const group_bucket& b : g->buckets)
+      dump_actions("bucket", b.acts);
+    undent();
+  }
+
   void
   dumper::dump_actions(const char* name, const action_seq& as)
   {
@@ -93,6 +111,10 @@ namespace pip
       return dump_action(cast<copy_action>(a));
     case ak_set:
       return dump_action(cast<set_action>(a));
+    case ak_meter:
+      return dump_action(cast<meter_action>(a));
+    case ak_conntrack:
+      return dump_action(cast<conntrack_action>(a));
     case ak_write:
       return dump_action(cast<write_action>(a));
     case ak_clear:
@@ -105,6 +127,8 @@ namespace pip
       return dump_action(cast<goto_action>(a));
     case ak_output:
       return dump_action(cast<output_action>(a));
+    case ak_group:
+      return dump_action(cast<group_action>(a));
     }
   }
   
@@ -129,6 +153,22 @@ namespace pip
     // FIXME: Implement me.
   }
 
+  void
+  dumper::dump_action(const meter_action* a)
+  {
+    dump_guard g(*this, a, get_phrase_name(a), false);
+    indent();
+    print_newline();
+    dump_expr(a->meter);
+    undent();
+  }
+
+  void
+  dumper::dump_action(const conntrack_action* a)
+  {
+    dump_guard g(*this, a, get_phrase_name(a));
+  }
+
   void
   dumper::dump_action(const write_action* a)
   {
@@ -174,6 +214,16 @@ namespace pip
     undent();
   }
 
+  void
+  dumper::dump_action(const group_action* a)
+  {
+    dump_guard g(*this, a, get_phrase_name(a), false);
+    indent();
+    print_newline();
+    dump_expr(a->group);
+    undent();
+  }
+
   void
   dumper::dump_expr(const expr* e)
   {
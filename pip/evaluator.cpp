@@ -6,74 +6,120 @@
 #include "decl.hpp"
 #include "dumper.hpp"
 #include "context.hpp"
+#include "clock.hpp"
 
 #include <climits>
-#include <random>
 #include <sstream>
 // testing only
 #include <iostream>
 
 namespace pip
 {
-  evaluator::evaluator(context& cxt, decl* prog, cap::packet& pkt, std::uint32_t physical_ports)
+  evaluator::evaluator(context& cxt, decl* prog, cap::packet& pkt, std::uint32_t physical_ports,
+                       flow_cache* cache, worker_stats* counters,
+                       stage_profile* profile, worker_meters* meters,
+                       group_table* groups, conntrack_table* conntrack,
+                       port_model* ports)
     : cxt(cxt), 
       prog(prog), 
       data(pkt), 
       arrival(pkt.timestamp()),
       ingress_port(), 
       physical_port(), 
+      physical_ports(physical_ports),
+      egress_port(rp_unset),
       metadata(), 
       keyreg(), 
       decode(),
-      dec(cxt)
+      dec(cxt),
+      cache(cache),
+      counters(counters),
+      profile(profile),
+      meters(meters),
+      groups(groups),
+      conntrack(conntrack)
   {    
-    assert(cap::ethernet_ethertype(pkt.data()) == 0x800  &&
-	   "Non-ethernet frames are not supported.\n");
-    assert(cap::ipv4_protocol(pkt.data()) == 0x06 &&
-	   "Non-TCP packets are not supported.\n");
-    
+    std::uint64_t start = profile ? read_cycles() : 0;
+
     modified_buffer = new unsigned char[pkt.size()];
+    frame.reset(modified_buffer, std::default_delete<unsigned char[]>());
     std::memcpy(modified_buffer, pkt.data(), pkt.size());
-    
+    replicas.reset(frame, pkt.size());
+
+    // Only TCP and UDP over IPv4 are supported. Other frames, such as
+    // the ARP and IPv6 neighbour discovery traffic of a live interface,
+    // are not evaluated, and so are dropped.
+    if (pkt.size() < SIZE_IPv4 + 4 ||
+        cap::ethernet_ethertype(pkt.data()) != 0x800 ||
+        (cap::ipv4_protocol(pkt.data()) != IPPROTO_TCP &&
+         cap::ipv4_protocol(pkt.data()) != IPPROTO_UDP)) {
+      unsupported = true;
+      return;
+    }
+
+    // TCP and UDP both begin with the source port.
     ingress_port = cap::tcp_src_port(pkt.data());
 
-    std::random_device rand_device;
-    std::mt19937 rand_engine(rand_device());
-    std::uniform_int_distribution<std::uint32_t> rand_distribution(1, physical_ports);
-    physical_port = rand_distribution(rand_engine);
+    // Without a port model, every packet arrives on port 1.
+    physical_port = ports ? ports->assign(pkt) : 1;
     std::cout << "Packet received on port: " << physical_port << '\n';
     
-    // Perform static initialization. We need to evaluate all of
-    // the table definitions to load them with their static rules.
+    // The tables of the program and their lookup structures were built
+    // once, by build_tables.
     auto program = static_cast<program_decl*>(prog);
-    std::vector<decl*> tables;
-    for(auto declaration : program->decls)
-      if(auto table = dynamic_cast<table_decl*>(declaration)) {
-	for(auto r : table->rules)
-	  if(auto int_key = dynamic_cast<int_expr*>(r->key))
-	    table->key_table.insert(int_key->val);
-	tables.push_back(table);
+
+    // The type checker bounds every frame access of the program by its
+    // minimum frame size. A shorter capture cannot be evaluated.
+    if (std::size_t(data.size()) < program->min_frame_size) {
+      truncated = true;
+      return;
+    }
+
+    // If the flow has been seen before, replay its trace instead of
+    // walking the tables. Otherwise, record this traversal.
+    if (cache && cache->enabled() &&
+        cache->signature().extract(pkt.data(), pkt.size(), ingress_port,
+                                   physical_port, cache->key())) {
+      flow_hash = cache->hash();
+      if (const flow_trace* t = cache->lookup(flow_hash)) {
+        eval.assign_span(t->actions.data(), t->actions.data() + t->actions.size());
+        if (counters)
+          for (const trace_lookup& l : t->lookups)
+            counters->lookup(l.table, l.rule, l.miss, pkt.size(), arrival);
+        replaying = true;
+        if (profile) {
+          stage_start = read_cycles();
+          profile->parse.record(stage_start - start);
+        }
+        return;
       }
+      recording = true;
+      if (cache->has_megaflows()) {
+        tracking = true;
+        consulted.assign(cache->signature().size(), 0);
+      }
+    }
 
-    // Load the instructions from the first table.
-    current_table = static_cast<table_decl*>(tables.front());
-    for(auto a : current_table->prep)
-      eval.push_back(a);
+    // Load the instructions from the entry table.
+    current_table = program->entry;
+    if (current_table)
+      eval.append(current_table->prep.begin(), current_table->prep.end());
+
+    if (profile) {
+      stage_start = read_cycles();
+      profile->parse.record(stage_start - start);
+    }
   }
 
   evaluator::~evaluator()
-  {
-    if(modified_buffer)
-      delete[] modified_buffer;
-  }
+  { }
 
   const action*
   evaluator::fetch()
   {
-    const action* a = eval.front();
+    const action* a = eval.pop_front();
     if(a)
       std::cout << "there is an action in eval\n";
-    eval.pop_front();
     return a;
   }
 
@@ -88,11 +134,17 @@ namespace pip
         return;
 
       // This marks the beginning of egress processing.
-      eval.insert(eval.end(), actions.begin(), actions.end());
+      eval.append(actions.begin(), actions.end());
       actions.clear();
+      if (profile && !in_egress && !replaying)
+        stage_start = read_cycles();
+      in_egress = true;
     }
     
     const action* a = fetch();
+    if (recording && is_traced(a))
+      trace.actions.push_back(a);
+
     switch (get_kind(a)) {
       case ak_advance:
         return eval_advance(cast<advance_action>(a));
@@ -100,6 +152,12 @@ namespace pip
         return eval_copy(cast<copy_action>(a));
       case ak_set:
         return eval_set(cast<set_action>(a));
+      case ak_meter:
+        return eval_meter(cast<meter_action>(a));
+      case ak_group:
+        return eval_group(cast<group_action>(a));
+      case ak_conntrack:
+        return eval_conntrack(cast<conntrack_action>(a));
       case ak_write:
         return eval_write(cast<write_action>(a));
       case ak_clear:
@@ -125,6 +183,26 @@ namespace pip
   {
     while (!done())
       step();
+
+    if (stale_checksums) {
+      for (checksum_set c : {cs_ipv4, cs_tcp})
+	if (stale_checksums & c)
+	  replicas.save(checksum_offset(c), checksum_offset(c) + 2);
+      recompute_checksums(modified_buffer, data.size(), stale_checksums);
+    }
+
+    if (profile) {
+      if (replaying)
+        profile->replay.record(read_cycles() - stage_start);
+      else if (in_egress)
+        profile->egress.record(read_cycles() - stage_start);
+    }
+
+    if (recording) {
+      cache->insert(flow_hash, tracking ? consulted.data() : nullptr,
+                    std::move(trace));
+      recording = false;
+    }
   }
 
   void
@@ -138,122 +216,6 @@ namespace pip
     std::cout << "Decode: " << decode << '\n';
   }  
 
-  // Copy n bits from position pos in a byte array into a 64-bit integer.
-  static std::uint64_t
-  data_to_key_reg(std::uint8_t* bytes, std::size_t pos, std::size_t n)
-  {
-    const std::uint8_t* current_byte = bytes + pos / CHAR_BIT;
-    std::uint64_t reg = 0;
-
-    std::size_t offset = pos % CHAR_BIT;
-
-    // If the copy begins between two whole bytes,
-    if(offset > 0) {
-      // copy the specified bits.
-      reg = *(current_byte++) & (0xff >> offset);
-
-      // If there is nothing else to copy, shift off any excess and return.
-      if(n <= CHAR_BIT - offset)
-	return reg >> (CHAR_BIT - offset - n);
-      // Remove the copied bits from n.
-      else
-	n -= CHAR_BIT - offset;
-    }
-
-    // Copy all remaining whole bytes.
-    while(n >= CHAR_BIT) {
-      reg = (reg << CHAR_BIT) + *(current_byte++);
-      n -= CHAR_BIT;
-    }
-
-    // If some fraction of a byte remains to be copied, copy it.
-    if(n > 0)
-      reg = (reg << n) + (*current_byte >> (CHAR_BIT - n));
-	
-    return reg;
-  }
-
-  // Copy n bits from one byte array to another, starting at position pos.
-  static void
-  bitwise_copy(std::uint8_t* dst, std::uint8_t const * src,
-	       std::size_t pos, std::size_t n)
-  {
-    std::uint8_t* current_byte = dst + (pos / CHAR_BIT);
-    std::size_t i = 0;
-
-    // if the copy begins in between two whole bytes
-    if(pos % CHAR_BIT > 0) {
-      // copy just what is needed
-      *current_byte |= src[i] & (0xFF >> (pos % CHAR_BIT));    
-
-      // if there is nothing else to copy, terminate
-      if(n <= CHAR_BIT - pos % CHAR_BIT)
-	return;
-      // otherwise, even out n to start on the next whole byte
-      // (n is now a multiple of CHAR_BIT)
-      else
-	n -= CHAR_BIT - pos % CHAR_BIT;
-
-      ++current_byte;
-      // note that we have already accessed the first element of src
-      ++i;
-    }
-
-    // copy all whole bytes that remain
-    for(; n >= CHAR_BIT; n -= CHAR_BIT, ++i)
-      *current_byte++ = src[i];
-
-    // if there is a remainder of less than CHAR_BIT bits,
-    // copy just that portion of the byte.
-    if(n > 0) {
-      *current_byte |= src[i] & (0xff << (CHAR_BIT - n));
-    }  
-  }
-
-  // Copy n bits from src register to dst register starting at position pos.
-  static std::uint64_t
-  reg_to_reg(std::uint64_t src, std::uint64_t dst, std::size_t pos, std::size_t n)
-  {
-    // Create a string of 1s starting at pos to the least significant bit
-    std::uint64_t mask = (((~0 & (1U << pos)) - 1));
-    // Make the string of 1s stop n bits after pos.
-    mask &= ~((~0 & (((1U << (pos - n - 1))) - 1) << 1) + 1);
-
-    dst &= mask;
-    src &= ~mask;
-    return dst | src;
-  }
-
-  // Copy n bits from a uint64_t into a byte array at position pos.
-  // See data_to_key_reg and bitwise_copy for further documentation.
-  static void
-  reg_to_buf(std::uint8_t* bytes, std::uint64_t in,
-	     std::size_t pos, std::size_t n)
-  {
-    std::uint8_t* current_byte = bytes + pos / CHAR_BIT;
-    std::size_t offset = pos % CHAR_BIT;
-
-    if(offset > 0) {
-      *current_byte++ = (std::uint8_t)in & (0xff >> offset);
-
-      if(n <= CHAR_BIT - offset)
-	return;
-      else
-	n -= CHAR_BIT - offset;
-
-      in >>= offset;
-    }
-
-    while(n >= CHAR_BIT) {
-      *current_byte++ = (std::uint8_t)in & 0xff;
-      in >>= 8;
-      n -= CHAR_BIT;
-    }
-
-    if(n > 0)
-      *current_byte = (in << (CHAR_BIT - n)) + (*current_byte >> n);
-  }
-  
   void
   evaluator::eval_copy(const copy_action* a)
   {
@@ -267,70 +229,56 @@ namespace pip
     auto dst_pos = static_cast<int_expr*>(dst_loc->pos);
     auto dst_len = static_cast<int_expr*>(dst_loc->len);
 
-    if(src_loc->as == as_key)
-      throw std::runtime_error("Cannot copy from a key register.\n");
-    if(dst_loc->as == as_ingress_port || dst_loc->as == as_physical_port)
-      throw std::runtime_error("Cannot copy into a context variable.\n");
-
-    if(n > dst_len->val || n > src_len->val)
-      throw std::runtime_error("Copy action overflows buffer.\n");
-
-    if(src_len->val != dst_len->val)
-      throw std::runtime_error
-	("Length of copy source and destination must be equal.\n");
+    // The type checker has proven the widths and address spaces of the
+    // copy, and the frame is at least the program's minimum size, so the
+    // copy is in bounds.
+    if(tracking)
+      track_copy(src_loc, dst_loc);
 
     /// Copying into key register.
     if(dst_loc->as == as_key) {
-      if(n > 64) {
-	std::stringstream ss;
-	ss << "Attempting to copy " << n << " bits into a register of size 64.\n";
-	throw std::runtime_error(ss.str().c_str());
-      }
-      
+      // Fields land at their position in the key, so that several copies
+      // build a key wider than any one register, such as a 5-tuple.
       if(src_loc->as == as_packet) {	
-	keyreg = data_to_key_reg((std::uint8_t*)data.data(), src_pos->val, src_len->val);
+	keyreg.load(dst_pos->val, data.data(), data.size(), src_pos->val, src_len->val);
 	std::cout << "value at packet: ";
 	for(int i = 0; i < src_len->val / 8; ++i)
-	  std::cout << (unsigned)*(data.data() + src_pos->val + i);
+	  std::cout << (unsigned)*(data.data() + src_pos->val / CHAR_BIT + i);
 	std::cout << '\n';
       }
 
       else if(src_loc->as == as_header) {
-	keyreg = data_to_key_reg((std::uint8_t*)data.data(), src_pos->val + decode, src_len->val);	
+	keyreg.load(dst_pos->val, data.data(), data.size(), src_pos->val + decode, src_len->val);
       }
       
       else if(src_loc->as == as_meta)
-	keyreg = reg_to_reg(metadata, keyreg, src_pos->val, src_len->val);
+	keyreg.insert(dst_pos->val, src_len->val, register_bits(metadata, src_pos->val, src_len->val));
       else if(src_loc->as == as_ingress_port)
-	keyreg = reg_to_reg(ingress_port, keyreg, src_pos->val, src_len->val);
+	keyreg.insert(dst_pos->val, src_len->val, register_bits(ingress_port, src_pos->val, src_len->val));
       else if(src_loc->as == as_physical_port)
-	keyreg = reg_to_reg(physical_port, keyreg, src_pos->val, src_len->val);
+	keyreg.insert(dst_pos->val, src_len->val, register_bits(physical_port, src_pos->val, src_len->val));
+      else if(src_loc->as == as_ct_state)
+	keyreg.insert(dst_pos->val, src_len->val, register_bits(ct_state, src_pos->val, src_len->val));
 
       std::cout << "Copy " << n << " bits to key register from position " << src_pos->val << ". Register value: " << keyreg << '\n';
     }
 
     /// Copying into header bitfield.
     else if(dst_loc->as == as_header) {
-      if(src_loc->as == as_packet) {
-	if((dst_len->val + dst_pos->val + decode) > data.size()) {
-	  std::stringstream ss;
-	  ss << "Cannot write beyond buffer. Attempting to copy ";
-	  ss << dst_len->val;
-	  ss << " bits at position ";
-	  ss << dst_pos->val;
-	  ss << " of a buffer of size ";
-	  ss << data.size() - decode;
-	  throw std::runtime_error(ss.str().c_str());
-	}
-	
-	bitwise_copy(modified_buffer, (std::uint8_t*)data.data(), dst_pos->val + decode, dst_len->val);
-      }
+      overwrite(dst_pos->val + decode, dst_len->val, a->checksums);
+      if(src_loc->as == as_packet)
+	copy_bits(modified_buffer + (dst_pos->val + decode) / CHAR_BIT, data.data() + src_pos->val / CHAR_BIT,
+		  dst_pos->val + decode, dst_len->val);
       else if(src_loc->as == as_meta)
-	reg_to_buf(modified_buffer, metadata, dst_pos->val + decode, dst_len->val);
-      else if(src_loc->as == ingress_port)
-	reg_to_buf(modified_buffer, ingress_port, dst_pos->val + decode, dst_len->val);
-      else if(src_loc->as == physical_port)
-	reg_to_buf(modified_buffer, physical_port, dst_pos->val + decode, dst_len->val);
+	insert_bits(modified_buffer, data.size(), dst_pos->val + decode, dst_len->val,
+		    register_bits(metadata, src_pos->val, src_len->val));
+      else if(src_loc->as == as_ingress_port)
+	insert_bits(modified_buffer, data.size(), dst_pos->val + decode, dst_len->val,
+		    register_bits(ingress_port, src_pos->val, src_len->val));
+      else if(src_loc->as == as_physical_port)
+	insert_bits(modified_buffer, data.size(), dst_pos->val + decode, dst_len->val,
+		    register_bits(physical_port, src_pos->val, src_len->val));
+      fixup_checksums();
 
       std::cout << "Copy " << dst_len->val << " bits at position " << dst_pos->val << " into header. Header value: (unimplemented)\n";
       // TODO: print(header);
@@ -338,86 +286,115 @@ namespace pip
 
     /// Copying into metadata register.
     else if(dst_loc->as == as_meta) {
-      if(n > 64) {
-	std::stringstream ss;
-	ss << "Attempting to copy " << n << " bits into a register of size 64.\n";
-	throw std::runtime_error(ss.str().c_str());
-      }
-      
       if(src_loc->as == as_packet) {	
-	metadata = data_to_key_reg((std::uint8_t*)data.data(), src_pos->val, src_len->val);
+	metadata = extract_bits(data.data(), data.size(), src_pos->val, src_len->val);
 	std::cout << "value at packet: ";
 	for(int i = 0; i < src_len->val / 8; ++i)
-	  std::cout << (unsigned)*(data.data() + src_pos->val + i);
+	  std::cout << (unsigned)*(data.data() + src_pos->val / CHAR_BIT + i);
 	std::cout << '\n';
       }
 
       else if(src_loc->as == as_header) {
-	metadata = data_to_key_reg((std::uint8_t*)data.data(), src_pos->val + decode, src_len->val);	
+	metadata = extract_bits(data.data(), data.size(), src_pos->val + decode, src_len->val);
       }
       
       else if(src_loc->as == as_meta)
-	metadata = reg_to_reg(metadata, metadata, src_pos->val, src_len->val);
+	metadata = merge_bits(metadata, metadata, src_pos->val, src_len->val);
       else if(src_loc->as == as_ingress_port)
-	metadata = reg_to_reg(ingress_port, metadata, src_pos->val, src_len->val);
+	metadata = merge_bits(ingress_port, metadata, src_pos->val, src_len->val);
       else if(src_loc->as == as_physical_port)
-	metadata = reg_to_reg(physical_port, metadata, src_pos->val, src_len->val);
+	metadata = merge_bits(physical_port, metadata, src_pos->val, src_len->val);
+      else if(src_loc->as == as_ct_state)
+	metadata = merge_bits(ct_state, metadata, src_pos->val, src_len->val);
 
 
-      std::cout << "Copy " << n << " bits to metadata register from position " << src_pos->val << ". Register value: " << keyreg << '\n';
+      std::cout << "Copy " << n << " bits to metadata register from position " << src_pos->val << ". Register value: " << metadata << '\n';
     }
 
     /// Copying into packet bitfield.
     else if(dst_loc->as == as_packet) {
-      if(src_loc->as == as_header) {
-	if(dst_len->val + dst_pos->val > data.size()) {
-	  std::stringstream ss;
-	  ss << "Cannot write beyond buffer. Attempting to copy ";
-	  ss << dst_len->val;
-	  ss << " bits at position ";
-	  ss << dst_pos->val;
-	  ss << " of a buffer of size ";
-	  ss << data.size();
-	  throw std::runtime_error(ss.str().c_str());
-	}
-	
-	bitwise_copy(modified_buffer, packet_header(data), dst_pos->val, dst_len->val);
-      }
-      else if(src_loc->as == as_meta) {
-	if(n > data.size()) {
-	  std::stringstream ss;
-	  ss << "Attempting to copy " << n << " bits into a packet of size: " << data.size();
-	  throw std::runtime_error(ss.str().c_str());
-	}
-      
-	reg_to_buf(modified_buffer, metadata, dst_pos->val, dst_len->val);
-      }
-
-      else if(src_loc->as == as_ingress_port) {
-	if(n > data.size()) {
-	  std::stringstream ss;
-	  ss << "Attempting to copy " << n << " bits into a packet of size: " << data.size();
-	  throw std::runtime_error(ss.str().c_str());
-	}
-      
-	reg_to_buf(modified_buffer, ingress_port, dst_pos->val, dst_len->val);
-      }
-
-      else if(src_loc->as == as_physical_port) {
-	if(n > data.size()) {
-	  std::stringstream ss;
-	  ss << "Attempting to copy " << n << " bits into a packet of size: " << data.size();
-	  throw std::runtime_error(ss.str().c_str());
-	}
-      
-	reg_to_buf(modified_buffer, physical_port, dst_pos->val, dst_len->val);
-      }
+      overwrite(dst_pos->val, dst_len->val, a->checksums);
+      if(src_loc->as == as_header)
+	copy_bits(modified_buffer + dst_pos->val / CHAR_BIT, data.data() + (src_pos->val + decode) / CHAR_BIT,
+		  dst_pos->val, dst_len->val);
+      else if(src_loc->as == as_meta)
+	insert_bits(modified_buffer, data.size(), dst_pos->val, dst_len->val,
+		    register_bits(metadata, src_pos->val, src_len->val));
+      else if(src_loc->as == as_ingress_port)
+	insert_bits(modified_buffer, data.size(), dst_pos->val, dst_len->val,
+		    register_bits(ingress_port, src_pos->val, src_len->val));
+      else if(src_loc->as == as_physical_port)
+	insert_bits(modified_buffer, data.size(), dst_pos->val, dst_len->val,
+		    register_bits(physical_port, src_pos->val, src_len->val));
+      fixup_checksums();
 
       std::cout << "Copy " << dst_len->val << " bits at position " << dst_pos->val << " into packet. packet value: (unimplemented)\n";
       // TODO: print(packet);
     }
   }
 
+  // Records which flow-key bits are carried into a register by a copy.
+  // Loads from the packet replace the metadata register's sources; the key
+  // register, cleared per table, accumulates the sources of its fields.
+  // Loads from other registers are merged in.
+  void
+  evaluator::track_copy(const bitfield_expr* src, const bitfield_expr* dst)
+  {
+    std::vector<key_span>* sources;
+    if(dst->as == as_key)
+      sources = &key_sources;
+    else if(dst->as == as_meta)
+      sources = &meta_sources;
+    else
+      return;
+
+    const flow_signature& sig = cache->signature();
+    std::size_t pos = static_cast<int_expr*>(src->pos)->val;
+    std::size_t len = static_cast<int_expr*>(src->len)->val;
+    switch(src->as) {
+    case as_packet:
+    case as_header: {
+      if(src->as == as_header)
+	pos += decode;
+      // The read must lie within a single range of the signature, so that
+      // its bits are contiguous in the key.
+      std::size_t at = sig.locate(pos);
+      if(at == flow_signature::npos || sig.locate(pos + len - 1) != at + len - 1) {
+	// The signature does not cover this read, so no megaflow can be
+	// derived from this traversal.
+	tracking = false;
+	return;
+      }
+      if(sources == &key_sources)
+	sources->push_back({at, len});
+      else
+	sources->assign(1, {at, len});
+      break;
+    }
+    case as_meta:
+      if(sources != &meta_sources)
+	sources->insert(sources->end(), meta_sources.begin(), meta_sources.end());
+      break;
+    case as_ingress_port:
+      sources->push_back({sig.ingress_offset(), 32});
+      break;
+    case as_physical_port:
+      sources->push_back({sig.physical_offset(), 32});
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Marks every flow-key bit in the key register as consulted.
+  void
+  evaluator::track_match()
+  {
+    for(const key_span& s : key_sources)
+      for(std::size_t i = s.pos; i < s.pos + s.len; ++i)
+	consulted[i / CHAR_BIT] |= 0x80 >> (i % CHAR_BIT);
+  }
+
   void
   evaluator::eval_set(const set_action* a)
   {
@@ -430,26 +407,138 @@ namespace pip
     std::size_t val_width = static_cast<int_type*>(val_expr->ty)->width;    
     std::size_t position = pos_expr->val;
 
-    if(val_width + position > data.size()) {
-      std::stringstream ss;
-      ss << "Cannot write beyond buffer. Attempting to write a value of ";
-      ss << val_width;
-      ss << " bits at position ";
-      ss << position;
-      ss << " of a buffer of size ";
-      ss << data.size();
-      throw std::runtime_error(ss.str().c_str());
+    overwrite(position, val_width, a->checksums);
+    insert_bits(modified_buffer, data.size(), position, val_width, value);
+    fixup_checksums();
+
+    std::cout << "Set " << val_width << " bits of packet to " << value << ". Value of packet: (unimplemented).\n";
+  }
+
+  // Increases the drop precedence of an AF-marked IPv4 packet by `level`,
+  // updating the header checksum incrementally (RFC 1624). Other DSCP
+  // values are left unchanged.
+  static void
+  remark_dscp(unsigned char* buf, std::size_t len, std::uint32_t level)
+  {
+    if (len < SIZE_IPv4)
+      return;
+    unsigned char* ip = buf + SIZE_ETHERNET;
+    std::uint8_t dscp = ip[1] >> 2;
+    std::uint8_t af_class = dscp >> 3;
+    std::uint8_t prec = (dscp >> 1) & 3;
+    if (af_class < 1 || af_class > 4 || prec < 1 || (dscp & 1))
+      return;
+    std::uint8_t new_prec = std::min<std::uint32_t>(prec + level, 3);
+    if (new_prec == prec)
+      return;
+
+    std::uint16_t old_word = (ip[0] << 8) | ip[1];
+    ip[1] = (((af_class << 3) | (new_prec << 1)) << 2) | (ip[1] & 3);
+    std::uint16_t new_word = (ip[0] << 8) | ip[1];
+
+    std::uint16_t check = checksum_replace((ip[10] << 8) | ip[11], old_word, new_word);
+    ip[10] = check >> 8;
+    ip[11] = check & 0xff;
+  }
+
+  void
+  evaluator::eval_meter(const meter_action* a)
+  {
+    auto m = static_cast<meter_decl*>(static_cast<ref_expr*>(a->meter)->ref);
+    if (!meters)
+      return;
+
+    const meter_band* band = meters->apply(m->index, arrival, data.total_size());
+    if (!band)
+      return;
+
+    switch (band->kind) {
+    case bk_drop:
+      std::cout << "Meter " << *m->id << ": drop.\n";
+      // What follows depends on the meter, so this traversal is not a
+      // trace of the flow.
+      recording = false;
+      tracking = false;
+      eval.clear();
+      actions.clear();
+      break;
+    case bk_dscp_remark:
+      std::cout << "Meter " << *m->id << ": remark.\n";
+      // The DSCP and the header checksum.
+      replicas.save(SIZE_ETHERNET + 1, SIZE_ETHERNET + 2);
+      replicas.save(SIZE_ETHERNET + 10, SIZE_ETHERNET + 12);
+      remark_dscp(modified_buffer, data.size(), band->prec_level);
+      break;
     }
+  }
 
-    reg_to_buf(modified_buffer, value, position, val_width);
+  void
+  evaluator::eval_conntrack(const conntrack_action* a)
+  {
+    // The ct_state depends on the packets seen before, not just on the
+    // flow, so this traversal is not a trace of the flow.
+    recording = false;
+    tracking = false;
+
+    if (conntrack)
+      ct_state = conntrack->track(modified_buffer, data.size(), arrival, a->commit);
+    else
+      ct_state = ct_trk | ct_inv;
+    std::cout << "Conntrack: ct_state " << ct_state << ".\n";
+  }
 
-    std::cout << "Set " << val_width << " bits of packet to " << value << ". Value of packet: (unimplemented).\n";
+  void
+  evaluator::eval_group(const group_action* a)
+  {
+    auto g = static_cast<group_decl*>(static_cast<ref_expr*>(a->group)->ref);
+
+    std::uint32_t b = 0;
+    switch (g->kind) {
+    case gk_all:
+      // Execute each bucket in turn before the rest of the action list.
+      std::cout << "Group " << *g->id << ": all.\n";
+      for (auto i = g->buckets.rbegin(); i != g->buckets.rend(); ++i)
+        eval.prepend(i->acts.begin(), i->acts.end());
+      return;
+    case gk_indirect:
+      break;
+    case gk_select:
+      if (tracking) {
+        // The choice of bucket depends on every bit of the 5-tuple.
+        const flow_signature& sig = cache->signature();
+        for (const hash_field& f : select_fields) {
+          for (std::size_t i = f.first * CHAR_BIT; tracking && i < f.last * CHAR_BIT; ++i) {
+            std::size_t at = sig.locate(i);
+            if (at == flow_signature::npos) {
+              tracking = false;
+              break;
+            }
+            consulted[at / CHAR_BIT] |= 0x80 >> (at % CHAR_BIT);
+          }
+        }
+      }
+      if (groups)
+        b = groups->select(g->index, select_hash(modified_buffer, data.size()));
+      break;
+    case gk_fast_failover:
+      if (groups)
+        b = groups->failover(g->index);
+      break;
+    }
+
+    if (b == no_bucket) {
+      std::cout << "Group " << *g->id << ": no live bucket.\n";
+      return;
+    }
+    std::cout << "Group " << *g->id << ": bucket " << b << ".\n";
+    const action_seq& acts = g->buckets[b].acts;
+    eval.prepend(acts.begin(), acts.end());
   }
 
   void
   evaluator::eval_write(const write_action* a)
   {
-    actions.push_back(a);
+    actions.push_back(a->act);
     std::cout << "Write action:\n";
     dumper d(std::cout);
     d(a);
@@ -476,25 +565,40 @@ namespace pip
     // If one of the rules matches the key register, then evaluate
     // that rule's action list.
 
+    std::uint64_t start = 0;
+    if(profile) {
+      start = read_cycles();
+      profile->key[current_table->index].record(start - stage_start);
+    }
+
+    if(tracking)
+      track_match();
+
     std::cout << "keyreg: " << keyreg << '\n';
-    std::cout << "keyreg ntohs: " << ntohs(keyreg) << '\n';
     
-    for(auto r : current_table->rules)
-    {
-      auto key = r->key;
-
-      if(get_kind(key) == ek_miss) {
-      	std::cout << "packet missed.\n";
-      	eval.insert(eval.end(), r->acts.begin(), r->acts.end());
-      	break;
-      }
-
-      if(current_table->key_table.find(keyreg) != current_table->key_table.end()) {
+    // Select the rule matching the key register, using the table's
+    // engine. If nothing matches, fall back to the table-miss rule, if any.
+    rule* selected = current_table->engine->lookup(keyreg);
+    bool miss = !selected;
+    if(miss)
+      selected = current_table->engine->miss();
+
+    std::uint32_t rule_index = selected ? selected->index : no_rule;
+    if(counters)
+      counters->lookup(current_table->index, rule_index, miss, data.size(), arrival);
+    if(recording)
+      trace.lookups.push_back({current_table->index, rule_index, miss});
+
+    if(selected) {
+      if(miss)
+	std::cout << "packet missed.\n";
+      else
 	std::cout << keyreg << " was matched in table.\n";
-	eval.insert(eval.end(), r->acts.begin(), r->acts.end());
-	break;
-      }
+      eval.append(selected->acts.begin(), selected->acts.end());
     }
+
+    if(profile)
+      profile->match[current_table->index].record(read_cycles() - start);
   }
 
 
@@ -507,9 +611,13 @@ namespace pip
     
     ref_expr* dst = static_cast<ref_expr*>(a->dest);
     current_table = static_cast<table_decl*>(dst->ref);
+    keyreg.clear();
+    key_sources.clear();
 
-    for(auto a : current_table->prep)
-      eval.push_back(a);
+    eval.append(current_table->prep.begin(), current_table->prep.end());
+
+    if(profile)
+      stage_start = read_cycles();
 
     std::cout << "Goto table: " << *(dst->id) << '\n';
   }
@@ -536,6 +644,66 @@ namespace pip
     }
     
     egress_port = port_num;
+
+    // Flood to every physical port but the one the packet arrived on.
+    // Each copy shares the frame.
+    if(port_num == rp_all) {
+      for(std::uint64_t p = 1; p <= physical_ports; ++p)
+	if(p != physical_port)
+	  replicas.add(p);
+    }
+    else if(port_num == rp_in_port)
+      replicas.add(physical_port);
+    else
+      replicas.add(port_num);
+  }
+
+  // Prepares to modify `len` bits of the frame at bit `pos`. The bytes
+  // spanned are saved for the replicas already made. If the write is
+  // covered by `checksums`, the words it spans are saved so that
+  // fixup_checksums() can update the checksums incrementally; checksums
+  // covering large writes are recomputed at egress instead.
+  void
+  evaluator::overwrite(std::size_t pos, std::size_t len, std::uint8_t checksums)
+  {
+    std::size_t first = pos / CHAR_BIT;
+    std::size_t last = (pos + len + CHAR_BIT - 1) / CHAR_BIT;
+    replicas.save(first, last);
+
+    if (!checksums)
+      return;
+    if (checksums & cs_dynamic)
+      checksums = covering_checksums(first, last);
+    checksums &= frame_checksums(modified_buffer, data.size());
+    if (!checksums)
+      return;
+
+    first &= ~std::size_t(1);
+    last = (last + 1) & ~std::size_t(1);
+    if (last - first > max_fixup_bytes) {
+      stale_checksums |= checksums;
+      return;
+    }
+    fixup.checksums = checksums;
+    fixup.first = first;
+    fixup.last = last;
+    std::size_t n = std::min<std::size_t>(last, data.size());
+    if (first < n)
+      std::memcpy(fixup.old, modified_buffer + first, n - first);
+  }
+
+  // Completes the write begun by overwrite().
+  void
+  evaluator::fixup_checksums()
+  {
+    if (!fixup.checksums)
+      return;
+    for (checksum_set c : {cs_ipv4, cs_tcp})
+      if (fixup.checksums & c)
+	replicas.save(checksum_offset(c), checksum_offset(c) + 2);
+    update_checksums(modified_buffer, data.size(), fixup.checksums,
+		     fixup.first, fixup.last, fixup.old);
+    fixup.checksums = cs_none;
   }
 
 } // namespace pip
@@ -3,16 +3,26 @@
 #include <pip/syntax.hpp>
 #include <pip/pcap.hpp>
 #include <pip/decoder.hpp>
+#include <pip/flow_cache.hpp>
+#include <pip/stats.hpp>
+#include <pip/profile.hpp>
+#include <pip/meter.hpp>
+#include <pip/group.hpp>
+#include <pip/replica.hpp>
+#include <pip/checksum.hpp>
+#include <pip/bitfield.hpp>
+#include <pip/conntrack.hpp>
+#include <pip/port_model.hpp>
+#include <pip/action_queue.hpp>
+#include <pip/inline_vector.hpp>
 
-#include <deque>
 #include <cstdint>
 #include "decode.hpp"
 
 namespace pip
 {
-  /// A queue of instructions.
-  using action_queue = std::deque<const action*>;
-
+  /// The most actions written to the action list of a packet.
+  constexpr std::size_t max_written_actions = 64;
 
   /// Evaluates a pipeline for a single packet.
   ///
@@ -28,20 +38,41 @@ namespace pip
   class evaluator
   {
   public:
-    evaluator(context& cxt, decl* prog, cap::packet& pkt, std::uint32_t physical_ports);
+    evaluator(context& cxt, decl* prog, cap::packet& pkt, std::uint32_t physical_ports,
+              flow_cache* cache = nullptr, worker_stats* counters = nullptr,
+              stage_profile* profile = nullptr, worker_meters* meters = nullptr,
+              group_table* groups = nullptr, conntrack_table* conntrack = nullptr,
+              port_model* ports = nullptr);
 
     ~evaluator();
 
-    /// Returns true if the program is finished.
-    bool done() const { return eval.empty(); }
+    /// Returns true if the program is finished. The program is finished
+    /// when both the pipeline and the egress action list are exhausted.
+    bool done() const { return eval.empty() && actions.empty(); }
     
     /// Execute the next action.
     void step();
     
-    /// Execute the program.
+    /// Execute the program. If the packet's flow missed in the flow cache,
+    /// the trace of this traversal is saved in the cache.
     void run();
 
     inline std::int32_t get_egress_port() const { return egress_port; }
+
+    /// Returns true if the frame is shorter than the program's minimum
+    /// frame size, in which case the program was not run.
+    inline bool is_truncated() const { return truncated; }
+
+    /// Returns true if the frame is not TCP or UDP over IPv4, in which
+    /// case the program was not run and the frame is dropped.
+    inline bool is_unsupported() const { return unsupported; }
+
+    /// Returns the copies of the packet output by the program.
+    inline replica_set& get_replicas() { return replicas; }
+
+    /// Returns the frame as modified by the program. The frame has the
+    /// captured size of the packet.
+    inline const unsigned char* get_modified_buffer() const { return modified_buffer; }
     inline bool controller_program() const { controller; }
 
   private:
@@ -51,6 +82,9 @@ namespace pip
     void eval_advance(const advance_action* a);
     void eval_copy(const copy_action* a);
     void eval_set(const set_action* a);
+    void eval_meter(const meter_action* a);
+    void eval_group(const group_action* a);
+    void eval_conntrack(const conntrack_action* a);
     void eval_write(const write_action* a);
     void eval_clear(const clear_action* a);
     void eval_drop(const drop_action* a);
@@ -58,6 +92,12 @@ namespace pip
     void eval_goto(const goto_action* a);
     void eval_output(const output_action* a);
 
+    void overwrite(std::size_t pos, std::size_t len, std::uint8_t checksums = cs_none);
+    void fixup_checksums();
+
+    void track_copy(const bitfield_expr* src, const bitfield_expr* dst);
+    void track_match();
+
   private:
     /// Various program facilities.
     context& cxt;
@@ -71,11 +111,8 @@ namespace pip
     /// The packet to execute the program on.
     cap::packet& data;
 
-    /// The time at which the packet arrive.
-    ///
-    /// \todo Openflow 5.1 uses a timeval-like structure that encodes seconds
-    /// and nanoseconds. timeval has seconds and microseconds. 
-    timeval arrival;
+    /// The time at which the packet arrived, in nanoseconds.
+    std::uint64_t arrival;
 
     /// The (possibly logical) port on which the packet arrived.
     std::uint32_t ingress_port;
@@ -83,24 +120,50 @@ namespace pip
     /// The physical port on which the packet arrived.
     std::uint32_t physical_port;
 
-    /// The port on which the packet will be outputted after processing.
+    /// The number of physical ports, numbered from 1.
+    std::uint32_t physical_ports;
+
+    /// The port of the last output. This is rp_unset if the packet is not
+    /// output.
     std::int32_t egress_port;
 
     /// Dynamic metadata. This can be written to by copy actions.
     std::uint64_t metadata;
 
-    /// The key used for table lookup. This can be written to by copy actions.
-    std::uint64_t keyreg;
+    /// The key used for table lookup. This can be written to by copy
+    /// actions, and is cleared on entry to each table.
+    key_value keyreg;
 
     /// The decoder offset, modified by advance instructions.
     std::uint32_t decode;
 
     /// The sequence of actions to execute on egress.
-    std::vector<const action*> actions;
+    inline_vector<const action*, max_written_actions> actions;
 
     /// A copy of the frame to be modified throughout the evaluator.
     unsigned char* modified_buffer;
 
+    /// Owns the modified buffer, which is shared with the replicas.
+    std::shared_ptr<unsigned char> frame;
+
+    /// The copies of the packet output so far.
+    replica_set replicas;
+
+    /// The write in progress whose checksums are to be updated.
+    struct checksum_fixup
+    {
+      std::uint8_t checksums = cs_none;
+      std::size_t first;
+      std::size_t last;
+
+      /// The previous contents of bytes [first, last).
+      unsigned char old[max_fixup_bytes];
+    };
+    checksum_fixup fixup;
+
+    /// The checksums to recompute at egress.
+    std::uint8_t stale_checksums = cs_none;
+
     /// The sequence of actions being evaluated. Each action is fetched from
     /// the queue in turn. On table lookup, the action list for the matched 
     /// key is added to the end of the queue.
@@ -112,17 +175,80 @@ namespace pip
     /// \note We could make this a pair of pointer + index, and point to
     /// the current action-seq being evaluated. However, we could conceivably
     /// end up dropping a rule while it is being executed. In order to avoid
-    /// that scenario, we simply copy instructions into the queue.
+    /// that scenario, we simply copy instructions into the queue. Only a
+    /// replayed trace, which no lookup can drop, is executed in place.
     action_queue eval;
 
-    /// A list of all tables in the program.
-    std::vector<decl*> tables;
-
     /// The table currently being examined.
     table_decl* current_table = nullptr;
 
     /// Set to true if outputted to controller.
     bool controller = false;
+
+    /// The flow cache, if any.
+    flow_cache* cache;
+
+    /// The hash of the packet's flow key.
+    std::uint64_t flow_hash = 0;
+
+    /// True when the executed actions are being recorded for the cache.
+    bool recording = false;
+
+    /// The actions executed and lookups performed so far, when recording.
+    flow_trace trace;
+
+    /// The rule and table counters of the current worker, if any.
+    worker_stats* counters;
+
+    /// A span of bits within the flow key.
+    struct key_span
+    {
+      std::size_t pos;
+      std::size_t len;
+    };
+
+    /// True when the flow-key bits consulted by lookups are being tracked
+    /// in order to install a megaflow.
+    bool tracking = false;
+
+    /// The flow-key bits that currently flow into the key and metadata
+    /// registers.
+    std::vector<key_span> key_sources;
+    std::vector<key_span> meta_sources;
+
+    /// The flow-key bits consulted by lookups so far.
+    std::vector<unsigned char> consulted;
+
+    /// The stage latency histograms of the current worker, if any.
+    stage_profile* profile;
+
+    /// The cycle count at which the current stage began.
+    std::uint64_t stage_start = 0;
+
+    /// True once egress processing has begun.
+    bool in_egress = false;
+
+    /// True when replaying a trace from the flow cache.
+    bool replaying = false;
+
+    /// True if the frame is too short for the program.
+    bool truncated = false;
+
+    /// True if the frame is not a protocol the evaluator supports.
+    bool unsupported = false;
+
+    /// The meter state of the current worker, if any.
+    worker_meters* meters;
+
+    /// The run-time group state, if any. Without it, select and
+    /// fast-failover groups use their first bucket.
+    group_table* groups;
+
+    /// The connection table, if any. Without it, every packet is untrackable.
+    conntrack_table* conntrack;
+
+    /// The ct_state of the packet, set by conntrack actions.
+    std::uint32_t ct_state = 0;
   };
 
 
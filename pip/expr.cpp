@@ -28,6 +28,8 @@ namespace pip
       return "port";
     case ek_bitfield:
       return "bitfield";
+    case ek_key:
+      return "key";
     }
   }
 
@@ -57,4 +59,12 @@ namespace pip
   {
     return get_phrase_name(get_kind(e));
   }
+
+  key_value
+  get_key_value(const expr* e)
+  {
+    if (const key_expr* k = as<key_expr>(e))
+      return k->value;
+    return key_value(cast<int_expr>(e)->val);
+  }
 }
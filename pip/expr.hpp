@@ -2,6 +2,7 @@
 
 #include <pip/syntax.hpp>
 #include <pip/type.hpp>
+#include <pip/key.hpp>
 
 #include <cstdint>
 #include <unordered_map>
@@ -24,7 +25,8 @@ namespace pip
     ek_ref,   // Declaration reference
     ek_named_field, // A named field, for example eth.ethertype
     ek_port, // Port number
-    ek_bitfield // A bitfield in the context or packet
+    ek_bitfield, // A bitfield in the context or packet
+    ek_key // A key literal of several fields
   };
 
   enum address_space : int
@@ -34,7 +36,8 @@ namespace pip
     as_key,
     as_meta,
     as_ingress_port,
-    as_physical_port
+    as_physical_port,
+    as_ct_state
   };
   
   /// The base class of all expressions.
@@ -155,10 +158,10 @@ namespace pip
   struct ref_expr : expr
   {
     ref_expr(type* t, symbol* id)
-      : expr(ek_ref, t), id(id)
-    { throw std::runtime_error("Unimplemented."); }
+      : expr(ek_ref, t), id(id), ref(nullptr)
+    { }
     
-    /// The identifier naming the table.
+    /// The identifier naming the declaration.
     symbol* id;
 
     /// The referenced declaration.
@@ -181,6 +184,25 @@ namespace pip
     ~bitfield_expr() { delete static_cast<loc_type*>(ty); }
   };
 
+  /// A key literal, the concatenation of its fields. The first field is
+  /// the most significant and the last ends at bit 0 of the key. This
+  /// denotes rule keys wider than an integer literal, for example the
+  /// 5-tuple of a flow or an IPv6 address.
+  struct key_expr : expr
+  {
+    key_expr(type* t, const expr_seq& fs, const key_value& v)
+      : expr(ek_key, t), fields(fs), value(v)
+    { }
+
+    /// The fields of the key, as integer literals.
+    expr_seq fields;
+
+    /// The value of the key.
+    key_value value;
+
+    ~key_expr() { delete static_cast<int_type*>(ty); }
+  };
+
   /// A reference to a packet header.
   ///
   /// \todo These probably resolve to a function that can load the value
@@ -226,6 +248,9 @@ namespace pip
   /// Returns a string representation of an expression's name.
   const char* get_phrase_name(const expr* e);
 
+  /// Returns the value of an integer or key literal as a key.
+  key_value get_key_value(const expr* e);
+
 } // namespace pip
 
 // -------------------------------------------------------------------------- //
@@ -289,4 +314,11 @@ namespace cc
     has_kind(const node* n) { return get_node_kind(n) == pip::ek_bitfield; }
   };
 
+  template<>
+  struct node_info<pip::key_expr>
+  {
+    static bool
+    has_kind(const node* n) { return get_node_kind(n) == pip::ek_key; }
+  };
+
 } // namespace cc
@@ -0,0 +1,333 @@
+#include "flow_cache.hpp"
+#include "megaflow.hpp"
+#include "group.hpp"
+#include "action.hpp"
+#include "decl.hpp"
+#include "expr.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace pip
+{
+  bool
+  is_traced(const action* a)
+  {
+    switch (get_kind(a)) {
+      case ak_match:
+      case ak_goto:
+      case ak_write:
+      case ak_clear:
+      case ak_group:
+        return false;
+      case ak_copy: {
+        auto dst = static_cast<bitfield_expr*>(cast<copy_action>(a)->dst);
+        return dst->as != as_key;
+      }
+      default:
+        return true;
+    }
+  }
+
+  // The number of (table, decode offset) states explored before giving up
+  // on a program. This bounds the analysis of pipelines that loop through
+  // advance actions.
+  static constexpr std::size_t max_states = 256;
+
+  flow_signature::flow_signature(program_decl* prog)
+  {
+    for (decl* d : prog->decls) {
+      if (get_kind(d) == dk_table) {
+        visit(cast<table_decl>(d), 0);
+        break;
+      }
+    }
+
+    // Merge overlapping and adjacent byte ranges.
+    std::sort(ranges.begin(), ranges.end(),
+      [](const byte_range& a, const byte_range& b) {
+        return a.first < b.first;
+      });
+    std::vector<byte_range> merged;
+    for (const byte_range& r : ranges) {
+      if (!merged.empty() && r.first <= merged.back().last)
+        merged.back().last = std::max(merged.back().last, r.last);
+      else
+        merged.push_back(r);
+    }
+    ranges = std::move(merged);
+
+    for (const byte_range& r : ranges)
+      length += r.last - r.first;
+    if (reads_ingress) {
+      ingress_at = length * CHAR_BIT;
+      length += sizeof(std::uint32_t);
+    }
+    if (reads_physical) {
+      physical_at = length * CHAR_BIT;
+      length += sizeof(std::uint32_t);
+    }
+  }
+
+  void
+  flow_signature::visit(table_decl* t, std::uint32_t decode)
+  {
+    if (!ok)
+      return;
+    if (!visited.emplace(t, decode).second)
+      return;
+    if (visited.size() > max_states) {
+      ok = false;
+      return;
+    }
+
+    // Rule actions run with the decode offset left by the key actions.
+    visit(t->prep, decode);
+    for (rule* r : t->rules) {
+      std::uint32_t d = decode;
+      visit(r->acts, d);
+    }
+  }
+
+  void
+  flow_signature::visit(const action_seq& as, std::uint32_t& decode)
+  {
+    for (action* a : as) {
+      switch (get_kind(a)) {
+        case ak_advance:
+          decode += static_cast<int_expr*>(cast<advance_action>(a)->amount)->val;
+          break;
+        case ak_copy: {
+          auto c = cast<copy_action>(a);
+          auto dst = static_cast<bitfield_expr*>(c->dst);
+          if (dst->as == as_key || dst->as == as_meta)
+            add(static_cast<bitfield_expr*>(c->src), decode);
+          break;
+        }
+        case ak_goto: {
+          auto dst = static_cast<ref_expr*>(cast<goto_action>(a)->dest);
+          visit(static_cast<table_decl*>(dst->ref), decode);
+          break;
+        }
+        case ak_write: {
+          // Approximate the decode offset at egress by the current one.
+          action_seq w {cast<write_action>(a)->act};
+          visit(w, decode);
+          break;
+        }
+        case ak_group: {
+          // A select group hashes the 5-tuple, so its bucket depends on
+          // those bytes. Approximate the decode offset after the group by
+          // the offset after its last bucket.
+          auto g = static_cast<group_decl*>(static_cast<ref_expr*>(cast<group_action>(a)->group)->ref);
+          if (g->kind == gk_select)
+            for (const hash_field& f : select_fields)
+              ranges.push_back({f.first, f.last});
+          std::uint32_t after = decode;
+          for (const group_bucket& b : g->buckets) {
+            after = decode;
+            visit(b.acts, after);
+          }
+          decode = after;
+          break;
+        }
+        default:
+          break;
+      }
+    }
+  }
+
+  void
+  flow_signature::add(const bitfield_expr* src, std::uint32_t decode)
+  {
+    std::uint32_t pos = static_cast<int_expr*>(src->pos)->val;
+    std::uint32_t len = static_cast<int_expr*>(src->len)->val;
+    switch (src->as) {
+      case as_header:
+        pos += decode;
+        // fallthrough
+      case as_packet:
+        ranges.push_back({pos / CHAR_BIT, (pos + len + CHAR_BIT - 1) / CHAR_BIT});
+        break;
+      case as_ingress_port:
+        reads_ingress = true;
+        break;
+      case as_physical_port:
+        reads_physical = true;
+        break;
+      default:
+        // Metadata is derived from other sources, which are recorded
+        // when they are copied into metadata.
+        break;
+    }
+  }
+
+  bool
+  flow_signature::extract(const unsigned char* pkt, std::size_t n,
+                          std::uint32_t ingress, std::uint32_t physical,
+                          unsigned char* out) const
+  {
+    if (!ranges.empty() && ranges.back().last > n)
+      return false;
+    for (const byte_range& r : ranges) {
+      std::memcpy(out, pkt + r.first, r.last - r.first);
+      out += r.last - r.first;
+    }
+    if (reads_ingress) {
+      std::memcpy(out, &ingress, sizeof(ingress));
+      out += sizeof(ingress);
+    }
+    if (reads_physical)
+      std::memcpy(out, &physical, sizeof(physical));
+    return true;
+  }
+
+  std::size_t
+  flow_signature::locate(std::uint32_t pos) const
+  {
+    std::uint32_t byte = pos / CHAR_BIT;
+    std::size_t offset = 0;
+    for (const byte_range& r : ranges) {
+      // Ranges are sorted, so a byte before this one lies in a gap.
+      if (byte < r.first)
+        return npos;
+      if (byte < r.last)
+        return (offset + byte - r.first) * CHAR_BIT + pos % CHAR_BIT;
+      offset += r.last - r.first;
+    }
+    return npos;
+  }
+
+  std::uint64_t
+  hash_key(const unsigned char* p, std::size_t n)
+  {
+    // FNV-1a, folded a word at a time.
+    std::uint64_t h = 0xcbf29ce484222325ull;
+    for (; n >= sizeof(std::uint64_t); n -= sizeof(std::uint64_t)) {
+      std::uint64_t w;
+      std::memcpy(&w, p, sizeof(w));
+      h = (h ^ w) * 0x100000001b3ull;
+      p += sizeof(w);
+    }
+    for (; n > 0; --n)
+      h = (h ^ *p++) * 0x100000001b3ull;
+    return h ^ (h >> 32);
+  }
+
+  // Returns the smallest power of 2 not less than n.
+  static std::size_t
+  round_up_pow2(std::size_t n)
+  {
+    std::size_t p = 1;
+    while (p < n)
+      p <<= 1;
+    return p;
+  }
+
+  flow_cache::flow_cache(program_decl* prog, std::size_t entries,
+                         std::size_t megaflows)
+    : sig(prog),
+      slots(round_up_pow2(std::max<std::size_t>(entries, 2))),
+      keys(slots.size() * sig.size()),
+      scratch(std::max<std::size_t>(sig.size(), 1)),
+      mask(slots.size() - 1)
+  {
+    if (megaflows)
+      this->megaflows.reset(new tuple_space(sig.size(), megaflows));
+  }
+
+  flow_cache::~flow_cache()
+  { }
+
+  std::uint64_t
+  flow_cache::hash() const
+  {
+    return hash_key(scratch.data(), sig.size());
+  }
+
+  bool
+  flow_cache::matches(std::size_t slot, std::uint64_t h) const
+  {
+    const entry& e = slots[slot];
+    return e.generation == generation
+        && e.hash == h
+        && std::memcmp(&keys[slot * sig.size()], scratch.data(), sig.size()) == 0;
+  }
+
+  const flow_trace*
+  flow_cache::lookup(std::uint64_t h)
+  {
+    std::size_t s1 = h & mask;
+    std::size_t s2 = (h >> 32) & mask;
+    if (matches(s1, h)) {
+      ++hit_count;
+      return &slots[s1].trace;
+    }
+    if (matches(s2, h)) {
+      ++hit_count;
+      return &slots[s2].trace;
+    }
+
+    // Promote megaflow hits into the exact-match level.
+    if (megaflows) {
+      if (const flow_trace* t = megaflows->lookup(scratch.data())) {
+        ++megaflow_hit_count;
+        std::size_t s = victim(h);
+        entry& e = slots[s];
+        e.hash = h;
+        e.generation = generation;
+        e.trace = *t;
+        std::memcpy(&keys[s * sig.size()], scratch.data(), sig.size());
+        return &e.trace;
+      }
+    }
+
+    ++miss_count;
+    return nullptr;
+  }
+
+  std::size_t
+  flow_cache::victim(std::uint64_t h) const
+  {
+    // Prefer a stale slot; otherwise alternate victims based on the hash.
+    std::size_t s1 = h & mask;
+    std::size_t s2 = (h >> 32) & mask;
+    if (slots[s1].generation != generation)
+      return s1;
+    if (slots[s2].generation != generation)
+      return s2;
+    return (h & (mask + 1)) ? s2 : s1;
+  }
+
+  void
+  flow_cache::insert(std::uint64_t h, const unsigned char* consulted,
+                     flow_trace&& t)
+  {
+    if (megaflows && consulted)
+      megaflows->insert(scratch.data(), consulted, t);
+
+    std::size_t s = victim(h);
+    entry& e = slots[s];
+    e.hash = h;
+    e.generation = generation;
+    e.trace = std::move(t);
+    std::memcpy(&keys[s * sig.size()], scratch.data(), sig.size());
+  }
+
+  void
+  flow_cache::invalidate()
+  {
+    ++generation;
+    if (megaflows)
+      megaflows->invalidate();
+  }
+
+  void
+  flow_cache::revalidate()
+  {
+    if (megaflows)
+      megaflows->revalidate();
+  }
+
+} // namespace pip
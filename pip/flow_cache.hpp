@@ -0,0 +1,211 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+#include <pip/stats.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace pip
+{
+  /// The sequence of actions actually executed for a packet, with table
+  /// lookups resolved. Replaying a trace reproduces the effects of the
+  /// original traversal without touching any table.
+  using action_trace = std::vector<const action*>;
+
+  /// The outcome of a table lookup performed during a traversal. The rule
+  /// is no_rule when the lookup selected nothing.
+  struct trace_lookup
+  {
+    std::uint32_t table;
+    std::uint32_t rule;
+    bool miss;
+  };
+
+  /// The trace of a traversal: the executed actions and the outcome of
+  /// each lookup, which is needed to keep counters exact on replay.
+  struct flow_trace
+  {
+    action_trace actions;
+    std::vector<trace_lookup> lookups;
+  };
+
+  /// Returns true if the action must be recorded in a trace. Lookups
+  /// (match, goto) and the key-building copies that feed them are already
+  /// resolved by the trace. Write and clear only affect which actions are
+  /// executed later, which is also captured by the trace.
+  bool is_traced(const action* a);
+
+  /// Returns a hash of the `n` bytes of a flow key.
+  std::uint64_t hash_key(const unsigned char* p, std::size_t n);
+
+  class tuple_space;
+
+  /// Describes which bytes of a packet (and which context registers) can
+  /// influence table lookups. Two packets that agree on those bytes take
+  /// the same path through the pipeline, so their concatenation identifies
+  /// a flow.
+  ///
+  /// The signature is computed once by walking every table reachable from
+  /// the entry table, tracking the decode offset along each path. Only
+  /// copies into the key or metadata registers are considered; copies into
+  /// the packet are re-executed when a trace is replayed.
+  class flow_signature
+  {
+  public:
+    flow_signature(program_decl* prog);
+
+    /// Returns true if the program could be analyzed. Programs whose decode
+    /// offsets cannot be bounded are never cached.
+    bool cacheable() const { return ok; }
+
+    /// Returns the number of bytes in a flow key.
+    std::size_t size() const { return length; }
+
+    /// Copies the flow key of a packet into `out`, which must hold at least
+    /// size() bytes. Returns false if the packet is too short to contain
+    /// every field read by the program.
+    bool extract(const unsigned char* pkt, std::size_t n,
+                 std::uint32_t ingress, std::uint32_t physical,
+                 unsigned char* out) const;
+
+    /// Returns the bit offset within the flow key of bit `pos` of the
+    /// packet, or npos if the bit is not covered by the signature.
+    std::size_t locate(std::uint32_t pos) const;
+
+    static constexpr std::size_t npos = -1;
+
+    /// Returns the bit offset within the flow key of the ingress and
+    /// physical port registers. These are only meaningful when the
+    /// program reads the corresponding register.
+    std::size_t ingress_offset() const { return ingress_at; }
+    std::size_t physical_offset() const { return physical_at; }
+
+  private:
+    void visit(table_decl* t, std::uint32_t decode);
+    void visit(const action_seq& as, std::uint32_t& decode);
+    void add(const bitfield_expr* src, std::uint32_t decode);
+
+  private:
+    /// A half-open range of bytes [first, last) read from the packet.
+    struct byte_range
+    {
+      std::uint32_t first;
+      std::uint32_t last;
+    };
+
+    /// The merged, ordered byte ranges that form the key.
+    std::vector<byte_range> ranges;
+
+    /// The (table, decode offset) states visited during analysis.
+    std::set<std::pair<table_decl*, std::uint32_t>> visited;
+
+    /// True when the ingress or physical port flows into a lookup.
+    bool reads_ingress = false;
+    bool reads_physical = false;
+
+    /// The bit offsets of the port registers in the key.
+    std::size_t ingress_at = 0;
+    std::size_t physical_at = 0;
+
+    /// The total length of a key in bytes.
+    std::size_t length = 0;
+
+    bool ok = true;
+  };
+
+  /// An exact-match microflow cache in front of the table pipeline. Each
+  /// entry maps the flow key of a packet to the trace of its traversal.
+  /// As with the OVS EMC, each key hashes to two candidate slots and
+  /// collisions simply evict.
+  ///
+  /// Entries are stamped with a generation number. Any change to the rules
+  /// of a table must call invalidate(), which retires every entry in O(1).
+  ///
+  /// Behind the exact-match level, the cache may hold a megaflow level: a
+  /// tuple-space classifier of wildcarded flows, where each megaflow only
+  /// constrains the key bits actually consulted by the lookups of a
+  /// traversal. A megaflow hit is promoted to the exact-match level.
+  ///
+  /// \note A cache serves one evaluator at a time; the key buffer is shared.
+  class flow_cache
+  {
+  public:
+    flow_cache(program_decl* prog, std::size_t entries, std::size_t megaflows = 0);
+    ~flow_cache();
+
+    /// Returns the flow signature of the program.
+    const flow_signature& signature() const { return sig; }
+
+    /// Returns true if the program can be cached at all.
+    bool enabled() const { return sig.cacheable(); }
+
+    /// Returns the buffer into which flow keys are extracted.
+    unsigned char* key() { return scratch.data(); }
+
+    /// Returns the hash of the key currently in the key buffer.
+    std::uint64_t hash() const;
+
+    /// Returns the trace for the key currently in the key buffer, or
+    /// nullptr if the flow is not cached.
+    const flow_trace* lookup(std::uint64_t h);
+
+    /// Returns true if the cache has a megaflow level.
+    bool has_megaflows() const { return megaflows != nullptr; }
+
+    /// Saves the trace for the key currently in the key buffer. When `mask`
+    /// is non-null, it is the set of key bits consulted by the traversal,
+    /// and a megaflow covering the trace is installed as well.
+    void insert(std::uint64_t h, const unsigned char* mask, flow_trace&& t);
+
+    /// Retires all cached traces.
+    void invalidate();
+
+    /// Reclaims the memory held by retired megaflows.
+    void revalidate();
+
+    std::uint64_t hits() const { return hit_count; }
+    std::uint64_t megaflow_hits() const { return megaflow_hit_count; }
+    std::uint64_t misses() const { return miss_count; }
+
+  private:
+    struct entry
+    {
+      std::uint64_t hash = 0;
+      std::uint64_t generation = 0;
+      flow_trace trace;
+    };
+
+    bool matches(std::size_t slot, std::uint64_t h) const;
+    std::size_t victim(std::uint64_t h) const;
+
+  private:
+    flow_signature sig;
+
+    /// The slots of the cache; the number of slots is a power of 2.
+    std::vector<entry> slots;
+
+    /// The keys of each slot, stored contiguously.
+    std::vector<unsigned char> keys;
+
+    /// The key of the packet being evaluated.
+    std::vector<unsigned char> scratch;
+
+    std::size_t mask;
+
+    /// The current generation. Entries from older generations are stale.
+    /// Generation 0 is never current, so empty slots never match.
+    std::uint64_t generation = 1;
+
+    /// The megaflow level, if any.
+    std::unique_ptr<tuple_space> megaflows;
+
+    std::uint64_t hit_count = 0;
+    std::uint64_t megaflow_hit_count = 0;
+    std::uint64_t miss_count = 0;
+  };
+
+} // namespace pip
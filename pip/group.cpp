@@ -0,0 +1,175 @@
+#include "group.hpp"
+#include "decl.hpp"
+#include "flow_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace pip
+{
+  std::uint64_t
+  select_hash(const unsigned char* pkt, std::size_t n)
+  {
+    unsigned char buf[16] = {};
+    std::size_t len = 0;
+    for (const hash_field& f : select_fields) {
+      if (f.first < n)
+        std::memcpy(buf + len, pkt + f.first, std::min<std::size_t>(f.last, n) - f.first);
+      len += f.last - f.first;
+    }
+    return hash_key(buf, len);
+  }
+
+  // Mixes a 64-bit value (splitmix64 finalizer).
+  static std::uint64_t
+  mix(std::uint64_t x)
+  {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  static bool
+  is_prime(std::size_t n)
+  {
+    if (n < 2)
+      return false;
+    for (std::size_t d = 2; d * d <= n; ++d)
+      if (n % d == 0)
+        return false;
+    return true;
+  }
+
+  // Returns the size of the lookup table for a group whose bucket weights
+  // sum to `weight`: the smallest prime of at least 100 entries per unit
+  // of weight, within the range of 16-bit bucket indexes.
+  static std::size_t
+  table_size_for(std::uint64_t weight)
+  {
+    std::size_t n = std::min<std::uint64_t>(std::max<std::uint64_t>(weight * 100, 251), 65521);
+    while (!is_prime(n))
+      ++n;
+    return n;
+  }
+
+  group_table::group_table(program_decl* prog)
+  {
+    for (decl* d : prog->decls) {
+      if (get_kind(d) != dk_group)
+        continue;
+      group_decl* g = cast<group_decl>(d);
+      if (groups.size() <= g->index)
+        groups.resize(g->index + 1);
+      groups[g->index].decl = g;
+    }
+    for (group_state& g : groups)
+      if (g.decl)
+        rebuild(g, false);
+  }
+
+  bool
+  group_table::port_live(std::uint32_t port) const
+  {
+    return port >= down.size() || !down[port];
+  }
+
+  bool
+  group_table::live(const group_state& g, std::size_t b) const
+  {
+    std::int32_t port = g.decl->buckets[b].watch_port;
+    return port == no_watch_port || port_live(port);
+  }
+
+  bool
+  group_table::set_port_live(std::uint32_t port, bool up)
+  {
+    if (port_live(port) == up)
+      return false;
+    if (down.size() <= port)
+      down.resize(port + 1);
+    down[port] = !up;
+
+    bool changed = false;
+    for (group_state& g : groups) {
+      if (!g.decl)
+        continue;
+      for (const group_bucket& b : g.decl->buckets) {
+        if (b.watch_port == std::int32_t(port)) {
+          rebuild(g, !up);
+          changed = true;
+          break;
+        }
+      }
+    }
+    return changed;
+  }
+
+  void
+  group_table::rebuild(group_state& g, bool keep)
+  {
+    const bucket_seq& buckets = g.decl->buckets;
+
+    g.first_live = no_bucket;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+      if (live(g, i)) {
+        g.first_live = i;
+        break;
+      }
+    }
+
+    if (g.decl->kind != gk_select || g.first_live == no_bucket) {
+      g.lookup.clear();
+      return;
+    }
+
+    // Each live bucket walks its own permutation of the table, determined
+    // only by the group and bucket index, and claims the next free entry
+    // once per unit of weight in each round. When keeping the table, only
+    // the entries of buckets that are down are free.
+    std::uint64_t weight = 0;
+    for (const group_bucket& b : buckets)
+      weight += b.weight;
+    std::size_t size = table_size_for(weight);
+
+    struct cursor
+    {
+      std::size_t bucket;
+      std::size_t offset;
+      std::size_t skip;
+      std::size_t next;
+    };
+    std::vector<cursor> cursors;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+      if (!live(g, i))
+        continue;
+      std::uint64_t h = mix((std::uint64_t(g.decl->index) << 32) | i);
+      cursors.push_back({i, h % size, mix(h) % (size - 1) + 1, 0});
+    }
+
+    const std::uint16_t empty = 0xffff;
+    std::size_t filled = 0;
+    if (keep && g.lookup.size() == size) {
+      for (std::uint16_t& b : g.lookup) {
+        if (live(g, b))
+          ++filled;
+        else
+          b = empty;
+      }
+    }
+    else
+      g.lookup.assign(size, empty);
+    while (filled < size) {
+      for (cursor& c : cursors) {
+        for (std::uint32_t w = 0; w < buckets[c.bucket].weight && filled < size; ++w) {
+          std::size_t slot;
+          do
+            slot = (c.offset + c.next++ * c.skip) % size;
+          while (g.lookup[slot] != empty);
+          g.lookup[slot] = c.bucket;
+          ++filled;
+        }
+      }
+    }
+  }
+
+} // namespace pip
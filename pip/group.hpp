@@ -0,0 +1,96 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace pip
+{
+  /// Indicates that a group has no live bucket.
+  constexpr std::uint32_t no_bucket = -1;
+
+  /// A half-open range of bytes [first, last) of a frame.
+  struct hash_field
+  {
+    std::uint32_t first;
+    std::uint32_t last;
+  };
+
+  /// The bytes of an Ethernet/IPv4 frame hashed by select groups: the
+  /// protocol, the addresses, and the transport ports. As elsewhere, the
+  /// IPv4 header is assumed to have no options.
+  constexpr hash_field select_fields[] = {
+    {23, 24},
+    {26, 38},
+  };
+
+  /// Returns the select hash of the `n`-byte frame `pkt`. Fields past the
+  /// end of the frame hash as zeros.
+  std::uint64_t select_hash(const unsigned char* pkt, std::size_t n);
+
+  /// The run-time state of the groups of a program.
+  ///
+  /// Each select group has a Maglev lookup table: a prime-sized array of
+  /// bucket indexes in which each live bucket owns a share of the entries
+  /// proportional to its weight. Selecting a bucket is a single multiply
+  /// and load. Each bucket fills the table by its own fixed permutation.
+  /// When a bucket goes down, only its entries are refilled, so only its
+  /// flows move. When a bucket comes back, the table is filled anew, and
+  /// only a small fraction of entries that did not belong to it change
+  /// owner.
+  ///
+  /// Bucket liveness is derived from the liveness of watched ports. All
+  /// ports are initially live.
+  class group_table
+  {
+  public:
+    group_table(program_decl* prog);
+
+    /// Returns the bucket of select group `n` for a packet whose select
+    /// hash is `h`, or no_bucket if no bucket is live.
+    std::uint32_t
+    select(std::uint32_t n, std::uint64_t h) const
+    {
+      const std::vector<std::uint16_t>& t = groups[n].lookup;
+      if (t.empty())
+        return no_bucket;
+      return t[(std::uint64_t(std::uint32_t(h)) * t.size()) >> 32];
+    }
+
+    /// Returns the first live bucket of fast-failover group `n`, or
+    /// no_bucket if no bucket is live.
+    std::uint32_t failover(std::uint32_t n) const { return groups[n].first_live; }
+
+    /// Sets the liveness of a port. Returns true if the live buckets of
+    /// any group changed, in which case cached traces are stale and the
+    /// flow cache must be invalidated.
+    bool set_port_live(std::uint32_t port, bool live);
+
+    /// Returns true if the port is live.
+    bool port_live(std::uint32_t port) const;
+
+    /// Returns the size of the lookup table of select group `n`.
+    std::size_t table_size(std::uint32_t n) const { return groups[n].lookup.size(); }
+
+  private:
+    struct group_state
+    {
+      group_decl* decl = nullptr;
+      std::vector<std::uint16_t> lookup;
+      std::uint32_t first_live = no_bucket;
+    };
+
+    bool live(const group_state& g, std::size_t b) const;
+    /// Recomputes the live buckets of a group. If `keep` is true, the
+    /// entries of buckets that are still live are kept.
+    void rebuild(group_state& g, bool keep);
+
+    /// The groups of the program, by index.
+    std::vector<group_state> groups;
+
+    /// The ports that are down, by port number.
+    std::vector<bool> down;
+  };
+
+} // namespace pip
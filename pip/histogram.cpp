@@ -0,0 +1,50 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pip
+{
+  void
+  histogram::merge(const histogram& h)
+  {
+    for (std::size_t i = 0; i < bucket_count; ++i)
+      counts[i] += h.counts[i];
+    total += h.total;
+    largest = std::max(largest, h.largest);
+  }
+
+  std::uint64_t
+  histogram::upper(std::size_t i)
+  {
+    if (i < sub_count)
+      return i;
+    int shift = (i >> sub_bits) - 1;
+    std::uint64_t lower = std::uint64_t(sub_count + (i & (sub_count - 1))) << shift;
+    return lower + ((std::uint64_t(1) << shift) - 1);
+  }
+
+  std::uint64_t
+  histogram::percentile(double q) const
+  {
+    if (!total)
+      return 0;
+    std::uint64_t rank = std::max<std::uint64_t>(std::ceil(q * total), 1);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+      seen += counts[i];
+      if (seen >= rank)
+        return std::min(upper(i), largest);
+    }
+    return largest;
+  }
+
+  void
+  histogram::clear()
+  {
+    counts.fill(0);
+    total = 0;
+    largest = 0;
+  }
+
+} // namespace pip
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace pip
+{
+  /// A log-bucketed histogram in the style of HdrHistogram. Values below
+  /// 2^sub_bits are counted exactly. Larger values fall into one of
+  /// 2^sub_bits linear sub-buckets of their power of two, which bounds the
+  /// relative error of any reported value by 2^-sub_bits (about 6%).
+  ///
+  /// Recording is a count-leading-zeros, two shifts and an increment.
+  /// Histograms are not synchronized; each thread records into its own
+  /// and they are merged for reporting.
+  class histogram
+  {
+  public:
+    static constexpr int sub_bits = 4;
+    static constexpr std::size_t sub_count = 1 << sub_bits;
+    static constexpr std::size_t bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    /// Records a single sample.
+    void record(std::uint64_t v)
+    {
+      ++counts[index(v)];
+      ++total;
+      if (v > largest)
+        largest = v;
+    }
+
+    /// Adds the samples of another histogram to this one.
+    void merge(const histogram& h);
+
+    /// Returns the number of samples.
+    std::uint64_t size() const { return total; }
+
+    /// Returns the largest sample.
+    std::uint64_t max() const { return largest; }
+
+    /// Returns the value at or below which the fraction `q` of samples
+    /// fall, rounded up to the upper bound of its bucket.
+    std::uint64_t percentile(double q) const;
+
+    /// Discards all samples.
+    void clear();
+
+  private:
+    static std::size_t
+    index(std::uint64_t v)
+    {
+      if (v < sub_count)
+        return v;
+      int e = 63 - __builtin_clzll(v);
+      return ((e - sub_bits + 1) << sub_bits) + ((v >> (e - sub_bits)) & (sub_count - 1));
+    }
+
+    /// Returns the largest value that falls into bucket `i`.
+    static std::uint64_t upper(std::size_t i);
+
+    std::array<std::uint64_t, bucket_count> counts {};
+    std::uint64_t total = 0;
+    std::uint64_t largest = 0;
+  };
+
+} // namespace pip
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+
+namespace pip
+{
+  /// A vector of at most N elements, stored inline. Elements must be
+  /// trivially copyable. Exceeding the capacity throws std::runtime_error.
+  template<typename T, std::size_t N>
+  class inline_vector
+  {
+  public:
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+    static constexpr std::size_t capacity() { return N; }
+
+    void clear() { count = 0; }
+
+    void
+    push_back(const T& x)
+    {
+      if (count == N) {
+        std::stringstream ss;
+        ss << "More than " << N << " elements in an inline vector";
+        throw std::runtime_error(ss.str());
+      }
+      elems[count++] = x;
+    }
+
+    T& operator[](std::size_t n) { return elems[n]; }
+    const T& operator[](std::size_t n) const { return elems[n]; }
+
+    iterator begin() { return elems; }
+    iterator end() { return elems + count; }
+    const_iterator begin() const { return elems; }
+    const_iterator end() const { return elems + count; }
+
+  private:
+    T elems[N];
+    std::size_t count = 0;
+  };
+
+} // namespace pip
@@ -0,0 +1,145 @@
+#include "key.hpp"
+#include "bitfield.hpp"
+
+#include <iomanip>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define PIP_X86 1
+#endif
+
+namespace pip
+{
+  void
+  key_value::insert(std::size_t pos, std::size_t n, std::uint64_t v)
+  {
+    std::size_t w = pos / 64;
+    std::size_t off = pos % 64;
+    v &= low_bits(n);
+    std::uint64_t mask = low_bits(n) << off;
+    words[w] = (words[w] & ~mask) | (v << off);
+
+    // The high bits of the field spill into the next word.
+    if (off + n > 64) {
+      std::uint64_t rest = low_bits(off + n - 64);
+      words[w + 1] = (words[w + 1] & ~rest) | (v >> (64 - off));
+    }
+  }
+
+  void
+  key_value::load(std::size_t at, const unsigned char* p, std::size_t size,
+                  std::size_t pos, std::size_t n)
+  {
+    // Move the field a word at a time, from its least significant end.
+    for (std::size_t done = 0; done < n; ) {
+      std::size_t c = n - done < 64 ? n - done : 64;
+      insert(at + done, c, extract_bits(p, size, pos + n - done - c, c));
+      done += c;
+    }
+  }
+
+  bool
+  key_value::narrow() const
+  {
+    std::uint64_t high = 0;
+    for (std::size_t i = 1; i < key_words; ++i)
+      high |= words[i];
+    return high == 0;
+  }
+
+  bool
+  operator==(const key_value& a, const key_value& b)
+  {
+    static_assert(sizeof a.words == 64, "keys are compared in 64-byte blocks");
+#if defined(__AVX2__)
+    auto pa = reinterpret_cast<const __m256i*>(a.words);
+    auto pb = reinterpret_cast<const __m256i*>(b.words);
+    __m256i x = _mm256_or_si256(
+      _mm256_xor_si256(_mm256_loadu_si256(pa), _mm256_loadu_si256(pb)),
+      _mm256_xor_si256(_mm256_loadu_si256(pa + 1), _mm256_loadu_si256(pb + 1)));
+    return _mm256_testz_si256(x, x);
+#elif defined(__SSE2__)
+    auto pa = reinterpret_cast<const __m128i*>(a.words);
+    auto pb = reinterpret_cast<const __m128i*>(b.words);
+    __m128i x = _mm_setzero_si128();
+    for (int i = 0; i < 4; ++i)
+      x = _mm_or_si128(x, _mm_xor_si128(_mm_loadu_si128(pa + i), _mm_loadu_si128(pb + i)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) == 0xffff;
+#else
+    return std::memcmp(a.words, b.words, sizeof a.words) == 0;
+#endif
+  }
+
+  std::ostream&
+  operator<<(std::ostream& os, const key_value& k)
+  {
+    if (k.narrow())
+      return os << k.words[0];
+
+    std::size_t top = key_words - 1;
+    while (k.words[top] == 0)
+      --top;
+    std::ios_base::fmtflags flags = os.flags();
+    os << "0x" << std::hex << k.words[top];
+    for (std::size_t i = top; i-- > 0; )
+      os << std::setw(16) << std::setfill('0') << k.words[i];
+    os.flags(flags);
+    return os;
+  }
+
+  namespace
+  {
+    // CRC32C (Castagnoli), reflected.
+    constexpr std::uint32_t crc32c_poly = 0x82f63b78;
+
+    struct crc32c_table
+    {
+      crc32c_table()
+      {
+        for (std::uint32_t i = 0; i < 256; ++i) {
+          std::uint32_t c = i;
+          for (int j = 0; j < 8; ++j)
+            c = c & 1 ? (c >> 1) ^ crc32c_poly : c >> 1;
+          entries[i] = c;
+        }
+      }
+
+      std::uint32_t entries[256];
+    };
+
+    std::uint32_t
+    key_crc_sw(const key_value& k)
+    {
+      static const crc32c_table table;
+      std::uint32_t c = ~0u;
+      for (std::uint64_t w : k.words)
+        for (int i = 0; i < 8; ++i, w >>= 8)
+          c = table.entries[(c ^ w) & 0xff] ^ (c >> 8);
+      return ~c;
+    }
+
+#if defined(PIP_X86) && defined(__x86_64__)
+    __attribute__((target("sse4.2"))) std::uint32_t
+    key_crc_hw(const key_value& k)
+    {
+      std::uint64_t c = ~0u;
+      for (std::uint64_t w : k.words)
+        c = _mm_crc32_u64(c, w);
+      return ~std::uint32_t(c);
+    }
+#endif
+  } // namespace
+
+  std::uint32_t
+  key_crc(const key_value& k)
+  {
+#if defined(PIP_X86) && defined(__x86_64__)
+    static const bool hw = __builtin_cpu_supports("sse4.2");
+    if (hw)
+      return key_crc_hw(k);
+#endif
+    return key_crc_sw(k);
+  }
+
+} // namespace pip
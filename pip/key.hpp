@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+
+namespace pip
+{
+  /// The width of the key register, in bits.
+  constexpr std::size_t max_key_bits = 512;
+
+  /// The number of 64-bit words in a key.
+  constexpr std::size_t key_words = max_key_bits / 64;
+
+  /// The value of the key register, or the key of a rule.
+  ///
+  /// Bit i of a key is bit i % 64 of word i / 64, and a field copied into
+  /// the key lands at its bit position. A key of up to 64 bits is thus its
+  /// integer value, and a key literal made of several fields lists them
+  /// from the most significant. Unused words are zero, so keys of any
+  /// width compare and hash alike.
+  struct key_value
+  {
+    key_value() = default;
+
+    explicit key_value(std::uint64_t v)
+    { words[0] = v; }
+
+    /// Clears every bit of the key.
+    void clear() { std::memset(words, 0, sizeof words); }
+
+    /// Replaces bits [pos, pos + n) with the low `n` bits of `v`, where
+    /// 0 < n <= 64.
+    void insert(std::size_t pos, std::size_t n, std::uint64_t v);
+
+    /// Replaces bits [at, at + n) with the `n`-bit field at bit `pos` of
+    /// the `size`-byte frame `p`. The field may be of any width.
+    void load(std::size_t at, const unsigned char* p, std::size_t size,
+              std::size_t pos, std::size_t n);
+
+    /// Returns true if the key fits in 64 bits.
+    bool narrow() const;
+
+    std::uint64_t words[key_words] = {};
+  };
+
+  /// Compares two keys, 16 or 32 bytes at a time where SIMD is available.
+  bool operator==(const key_value& a, const key_value& b);
+
+  inline bool
+  operator!=(const key_value& a, const key_value& b)
+  {
+    return !(a == b);
+  }
+
+  /// Prints a narrow key in decimal and a wide key in hexadecimal.
+  std::ostream& operator<<(std::ostream& os, const key_value& k);
+
+  /// Returns the CRC32C of a key. This uses the SSE4.2 instruction when
+  /// the processor has it.
+  std::uint32_t key_crc(const key_value& k);
+
+  /// Hashes keys for exact-match tables.
+  struct key_hash
+  {
+    std::size_t operator()(const key_value& k) const { return key_crc(k); }
+  };
+
+} // namespace pip
@@ -4,7 +4,10 @@
 #include <pip/decl.hpp>
 #include <pip/translator.hpp>
 #include <pip/resolver.hpp>
+#include <pip/type_checker.hpp>
+#include <pip/table.hpp>
 #include <pip/evaluator.hpp>
+#include <pip/port_model.hpp>
 #include <pip/pcap.hpp>
 #include <pip/decode.hpp>
 #include <pip/codegen.hpp>
@@ -20,6 +23,7 @@
 #include <iostream>
 #include <fstream>
 #include <cstdint>
+#include <memory>
 
 namespace pip
 {
@@ -61,6 +65,7 @@ public:
       
 	physical_ports = amount;
       }
+      ports = std::make_unique<port_model>(pm_random, physical_ports);
 
       // Stage 2: Parse the program as an uninterpreted s-expression.
       sexpr::context sexpr(diags, inputs, syms);
@@ -74,6 +79,21 @@ public:
       // Stage 4: Name lookup. Match identifiers to declarations.
       resolver resolve(cxt);
       resolve(prog);
+
+      // Stage 5: Type checking.
+      type_checker types(cxt, static_cast<program_decl*>(prog));
+      types.check();
+
+      // Find the writes covered by IPv4 and TCP checksums.
+      mark_checksums(static_cast<program_decl*>(prog));
+
+      // Build the lookup structure of each table.
+      build_tables(static_cast<program_decl*>(prog));
+
+      // Flooding replicates to every physical port, so their number
+      // must be known.
+      if (physical_ports == (std::uint32_t)(~0) && floods(static_cast<program_decl*>(prog)))
+        throw std::logic_error("Flooding to all ports requires the number of physical ports. Usage: -p <uint32> or --ports <uint32>.");
     }
 
     catch(cc::diagnosable_error& err) {
@@ -86,7 +106,8 @@ public:
   
   inline evaluator build_evaluator(cap::packet& pkt)
   {
-    return evaluator(cxt, static_cast<program_decl*>(prog), pkt, physical_ports);
+    return evaluator(cxt, static_cast<program_decl*>(prog), pkt, physical_ports,
+                     nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, ports.get());
   }
 
 
@@ -110,6 +131,9 @@ private:
   decl* prog;
 
   std::uint32_t physical_ports;
+
+  /// Assigns the physical port of each packet.
+  std::unique_ptr<port_model> ports;
 };
 
 } //namespace pip
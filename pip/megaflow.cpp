@@ -0,0 +1,134 @@
+#include "megaflow.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace pip
+{
+  tuple_space::tuple_space(std::size_t n, std::size_t max)
+    : length(n), capacity(max), scratch(n)
+  { }
+
+  // Writes `key & s.mask` into the scratch buffer.
+  void
+  tuple_space::apply(const subtable& s, const unsigned char* key)
+  {
+    for (std::size_t i = 0; i < length; ++i)
+      scratch[i] = key[i] & s.mask[i];
+  }
+
+  const tuple_space::megaflow*
+  tuple_space::find(const subtable& s, std::uint64_t h) const
+  {
+    std::size_t m = s.slots.size() - 1;
+    for (std::size_t i = h & m; s.slots[i] >= 0; i = (i + 1) & m) {
+      const megaflow& f = s.flows[s.slots[i]];
+      if (f.hash == h && std::memcmp(f.key.data(), scratch.data(), length) == 0)
+        return &f;
+    }
+    return nullptr;
+  }
+
+  const flow_trace*
+  tuple_space::lookup(const unsigned char* key)
+  {
+    for (std::size_t i = 0; i < tables.size(); ++i) {
+      subtable& s = tables[i];
+      apply(s, key);
+      const megaflow* f = find(s, hash_key(scratch.data(), length));
+      if (!f || f->generation != generation)
+        continue;
+
+      // Keep the most frequently hit subtables at the front. Swapping
+      // subtables does not move their megaflows, so `f` remains valid.
+      ++s.hits;
+      if (i > 0 && s.hits > tables[i - 1].hits)
+        std::swap(tables[i], tables[i - 1]);
+      return &f->trace;
+    }
+    return nullptr;
+  }
+
+  void
+  tuple_space::place(subtable& s, std::int32_t index)
+  {
+    std::size_t m = s.slots.size() - 1;
+    std::size_t i = s.flows[index].hash & m;
+    while (s.slots[i] >= 0)
+      i = (i + 1) & m;
+    s.slots[i] = index;
+  }
+
+  void
+  tuple_space::rehash(subtable& s, std::size_t n)
+  {
+    s.slots.assign(n, -1);
+    for (std::size_t i = 0; i < s.flows.size(); ++i)
+      place(s, i);
+  }
+
+  bool
+  tuple_space::insert(const unsigned char* key, const unsigned char* mask,
+                      const flow_trace& t)
+  {
+    // Reclaim stale megaflows before giving up.
+    if (count >= capacity) {
+      revalidate();
+      if (count >= capacity)
+        return false;
+    }
+
+    auto iter = std::find_if(tables.begin(), tables.end(),
+      [&](const subtable& s) {
+        return std::memcmp(s.mask.data(), mask, length) == 0;
+      });
+    if (iter == tables.end()) {
+      tables.emplace_back();
+      iter = tables.end() - 1;
+      iter->mask.assign(mask, mask + length);
+      iter->slots.assign(8, -1);
+    }
+
+    subtable& s = *iter;
+    apply(s, key);
+    std::uint64_t h = hash_key(scratch.data(), length);
+
+    // A stale megaflow with the same masked key is refreshed in place.
+    if (const megaflow* f = find(s, h)) {
+      megaflow& g = s.flows[f - s.flows.data()];
+      g.generation = generation;
+      g.trace = t;
+      return true;
+    }
+
+    s.flows.push_back({h, generation, scratch, t});
+    ++count;
+    if (2 * s.flows.size() > s.slots.size())
+      rehash(s, 2 * s.slots.size());
+    else
+      place(s, s.flows.size() - 1);
+    return true;
+  }
+
+  void
+  tuple_space::revalidate()
+  {
+    count = 0;
+    for (subtable& s : tables) {
+      auto last = std::remove_if(s.flows.begin(), s.flows.end(),
+        [&](const megaflow& f) { return f.generation != generation; });
+      s.flows.erase(last, s.flows.end());
+      count += s.flows.size();
+    }
+    tables.erase(std::remove_if(tables.begin(), tables.end(),
+      [](const subtable& s) { return s.flows.empty(); }), tables.end());
+    for (subtable& s : tables) {
+      std::size_t n = 8;
+      while (n < 2 * s.flows.size())
+        n <<= 1;
+      rehash(s, n);
+    }
+  }
+
+} // namespace pip
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <pip/flow_cache.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace pip
+{
+  /// A tuple-space classifier of wildcarded flows. Each megaflow is a
+  /// (mask, masked key) pair over the flow key layout of a program. All
+  /// megaflows that share a mask live in the same subtable, which is an
+  /// exact-match hash table on the masked key. Lookup probes each subtable
+  /// in turn; subtables that hit more often migrate to the front.
+  ///
+  /// Like the exact-match cache, megaflows are generation-stamped and are
+  /// retired by invalidate(). Calling revalidate() afterwards reclaims the
+  /// memory held by stale megaflows and empty subtables.
+  class tuple_space
+  {
+  public:
+    /// Constructs a classifier for keys of `n` bytes holding no more than
+    /// `max` megaflows.
+    tuple_space(std::size_t n, std::size_t max);
+
+    /// Returns the trace of the megaflow covering `key`, or nullptr if
+    /// there is none.
+    const flow_trace* lookup(const unsigned char* key);
+
+    /// Installs a megaflow covering all keys that agree with `key` on the
+    /// bits set in `mask`. Returns false if the classifier is full.
+    bool insert(const unsigned char* key, const unsigned char* mask,
+                const flow_trace& t);
+
+    /// Retires all megaflows.
+    void invalidate() { ++generation; }
+
+    /// Removes stale megaflows and empty subtables.
+    void revalidate();
+
+    /// Returns the number of megaflows held, including stale ones.
+    std::size_t size() const { return count; }
+
+    /// Returns the number of subtables (distinct masks).
+    std::size_t subtables() const { return tables.size(); }
+
+  private:
+    struct megaflow
+    {
+      std::uint64_t hash;
+      std::uint64_t generation;
+      std::vector<unsigned char> key;
+      flow_trace trace;
+    };
+
+    /// The megaflows sharing a single mask. Slots index into `flows`;
+    /// -1 marks an empty slot. The slot array is kept at most half full.
+    struct subtable
+    {
+      std::vector<unsigned char> mask;
+      std::vector<std::int32_t> slots;
+      std::vector<megaflow> flows;
+      std::uint64_t hits = 0;
+    };
+
+    void apply(const subtable& s, const unsigned char* key);
+    const megaflow* find(const subtable& s, std::uint64_t h) const;
+    void place(subtable& s, std::int32_t index);
+    void rehash(subtable& s, std::size_t n);
+
+  private:
+    std::size_t length;
+    std::size_t capacity;
+    std::size_t count = 0;
+    std::uint64_t generation = 1;
+
+    std::vector<subtable> tables;
+
+    /// The masked key being probed.
+    std::vector<unsigned char> scratch;
+  };
+
+} // namespace pip
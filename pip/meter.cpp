@@ -0,0 +1,163 @@
+#include "meter.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <new>
+
+namespace pip
+{
+  // Returns n rounded up to a multiple of the cache line size.
+  static std::size_t
+  round_to_line(std::size_t n)
+  {
+    return (n + cache_line_size - 1) / cache_line_size * cache_line_size;
+  }
+
+  worker_meters::worker_meters(meter_table& t, std::size_t workers)
+    : table(t)
+  {
+    std::size_t nbands = t.bands.size();
+    for (const meter_band* b : t.bands)
+      grants.push_back(std::max<std::uint64_t>(
+        b->burst * tokens_per_burst_unit / std::max<std::size_t>(workers, 1), 1));
+
+    std::size_t bucket_bytes = round_to_line(nbands * sizeof(local_bucket));
+    std::size_t counter_bytes = round_to_line(nbands * sizeof(band_counters));
+
+    // Over-allocate by one line so that the arrays can be aligned.
+    storage.reset(new unsigned char[bucket_bytes + counter_bytes + cache_line_size]);
+    auto base = reinterpret_cast<std::uintptr_t>(storage.get());
+    unsigned char* p = storage.get() + (round_to_line(base) - base);
+
+    buckets = new (p) local_bucket[nbands]();
+    counters = new (p + bucket_bytes) band_counters[nbands];
+  }
+
+  const meter_band*
+  worker_meters::apply(std::uint32_t n, std::uint64_t now, std::size_t bytes)
+  {
+    const meter_decl* m = table.meters[n];
+    std::size_t first = table.first[n];
+    std::uint64_t cost = meter_cost(m->unit, bytes);
+
+    // Charge every band that can pay for the packet. Of the bands that
+    // cannot, apply the one with the highest rate.
+    std::size_t applied = 0;
+    const meter_band* band = nullptr;
+    for (std::size_t i = 0; i < m->bands.size(); ++i) {
+      local_bucket& l = buckets[first + i];
+      if (!l.last || now >= l.last + interval ||
+          (l.tokens < cost && now >= l.last + min_retry))
+        rebalance(first + i, now);
+
+      if (l.tokens >= cost) {
+        l.tokens -= cost;
+      }
+      else if (!band || m->bands[i].rate > band->rate) {
+        band = &m->bands[i];
+        applied = first + i;
+      }
+    }
+
+    if (band) {
+      ++counters[applied].packets;
+      counters[applied].bytes += bytes;
+    }
+    return band;
+  }
+
+  void
+  worker_meters::rebalance(std::size_t b, std::uint64_t now)
+  {
+    shared_bucket& s = table.shared[b];
+    const meter_band& band = *table.bands[b];
+    std::uint64_t cap = band.burst * tokens_per_burst_unit;
+
+    // Credit the shared bucket for the time since it was last credited.
+    // Exactly one worker wins each interval; the pool starts full.
+    std::uint64_t stamp = s.stamp.load(std::memory_order_relaxed);
+    if (now > stamp && s.stamp.compare_exchange_strong(stamp, now) && stamp) {
+      std::uint64_t elapsed = std::min(now - stamp, cap / band.rate + 1);
+      std::uint64_t add = elapsed * band.rate;
+      std::uint64_t p = s.pool.load(std::memory_order_relaxed);
+      while (!s.pool.compare_exchange_weak(p, std::min(p + add, cap)))
+        ;
+    }
+
+    // Return the unspent tokens and take a new grant.
+    local_bucket& l = buckets[b];
+    std::uint64_t p = s.pool.load(std::memory_order_relaxed);
+    std::uint64_t q;
+    std::uint64_t take;
+    do {
+      q = std::min(p + l.tokens, cap);
+      take = std::min(q, grants[b]);
+    } while (!s.pool.compare_exchange_weak(p, q - take));
+    l.tokens = take;
+    l.last = now;
+  }
+
+  const band_counters&
+  worker_meters::band(std::uint32_t n, std::size_t b) const
+  {
+    return counters[table.first[n] + b];
+  }
+
+  meter_table::meter_table(program_decl* prog, std::size_t n)
+  {
+    for (decl* d : prog->decls) {
+      if (get_kind(d) != dk_meter)
+        continue;
+      meter_decl* m = cast<meter_decl>(d);
+      if (meters.size() <= m->index)
+        meters.resize(m->index + 1);
+      meters[m->index] = m;
+    }
+
+    for (meter_decl* m : meters) {
+      first.push_back(bands.size());
+      if (m)
+        for (const meter_band& b : m->bands)
+          bands.push_back(&b);
+    }
+
+    // Over-allocate by one line so that the buckets can be aligned.
+    storage.reset(new unsigned char[bands.size() * sizeof(shared_bucket) + cache_line_size]);
+    auto base = reinterpret_cast<std::uintptr_t>(storage.get());
+    shared = reinterpret_cast<shared_bucket*>(storage.get() + (round_to_line(base) - base));
+    for (std::size_t i = 0; i < bands.size(); ++i) {
+      new (&shared[i]) shared_bucket;
+      shared[i].pool = bands[i]->burst * tokens_per_burst_unit;
+      shared[i].stamp = 0;
+    }
+
+    n = std::max<std::size_t>(n, 1);
+    for (std::size_t i = 0; i < n; ++i)
+      workers.emplace_back(new worker_meters(*this, n));
+  }
+
+  void
+  meter_table::print(std::ostream& os) const
+  {
+    for (meter_decl* m : meters) {
+      if (!m)
+        continue;
+      os << "meter " << *m->id << ":\n";
+      for (std::size_t i = 0; i < m->bands.size(); ++i) {
+        band_counters c;
+        for (const auto& w : workers) {
+          c.packets += w->band(m->index, i).packets;
+          c.bytes += w->band(m->index, i).bytes;
+        }
+        const meter_band& b = m->bands[i];
+        os << "  band " << i << " ("
+           << (b.kind == bk_drop ? "drop" : "dscp_remark")
+           << " rate=" << b.rate << (m->unit == mu_pps ? "pps" : "kbps")
+           << " burst=" << b.burst
+           << "): packets=" << c.packets
+           << " bytes=" << c.bytes << '\n';
+      }
+    }
+  }
+
+} // namespace pip
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+#include <pip/decl.hpp>
+#include <pip/stats.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+namespace pip
+{
+  class meter_table;
+
+  /// Token buckets are kept in units of 10^-9 packets (pps meters) or
+  /// 10^-6 bits (kbps meters). In these units, a band of rate r earns
+  /// exactly r tokens per nanosecond, and a burst of b packets or kilobits
+  /// holds b * 10^9 tokens.
+  constexpr std::uint64_t tokens_per_burst_unit = 1000000000;
+
+  /// The credit of a meter band that is shared by all workers. The shared
+  /// bucket is refilled from the arrival times of packets and drained in
+  /// grants by the workers. Each bucket is on its own cache line.
+  struct alignas(cache_line_size) shared_bucket
+  {
+    /// The available tokens.
+    std::atomic<std::uint64_t> pool;
+
+    /// The arrival time (in ns) up to which the pool has been refilled;
+    /// 0 before the first packet.
+    std::atomic<std::uint64_t> stamp;
+  };
+
+  /// The portion of a band's credit held by a single worker.
+  struct local_bucket
+  {
+    /// The tokens granted to the worker and not yet spent.
+    std::uint64_t tokens;
+
+    /// The arrival time of the last rebalance.
+    std::uint64_t last;
+  };
+
+  /// Counts for a meter band.
+  struct band_counters
+  {
+    /// The number of packets to which the band was applied.
+    std::uint64_t packets = 0;
+    std::uint64_t bytes = 0;
+  };
+
+  /// The metering state of a single worker. Packets are charged against
+  /// the worker's local buckets, so the common case touches no shared
+  /// memory. A worker rebalances a band when its rebalance interval has
+  /// passed or when its local bucket cannot pay for a packet, but not more
+  /// often than `min_retry`. A rebalance returns the unspent local tokens
+  /// to the shared bucket and takes a new grant.
+  class worker_meters
+  {
+  public:
+    /// The arrival time between rebalances, in nanoseconds.
+    static constexpr std::uint64_t interval = 1000000;
+
+    /// The minimum time between rebalances caused by a shortage.
+    static constexpr std::uint64_t min_retry = 10000;
+
+    worker_meters(meter_table& t, std::size_t workers);
+
+    /// Applies a packet of `bytes` bytes arriving at `now` (in ns) to
+    /// meter `n`. Returns the band applied to the packet, or nullptr if
+    /// the packet conforms to every band.
+    const meter_band* apply(std::uint32_t n, std::uint64_t now, std::size_t bytes);
+
+    /// Returns the counts of band `b` of meter `n`.
+    const band_counters& band(std::uint32_t n, std::size_t b) const;
+
+  private:
+    void rebalance(std::size_t b, std::uint64_t now);
+
+    meter_table& table;
+
+    /// The size of a grant taken from a shared bucket, by band.
+    std::vector<std::uint64_t> grants;
+
+    std::unique_ptr<unsigned char[]> storage;
+    local_bucket* buckets;
+    band_counters* counters;
+  };
+
+  /// The meters of a program. Every band of every meter has a shared
+  /// bucket; each worker holds a share of the credit in local buckets.
+  ///
+  /// A grant is the burst divided by the number of workers. Since the
+  /// other workers may hold their grants, the credit available to a
+  /// burst can exceed the configured burst by up to one grant per
+  /// additional worker.
+  class meter_table
+  {
+    friend class worker_meters;
+  public:
+    meter_table(program_decl* prog, std::size_t workers = 1);
+
+    /// Returns the metering state of the nth worker.
+    worker_meters& worker(std::size_t n) { return *workers[n]; }
+
+    /// Returns the number of meters.
+    std::size_t size() const { return meters.size(); }
+
+    /// Writes the per-band counters of each meter to `os`.
+    void print(std::ostream& os) const;
+
+  private:
+    /// The meters of the program, by index.
+    std::vector<meter_decl*> meters;
+
+    /// The index of the first band of each meter. Bands are numbered
+    /// consecutively across meters.
+    std::vector<std::size_t> first;
+
+    /// The bands of all meters.
+    std::vector<const meter_band*> bands;
+
+    /// The shared bucket of each band.
+    std::unique_ptr<unsigned char[]> storage;
+    shared_bucket* shared;
+
+    std::vector<std::unique_ptr<worker_meters>> workers;
+  };
+
+  /// Returns the cost, in tokens, of a packet of `bytes` bytes.
+  inline std::uint64_t
+  meter_cost(meter_unit u, std::size_t bytes)
+  {
+    if (u == mu_pps)
+      return tokens_per_burst_unit;
+    return std::uint64_t(bytes) * 8 * 1000000;
+  }
+
+} // namespace pip
@@ -0,0 +1,250 @@
+#include "output.hpp"
+#include "expr.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace pip
+{
+namespace cap
+{
+  namespace
+  {
+    /// The file header of a classic pcap file.
+    struct file_header
+    {
+      std::uint32_t magic;
+      std::uint16_t version_major;
+      std::uint16_t version_minor;
+      std::int32_t thiszone;
+      std::uint32_t sigfigs;
+      std::uint32_t snaplen;
+      std::uint32_t linktype;
+    };
+
+    /// The header of each record of a classic pcap file.
+    struct record_header
+    {
+      std::uint32_t ts_sec;
+      std::uint32_t ts_nsec;
+      std::uint32_t caplen;
+      std::uint32_t len;
+    };
+
+    [[noreturn]] void
+    io_error(const char* what, const std::string& path)
+    {
+      std::stringstream ss;
+      ss << what << " '" << path << "': " << std::strerror(errno);
+      throw std::runtime_error(ss.str());
+    }
+  } // namespace
+
+  writer::writer(const std::string& path, bool direct, std::size_t buffer)
+    : path(path), fd(-1), direct(false), buf(nullptr),
+      cap((buffer + block_size - 1) / block_size * block_size)
+  {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (direct) {
+      fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+      this->direct = fd >= 0;
+    }
+#endif
+    if (fd < 0)
+      fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0)
+      io_error("cannot open", path);
+
+    void* p;
+    if (::posix_memalign(&p, block_size, cap) != 0) {
+      ::close(fd);
+      throw std::bad_alloc();
+    }
+    buf = static_cast<unsigned char*>(p);
+
+    // The nanosecond variant of the pcap format.
+    file_header h { 0xa1b23c4d, 2, 4, 0, 0, 262144, DLT_EN10MB };
+    append(&h, sizeof h);
+  }
+
+  writer::~writer()
+  {
+    try {
+      close();
+    }
+    catch (...) {
+      // Errors are lost when the writer is destroyed without a flush.
+    }
+    std::free(buf);
+  }
+
+  void
+  writer::write(std::uint64_t ts, const unsigned char* frame,
+                std::uint32_t caplen, std::uint32_t len)
+  {
+    record_header h {
+      std::uint32_t(ts / 1000000000), std::uint32_t(ts % 1000000000), caplen, len
+    };
+    append(&h, sizeof h);
+    append(frame, caplen);
+    ++records;
+  }
+
+  void
+  writer::write(std::uint64_t ts, const frame_view& frame, std::uint32_t len)
+  {
+    record_header h {
+      std::uint32_t(ts / 1000000000), std::uint32_t(ts % 1000000000), frame.size, len
+    };
+    append(&h, sizeof h);
+    std::uint32_t pos = 0;
+    for (std::size_t i = 0; i < frame.npatches; ++i) {
+      const frame_patch& p = frame.patches[i];
+      append(frame.base + pos, p.offset - pos);
+      append(p.data, p.length);
+      pos = p.offset + p.length;
+    }
+    append(frame.base + pos, frame.size - pos);
+    ++records;
+  }
+
+  void
+  writer::append(const void* p, std::size_t n)
+  {
+    const unsigned char* src = static_cast<const unsigned char*>(p);
+    while (n) {
+      std::size_t k = std::min(n, cap - len);
+      std::memcpy(buf + len, src, k);
+      len += k;
+      src += k;
+      n -= k;
+      if (len == cap)
+        flush();
+    }
+  }
+
+  void
+  writer::flush()
+  {
+    // Direct writes must be whole blocks; keep the tail for later.
+    std::size_t n = direct ? len / block_size * block_size : len;
+    if (!n)
+      return;
+    write_out(n);
+    std::memmove(buf, buf + n, len - n);
+    len -= n;
+  }
+
+  void
+  writer::write_out(std::size_t n)
+  {
+    std::size_t done = 0;
+    while (done < n) {
+      ssize_t k = ::write(fd, buf + done, n - done);
+      if (k < 0) {
+        if (errno == EINTR)
+          continue;
+        io_error("cannot write", path);
+      }
+      done += k;
+    }
+  }
+
+  void
+  writer::close()
+  {
+    if (fd < 0)
+      return;
+    flush();
+#ifdef O_DIRECT
+    // The tail is shorter than a block; write it through the page cache.
+    if (direct && len) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+      direct = false;
+      flush();
+    }
+#endif
+    ::close(fd);
+    fd = -1;
+  }
+
+} // namespace cap
+
+
+  output_stage::output_stage(const std::string& prefix, bool direct)
+    : prefix(prefix), direct(direct)
+  { }
+
+  void
+  output_stage::emit(const cap::packet& pkt, replica_set& replicas)
+  {
+    if (replicas.empty()) {
+      ++unsent;
+      return;
+    }
+    for (std::size_t i = 0; i < replicas.size(); ++i)
+      get(replicas.port(i)).write(pkt.timestamp(), replicas.frame(i), pkt.total_size());
+    written += replicas.size();
+  }
+
+  void
+  output_stage::flush()
+  {
+    for (auto& f : files)
+      f.second->flush();
+  }
+
+  cap::writer&
+  output_stage::get(std::int32_t port)
+  {
+    auto iter = files.find(port);
+    if (iter != files.end())
+      return *iter->second;
+
+    std::stringstream ss;
+    ss << prefix << '-';
+    if (port >= 0)
+      ss << port;
+    else
+      ss << get_phrase_name(static_cast<reserved_ports>(port));
+    ss << ".pcap";
+
+    std::unique_ptr<cap::writer> w(new cap::writer(ss.str(), direct));
+    cap::writer& ref = *w;
+    files.emplace(port, std::move(w));
+    return ref;
+  }
+
+  live_output::live_output(const std::vector<std::unique_ptr<cap::device>>& devs)
+    : devs(devs)
+  { }
+
+  void
+  live_output::emit(replica_set& replicas)
+  {
+    for (std::size_t i = 0; i < replicas.size(); ++i) {
+      std::int32_t port = replicas.port(i);
+      if (port < 1 || std::size_t(port) > devs.size()) {
+        ++misses;
+        continue;
+      }
+      devs[port - 1]->send(replicas.frame(i));
+      ++sent;
+    }
+  }
+
+  void
+  live_output::flush()
+  {
+    for (const auto& d : devs)
+      d->flush();
+  }
+
+} // namespace pip
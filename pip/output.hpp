@@ -0,0 +1,142 @@
+#pragma once
+
+#include <pip/pcap.hpp>
+#include <pip/device.hpp>
+#include <pip/replica.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pip
+{
+namespace cap
+{
+  /// Writes a classic pcap file with nanosecond timestamps. Records are
+  /// appended to a large in-memory buffer that is written to the file in
+  /// whole blocks, so the cost of the write system call is amortized over
+  /// many packets.
+  ///
+  /// When `direct` is true, the file is opened with O_DIRECT and written
+  /// in block-aligned chunks, bypassing the page cache. If the file system
+  /// does not support O_DIRECT, the file is written normally.
+  class writer
+  {
+  public:
+    /// The default size of the write buffer.
+    static constexpr std::size_t default_buffer = 4 << 20;
+
+    /// The alignment and granularity of direct writes.
+    static constexpr std::size_t block_size = 4096;
+
+    writer(const std::string& path, bool direct = false,
+           std::size_t buffer = default_buffer);
+    ~writer();
+
+    writer(const writer&) = delete;
+    writer& operator=(const writer&) = delete;
+
+    /// Appends a record for a frame of `caplen` captured bytes from a
+    /// packet of `len` bytes.
+    void write(std::uint64_t ts, const unsigned char* frame,
+               std::uint32_t caplen, std::uint32_t len);
+
+    /// Appends a record for a replica of a packet of `len` bytes. The
+    /// frame is assembled from its base and patches as it is copied.
+    void write(std::uint64_t ts, const frame_view& frame, std::uint32_t len);
+
+    /// Writes all whole blocks in the buffer to the file.
+    void flush();
+
+    /// Returns the number of records written.
+    std::uint64_t size() const { return records; }
+
+  private:
+    void append(const void* p, std::size_t n);
+    void write_out(std::size_t n);
+    void close();
+
+    std::string path;
+
+    /// The file descriptor.
+    int fd;
+
+    /// True if the file was opened with O_DIRECT.
+    bool direct;
+
+    /// The block-aligned write buffer.
+    unsigned char* buf;
+    std::size_t cap;
+    std::size_t len = 0;
+
+    std::uint64_t records = 0;
+  };
+
+} // namespace cap
+
+
+  /// Writes the frames leaving the pipeline to one capture file per egress
+  /// port. Files are created on the first packet output to a port and
+  /// named `<prefix>-<port>.pcap`; reserved ports use their name (e.g.,
+  /// `<prefix>-controller.pcap`). Dropped packets are not written.
+  class output_stage
+  {
+  public:
+    output_stage(const std::string& prefix, bool direct = false);
+
+    /// Writes each replica of `pkt` to the file for its port.
+    void emit(const cap::packet& pkt, replica_set& replicas);
+
+    /// Writes all buffered records.
+    void flush();
+
+    /// Returns the number of frames written.
+    std::uint64_t size() const { return written; }
+
+    /// Returns the number of packets that were not output to any port.
+    std::uint64_t dropped() const { return unsent; }
+
+  private:
+    cap::writer& get(std::int32_t port);
+
+    std::string prefix;
+    bool direct;
+
+    /// The files by egress port.
+    std::map<std::int32_t, std::unique_ptr<cap::writer>> files;
+
+    std::uint64_t written = 0;
+    std::uint64_t unsent = 0;
+  };
+
+  /// Sends the frames leaving the pipeline on live devices: port n is
+  /// the n-th device, counting from 1. Frames output to any other port,
+  /// including the reserved ports, are not sent. Frames are queued on the
+  /// transmit ring of their device until the next flush.
+  class live_output
+  {
+  public:
+    live_output(const std::vector<std::unique_ptr<cap::device>>& devs);
+
+    /// Queues each replica on the device for its port.
+    void emit(replica_set& replicas);
+
+    /// Transmits the queued frames of every device.
+    void flush();
+
+    /// Returns the number of frames queued.
+    std::uint64_t size() const { return sent; }
+
+    /// Returns the number of frames output to a port without a device.
+    std::uint64_t unrouted() const { return misses; }
+
+  private:
+    const std::vector<std::unique_ptr<cap::device>>& devs;
+
+    std::uint64_t sent = 0;
+    std::uint64_t misses = 0;
+  };
+
+} // namespace pip
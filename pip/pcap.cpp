@@ -1 +1,84 @@
 #include "pcap.hpp"
+#include "pcapng.hpp"
+#include "uring.hpp"
+
+#include <cstdio>
+
+namespace pip
+{
+namespace cap
+{
+  namespace
+  {
+    /// Returns true if the file at `path` starts with a pcapng section
+    /// header. Unreadable files are left to the reader to report.
+    bool
+    is_pcapng(const char* path)
+    {
+      std::FILE* f = std::fopen(path, "rb");
+      if (!f)
+        return false;
+      std::uint32_t magic = 0;
+      bool ng = std::fread(&magic, sizeof magic, 1, f) == 1 && magic == pcapng_magic;
+      std::fclose(f);
+      return ng;
+    }
+  } // namespace
+
+  // Opens the capture with nanosecond timestamps, so that the tv_usec
+  // field of each record holds nanoseconds.
+  pcap_t*
+  file::open(const char* path)
+  {
+    return pcap_open_offline_with_tstamp_precision(
+      path, PCAP_TSTAMP_PRECISION_NANO, error);
+  }
+
+  file::file(const char* path)
+    : file(path, false)
+  { }
+
+  file::file(const char* path, bool read_ahead)
+    : handle(nullptr)
+  {
+    if (is_pcapng(path))
+      ng.reset(new pcapng_reader(path));
+    else if (read_ahead)
+      ring.reset(new ring_reader(path));
+    else if (!(handle = open(path)))
+      throw std::runtime_error(error);
+  }
+
+  file::~file()
+  {
+    if (handle)
+      pcap_close(handle);
+  }
+
+  file&
+  file::get(packet& p)
+  {
+    if (ng) {
+      status = ng->next(p.hdr, p.buf) ? 1 : PCAP_ERROR_BREAK;
+      p.iface = ng->interface_id();
+      p.link = ng->linktype();
+      p.ns = ng->timestamp();
+      return *this;
+    }
+    if (ring) {
+      status = ring->next(p.hdr, p.buf) ? 1 : PCAP_ERROR_BREAK;
+      p.link = ring->linktype();
+    }
+    else {
+      do {
+        status = ::pcap_next_ex(handle, &p.hdr, &p.buf);
+      } while (status == 0);
+      p.link = pcap_datalink(handle);
+    }
+    if (status > 0)
+      p.ns = std::uint64_t(p.hdr->ts.tv_sec) * 1000000000 + p.hdr->ts.tv_usec;
+    return *this;
+  }
+
+} // namespace cap
+} // namespace pip
@@ -1,20 +1,23 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <stdexcept>
 
 #include <pcap/pcap.h>
 
-#include <sys/time.h>
-
 namespace pip
 {
 namespace cap
 {
+  class ring_reader;
+  class pcapng_reader;
+
   /// A packet provides a view into captured data from the device.
   class packet
   {
     friend class file;
+    friend class device;
   public:
     packet()
       : hdr(nullptr), buf(nullptr)
@@ -31,29 +34,46 @@ namespace cap
     // Returns true when the packet is fully captured.
     bool is_complete() const { return size() == total_size(); }
 
-    /// Returns the time stamp of the packet. This is time elapsed since 
-    /// the beginning of the capture (not the absolute time of the capture).
-    ///
-    /// \todo Convert this to a chrono value.
-    timeval timestamp() const { return hdr->ts; }
+    /// Returns the time stamp of the packet in nanoseconds since the
+    /// epoch, at the resolution recorded by the capture.
+    std::uint64_t timestamp() const { return ns; }
 
     // Returns the underlying packet data.
     const unsigned char* data() const { return buf; }
 
+    /// Returns the index of the interface on which the packet was
+    /// captured. This is 0 for formats that do not record interfaces.
+    std::uint32_t interface_id() const { return iface; }
+
+    /// Returns the link type of the packet (a LINKTYPE_ value), which
+    /// determines its lowest-level protocol layer.
+    std::uint32_t linktype() const { return link; }
+
   private:
     pcap_pkthdr* hdr;
     const unsigned char* buf;
+    std::uint32_t iface = 0;
+    std::uint32_t link = 0;
+    std::uint64_t ns = 0;
   };
 
 
   /// Provides access to a captured stream of packets.
   ///
-  /// \todo Provide a facility for returning the link type for the packet.
-  /// This can be used to establish the lowest-level protocol layer.
+  /// Classic pcap files are read through libpcap, or the read-ahead
+  /// reader. Pcapng files are read natively (see pcapng_reader), which
+  /// records the interface of each packet.
   struct file
   {
   public:
     file(const char* path);
+
+    /// Opens the capture at `path`. If `read_ahead` is true, the file is
+    /// read in large chunks ahead of the parser, overlapping I/O with
+    /// evaluation (see ring_reader). Only classic pcap files are read
+    /// ahead; pcapng files are always mapped.
+    file(const char* path, bool read_ahead);
+
     ~file();
 
     /// Returns true if the file is open and not in error.
@@ -68,39 +88,24 @@ namespace cap
     file& get(packet& p);
 
   private:
+    pcap_t* open(const char* path);
+
     /// An error message (256 bytes)
     char error[PCAP_ERRBUF_SIZE];
 
     /// The underlying device
     pcap_t* handle;
+
+    /// The read-ahead reader, used instead of the device if set.
+    std::unique_ptr<ring_reader> ring;
+
+    /// The pcapng reader, used instead of the device if set.
+    std::unique_ptr<pcapng_reader> ng;
     
     /// Result of the last get.
     int status;
   };
 
-  inline
-  file::file(const char* path)
-    : handle(pcap_open_offline(path, error))
-  {
-    if (!handle)
-      throw std::runtime_error(error);
-  }
-
-  inline
-  file::~file()
-  {
-    pcap_close(handle);
-  }
-
-  inline file&
-  file::get(packet& p)
-  {
-    do {
-      status = ::pcap_next_ex(handle, &p.hdr, &p.buf);
-    } while (status == 0);
-    return *this;
-  }
-
 } // namespace cap
 } // namespace pip
 
@@ -0,0 +1,292 @@
+#include "pcapng.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pip
+{
+namespace cap
+{
+  namespace
+  {
+    /// Block types.
+    constexpr std::uint32_t section_header_block = pcapng_magic;
+    constexpr std::uint32_t interface_description_block = 1;
+    constexpr std::uint32_t obsolete_packet_block = 2;
+    constexpr std::uint32_t simple_packet_block = 3;
+    constexpr std::uint32_t enhanced_packet_block = 6;
+
+    /// The byte-order magic of a section header.
+    constexpr std::uint32_t byte_order_magic = 0x1a2b3c4d;
+
+    /// Interface description options.
+    constexpr std::uint16_t opt_endofopt = 0;
+    constexpr std::uint16_t opt_if_tsresol = 9;
+    constexpr std::uint16_t opt_if_tsoffset = 14;
+
+    [[noreturn]] void
+    malformed(const char* what, std::size_t pos)
+    {
+      std::stringstream ss;
+      ss << "malformed pcapng capture: " << what << " at offset " << pos;
+      throw std::runtime_error(ss.str());
+    }
+
+    constexpr std::size_t
+    pad4(std::size_t n)
+    {
+      return (n + 3) & ~std::size_t(3);
+    }
+  } // namespace
+
+  pcapng_reader::pcapng_reader(const char* path)
+  {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      std::stringstream ss;
+      ss << "cannot open '" << path << "': " << std::strerror(errno);
+      throw std::runtime_error(ss.str());
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+      int err = errno;
+      ::close(fd);
+      std::stringstream ss;
+      ss << "cannot stat '" << path << "': " << std::strerror(err);
+      throw std::runtime_error(ss.str());
+    }
+
+    size = st.st_size;
+    if (size) {
+      void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        int err = errno;
+        ::close(fd);
+        std::stringstream ss;
+        ss << "cannot map '" << path << "': " << std::strerror(err);
+        throw std::runtime_error(ss.str());
+      }
+      base = static_cast<const unsigned char*>(p);
+      ::madvise(p, size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+
+    // The file must start with a section header.
+    if (size < 4 || std::memcmp(base, &pcapng_magic, 4) != 0) {
+      if (base)
+        ::munmap(const_cast<unsigned char*>(base), size);
+      std::stringstream ss;
+      ss << "'" << path << "' is not a pcapng capture";
+      throw std::runtime_error(ss.str());
+    }
+  }
+
+  pcapng_reader::~pcapng_reader()
+  {
+    if (base)
+      ::munmap(const_cast<unsigned char*>(base), size);
+  }
+
+  std::uint16_t
+  pcapng_reader::load16(const unsigned char* p) const
+  {
+    std::uint16_t x;
+    std::memcpy(&x, p, sizeof x);
+    return swapped ? __builtin_bswap16(x) : x;
+  }
+
+  std::uint32_t
+  pcapng_reader::load32(const unsigned char* p) const
+  {
+    std::uint32_t x;
+    std::memcpy(&x, p, sizeof x);
+    return swapped ? __builtin_bswap32(x) : x;
+  }
+
+  // The body of a section header is the byte-order magic, the version,
+  // and the section length, followed by options. A new section starts
+  // a new set of interfaces.
+  void
+  pcapng_reader::read_section(const unsigned char* p, std::size_t len)
+  {
+    if (len < 16)
+      malformed("short section header", pos);
+    if (load32(p) != byte_order_magic)
+      malformed("unknown byte order", pos);
+    if (load16(p + 4) != 1)
+      malformed("unsupported version", pos);
+    section_base = interfaces.size();
+  }
+
+  // The body of an interface description is the link type, a reserved
+  // field, and the snapshot length, followed by options.
+  void
+  pcapng_reader::read_interface(const unsigned char* p, std::size_t len)
+  {
+    if (len < 8)
+      malformed("short interface description", pos);
+
+    interface i { load16(p), 6, false, 0 };
+    std::size_t off = 8;
+    while (off + 4 <= len) {
+      std::uint16_t code = load16(p + off);
+      std::uint16_t n = load16(p + off + 2);
+      const unsigned char* val = p + off + 4;
+      off += 4;
+      if (code == opt_endofopt)
+        break;
+      if (off + n > len)
+        malformed("option overruns block", pos);
+
+      if (code == opt_if_tsresol && n >= 1) {
+        i.binary = val[0] & 0x80;
+        i.exp = val[0] & 0x7f;
+        if (!i.binary && i.exp > 19)
+          malformed("unsupported timestamp resolution", pos);
+      }
+      else if (code == opt_if_tsoffset && n >= 8) {
+        std::uint64_t x;
+        std::memcpy(&x, val, sizeof x);
+        i.offset = swapped ? __builtin_bswap64(x) : x;
+      }
+      off += pad4(n);
+    }
+    interfaces.push_back(i);
+  }
+
+  // Returns the file-wide index of interface `local` of the current
+  // section.
+  std::uint32_t
+  pcapng_reader::find_interface(std::uint32_t local) const
+  {
+    std::uint32_t id = section_base + local;
+    if (local >= interfaces.size() - section_base)
+      malformed("packet on undescribed interface", pos);
+    return id;
+  }
+
+  std::uint64_t
+  pcapng_reader::convert(const interface& i, std::uint64_t ts) const
+  {
+    constexpr std::uint64_t giga = 1000000000;
+    std::uint64_t r;
+    if (i.binary) {
+      unsigned __int128 x = ts;
+      r = (x * giga) >> i.exp;
+    }
+    else if (i.exp <= 9) {
+      static constexpr std::uint64_t scale[] = {
+        1000000000, 100000000, 10000000, 1000000, 100000,
+        10000, 1000, 100, 10, 1,
+      };
+      r = ts * scale[i.exp];
+    }
+    else {
+      std::uint64_t div = 1;
+      for (unsigned n = 9; n < i.exp; ++n)
+        div *= 10;
+      r = ts / div;
+    }
+    return r + i.offset * std::int64_t(giga);
+  }
+
+  bool
+  pcapng_reader::next(pcap_pkthdr*& h, const unsigned char*& data)
+  {
+    while (pos < size) {
+      if (size - pos < 12)
+        malformed("truncated block", pos);
+
+      const unsigned char* b = base + pos;
+      std::uint32_t type;
+      std::memcpy(&type, b, sizeof type);
+
+      // The byte order of a section is given by its header, whose type
+      // reads the same in either order.
+      if (type == section_header_block) {
+        std::uint32_t magic;
+        std::memcpy(&magic, b + 8, sizeof magic);
+        swapped = magic != byte_order_magic;
+      }
+      else {
+        type = load32(b);
+      }
+
+      std::uint32_t total = load32(b + 4);
+      if (total < 12 || total % 4 != 0 || total > size - pos)
+        malformed("bad block length", pos);
+
+      const unsigned char* body = b + 8;
+      std::size_t len = total - 12;
+
+      switch (type) {
+      case section_header_block:
+        read_section(body, len);
+        break;
+
+      case interface_description_block:
+        read_interface(body, len);
+        break;
+
+      case enhanced_packet_block:
+      case obsolete_packet_block: {
+        // The obsolete packet block has a 16-bit interface ID followed
+        // by a drop count; otherwise the layouts are the same.
+        if (len < 20)
+          malformed("short packet block", pos);
+        std::uint32_t local = type == enhanced_packet_block
+          ? load32(body)
+          : load16(body);
+        iface = find_interface(local);
+        std::uint64_t ts =
+          std::uint64_t(load32(body + 4)) << 32 | load32(body + 8);
+        std::uint32_t caplen = load32(body + 12);
+        if (caplen > len - 20)
+          malformed("packet overruns block", pos);
+        hdr.caplen = caplen;
+        hdr.len = load32(body + 16);
+        ns = convert(interfaces[iface], ts);
+        data = body + 20;
+        break;
+      }
+
+      case simple_packet_block: {
+        // A simple packet has no timestamp, so it keeps that of the
+        // previous packet. Its captured length is implied by the block
+        // length.
+        if (len < 4)
+          malformed("short packet block", pos);
+        iface = find_interface(0);
+        hdr.len = load32(body);
+        hdr.caplen = std::min<std::size_t>(hdr.len, len - 4);
+        data = body + 4;
+        break;
+      }
+
+      default:
+        break;
+      }
+
+      pos += total;
+      if (type == enhanced_packet_block || type == obsolete_packet_block ||
+          type == simple_packet_block) {
+        hdr.ts.tv_sec = ns / 1000000000;
+        hdr.ts.tv_usec = ns % 1000000000;
+        h = &hdr;
+        return true;
+      }
+    }
+    return false;
+  }
+
+} // namespace cap
+} // namespace pip
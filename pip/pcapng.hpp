@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <pcap/pcap.h>
+
+namespace pip
+{
+namespace cap
+{
+  /// The block type of a pcapng section header, which is also the magic
+  /// number of a pcapng file.
+  constexpr std::uint32_t pcapng_magic = 0x0a0d0d0a;
+
+  /// Reads a pcapng file directly from a memory mapping of it.
+  ///
+  /// As with libpcap's nanosecond precision, the tv_usec field of each
+  /// record holds nanoseconds.
+  ///
+  /// Blocks are parsed in place and packet data is returned as a pointer
+  /// into the mapping, so no packet is copied. The returned record is
+  /// valid for the lifetime of the reader.
+  ///
+  /// A file may hold several sections, each with its own byte order and
+  /// interfaces. Interfaces are numbered across the whole file in the
+  /// order in which they are described, so the interfaces of a later
+  /// section follow those of the earlier ones. Timestamps are converted
+  /// from the resolution and offset of their interface to nanoseconds.
+  ///
+  /// Enhanced, simple, and obsolete packet blocks are read; all other
+  /// blocks are skipped.
+  class pcapng_reader
+  {
+  public:
+    pcapng_reader(const char* path);
+    ~pcapng_reader();
+
+    pcapng_reader(const pcapng_reader&) = delete;
+    pcapng_reader& operator=(const pcapng_reader&) = delete;
+
+    /// Parses the next packet. Returns false at the end of the file.
+    bool next(pcap_pkthdr*& hdr, const unsigned char*& data);
+
+    /// Returns the interface of the last packet.
+    std::uint32_t interface_id() const { return iface; }
+
+    /// Returns the link type of the last packet.
+    std::uint32_t
+    linktype() const
+    {
+      return interfaces.empty() ? 0 : interfaces[iface].link;
+    }
+
+    /// Returns the timestamp of the last packet in nanoseconds.
+    std::uint64_t timestamp() const { return ns; }
+
+  private:
+    /// An interface described in the file.
+    struct interface
+    {
+      std::uint32_t link;
+
+      /// The timestamp resolution: units per second are 10^exp, or 2^exp
+      /// if `binary`.
+      std::uint8_t exp;
+      bool binary;
+
+      /// Seconds added to each timestamp.
+      std::int64_t offset;
+    };
+
+    std::uint16_t load16(const unsigned char* p) const;
+    std::uint32_t load32(const unsigned char* p) const;
+
+    void read_section(const unsigned char* p, std::size_t len);
+    void read_interface(const unsigned char* p, std::size_t len);
+    std::uint32_t find_interface(std::uint32_t local) const;
+    std::uint64_t convert(const interface& i, std::uint64_t ts) const;
+
+    /// The mapping of the file.
+    const unsigned char* base = nullptr;
+    std::size_t size = 0;
+    std::size_t pos = 0;
+
+    /// Properties of the current section.
+    bool swapped = false;
+    std::uint32_t section_base = 0;
+
+    /// The interfaces of every section read so far.
+    std::vector<interface> interfaces;
+
+    /// The last packet.
+    pcap_pkthdr hdr;
+    std::uint32_t iface = 0;
+    std::uint64_t ns = 0;
+  };
+
+} // namespace cap
+} // namespace pip
@@ -4,9 +4,22 @@
 #include <pip/resolver.hpp>
 #include <pip/evaluator.hpp>
 #include <pip/type_checker.hpp>
+#include <pip/table.hpp>
 #include <pip/pcap.hpp>
 #include <pip/decode.hpp>
 #include <pip/codegen.hpp>
+#include <pip/flow_cache.hpp>
+#include <pip/stats.hpp>
+#include <pip/profile.hpp>
+#include <pip/output.hpp>
+#include <pip/replay.hpp>
+#include <pip/meter.hpp>
+#include <pip/group.hpp>
+#include <pip/timeout.hpp>
+#include <pip/conntrack.hpp>
+#include <pip/port_model.hpp>
+#include <pip/device.hpp>
+#include <pip/clock.hpp>
 
 #include <sexpr/syntax.hpp>
 #include <sexpr/context.hpp>
@@ -18,13 +31,37 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 #include <cstring>
 #include <cstdint>
 #include <netinet/in.h>
 #include <climits>
 #include <algorithm>
+#include <chrono>
+#include <memory>
+#include <csignal>
 
+/// Set by SIGUSR1 to request a dump of the stage latency histograms.
+static volatile std::sig_atomic_t dump_profile = 0;
+
+static void
+request_profile(int)
+{
+  dump_profile = 1;
+}
+
+/// Set by SIGINT or SIGTERM to stop switching live traffic.
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void
+request_stop(int)
+{
+  stop_requested = 1;
+}
+
+/// The most packets taken from a live interface before the next one.
+static constexpr int live_batch = 64;
 
 int
 main(int argc, char* argv[])
@@ -45,7 +82,8 @@ main(int argc, char* argv[])
   pip::context cxt(diags, inputs, syms);
 
   if (argc < 3) {
-    std::cerr << "usage: pip <pip-program> <pcap-file>\n";
+    std::cerr << "usage: pip <pip-program> <pcap-file>\n"
+              << "       pip <pip-program> --check\n";
     return 1;
   }
 
@@ -77,6 +115,155 @@ main(int argc, char* argv[])
       physical_ports = amount;
     }
 
+    // The number of entries in the flow cache. The cache is disabled when
+    // this is 0.
+    std::size_t cache_entries = 0;
+    auto cache_arg_it = std::find(arguments.begin(), arguments.end(), "-c");
+    if(cache_arg_it == arguments.end())
+      cache_arg_it = std::find(arguments.begin(), arguments.end(), "--flow-cache");
+
+    if(cache_arg_it != arguments.end()) {
+      std::string entries_string = *(cache_arg_it + 1);
+      std::size_t size;
+      int entries = std::stoi(entries_string, &size);
+      if(entries_string.size() != size || entries < 0)
+	throw std::runtime_error("Invalid flow cache size. Usage: -c <entries> or --flow-cache <entries>.");
+      cache_entries = entries;
+    }
+
+    // The number of wildcarded megaflows cached behind the exact-match
+    // cache. Megaflows require the flow cache.
+    std::size_t megaflow_entries = 0;
+    auto megaflow_arg_it = std::find(arguments.begin(), arguments.end(), "-m");
+    if(megaflow_arg_it == arguments.end())
+      megaflow_arg_it = std::find(arguments.begin(), arguments.end(), "--megaflows");
+
+    if(megaflow_arg_it != arguments.end()) {
+      std::string entries_string = *(megaflow_arg_it + 1);
+      std::size_t size;
+      int entries = std::stoi(entries_string, &size);
+      if(entries_string.size() != size || entries < 0)
+	throw std::runtime_error("Invalid megaflow cache size. Usage: -m <entries> or --megaflows <entries>.");
+      if(entries && !cache_entries)
+	throw std::runtime_error("The megaflow cache requires the flow cache (-c <entries>).");
+      megaflow_entries = entries;
+    }
+
+    // Print per-table and per-rule counters after evaluation.
+    bool print_stats =
+      std::find(arguments.begin(), arguments.end(), "-s") != arguments.end() ||
+      std::find(arguments.begin(), arguments.end(), "--stats") != arguments.end();
+
+    // Record per-stage latency histograms. These are printed after
+    // evaluation and whenever the process receives SIGUSR1.
+    bool print_latency =
+      std::find(arguments.begin(), arguments.end(), "-l") != arguments.end() ||
+      std::find(arguments.begin(), arguments.end(), "--latency") != arguments.end();
+
+    // Write the frames leaving the pipeline to one capture file per
+    // egress port, named <prefix>-<port>.pcap. With --direct, the files
+    // are written with O_DIRECT.
+    std::string output_prefix;
+    auto output_arg_it = std::find(arguments.begin(), arguments.end(), "-o");
+    if(output_arg_it == arguments.end())
+      output_arg_it = std::find(arguments.begin(), arguments.end(), "--output");
+
+    if(output_arg_it != arguments.end()) {
+      if(output_arg_it + 1 == arguments.end())
+	throw std::runtime_error("Missing output prefix. Usage: -o <prefix> or --output <prefix>.");
+      output_prefix = *(output_arg_it + 1);
+    }
+    bool direct_output =
+      std::find(arguments.begin(), arguments.end(), "--direct") != arguments.end();
+
+    // Read the capture in large chunks ahead of evaluation.
+    bool read_ahead =
+      std::find(arguments.begin(), arguments.end(), "--read-ahead") != arguments.end();
+
+    // Replay packets at their capture timestamps, scaled by a factor.
+    // "max" (the default) replays as fast as possible.
+    double replay_speed = 0;
+    auto rate_arg_it = std::find(arguments.begin(), arguments.end(), "-r");
+    if(rate_arg_it == arguments.end())
+      rate_arg_it = std::find(arguments.begin(), arguments.end(), "--rate");
+
+    if(rate_arg_it != arguments.end()) {
+      if(rate_arg_it + 1 == arguments.end())
+	throw std::runtime_error("Missing replay rate. Usage: -r <factor|max> or --rate <factor|max>.");
+      std::string rate_string = *(rate_arg_it + 1);
+      if(rate_string != "max") {
+	std::size_t size;
+	replay_speed = std::stod(rate_string, &size);
+	if(rate_string.size() != size || replay_speed <= 0)
+	  throw std::runtime_error("Invalid replay rate. Usage: -r <factor|max> or --rate <factor|max>.");
+      }
+    }
+
+    // Assign the physical port of each packet by a model: random (the
+    // default), round-robin, hash, or interface. The random model is
+    // seeded by --seed, so that replays are reproducible.
+    pip::port_model_kind port_model = pip::pm_random;
+    auto model_arg_it = std::find(arguments.begin(), arguments.end(), "--port-model");
+    if(model_arg_it != arguments.end()) {
+      if(model_arg_it + 1 == arguments.end())
+	throw std::runtime_error("Missing port model. Usage: --port-model <random|round-robin|hash|interface>.");
+      port_model = pip::get_port_model(*(model_arg_it + 1));
+    }
+
+    std::uint64_t port_seed = 0;
+    auto seed_arg_it = std::find(arguments.begin(), arguments.end(), "--seed");
+    if(seed_arg_it != arguments.end()) {
+      if(seed_arg_it + 1 == arguments.end())
+	throw std::runtime_error("Missing seed. Usage: --seed <uint64>.");
+      std::string seed_string = *(seed_arg_it + 1);
+      std::size_t size;
+      port_seed = std::stoull(seed_string, &size);
+      if(seed_string.size() != size)
+	throw std::runtime_error("Invalid seed. Usage: --seed <uint64>.");
+    }
+
+    // With --check, the program is only loaded and checked, and no
+    // packets are read.
+    bool check_only =
+      std::find(arguments.begin(), arguments.end(), "--check") != arguments.end();
+
+    // With --live, the input is a comma-separated list of interfaces
+    // instead of a capture, and packets are switched between them: port
+    // n is the n-th interface, and packets arrive on the port of their
+    // interface unless another port model is given. Several processes
+    // can share the interfaces with --fanout <group>. A fanout group
+    // holds the sockets of a single interface, so the n-th interface
+    // (counting from 0) joins group (group + n) mod 2^16.
+    bool live =
+      std::find(arguments.begin(), arguments.end(), "--live") != arguments.end();
+
+    int fanout = -1;
+    auto fanout_arg_it = std::find(arguments.begin(), arguments.end(), "--fanout");
+    if(fanout_arg_it != arguments.end()) {
+      if(fanout_arg_it + 1 == arguments.end())
+	throw std::runtime_error("Missing fanout group. Usage: --fanout <uint16>.");
+      std::string group_string = *(fanout_arg_it + 1);
+      std::size_t size;
+      fanout = std::stoi(group_string, &size);
+      if(group_string.size() != size || fanout < 0 || fanout > 0xffff)
+	throw std::runtime_error("Invalid fanout group. Usage: --fanout <uint16>.");
+    }
+
+    std::vector<std::string> interfaces;
+    if(live) {
+      std::stringstream names(argv[2]);
+      std::string name;
+      while(std::getline(names, name, ','))
+	if(!name.empty())
+	  interfaces.push_back(name);
+      if(interfaces.empty())
+	throw std::runtime_error("Missing interfaces. Usage: pip <pip-program> <if>[,<if>...] --live.");
+      if(physical_ports == (std::uint32_t)(~0))
+	physical_ports = interfaces.size();
+      if(model_arg_it == arguments.end())
+	port_model = pip::pm_interface;
+    }
+
     // Stage 2: Parse the program as an uninterpreted s-expression.
     sexpr::context sexpr(diags, inputs, syms);
     sexpr::parser parse(sexpr, input);
@@ -99,9 +286,31 @@ main(int argc, char* argv[])
     pip::resolver resolve(cxt);
     resolve(prog);
 
-    // // Stage 5: Type checking. Assign a type to each expression.
-    // pip::type_checker types(cxt, program);
-    // types.check();
+    // Stage 5: Type checking. Prove the widths and bounds of every
+    // access, so that the evaluator need not check them per packet.
+    pip::type_checker types(cxt, program);
+    types.check();
+
+    // Find the writes covered by IPv4 and TCP checksums.
+    pip::mark_checksums(program);
+
+    // Load the rules of each table into a lookup structure specialized
+    // for its key width and match kind.
+    pip::build_tables(program);
+
+    // Flooding replicates to every physical port, so their number must
+    // be known.
+    if(physical_ports == (std::uint32_t)(~0) && pip::floods(program))
+      throw std::runtime_error("Flooding to all ports requires the number of physical ports. Usage: -p <uint32> or --ports <uint32>.");
+
+    if(check_only) {
+      if(diags.error_count()) {
+	print(diags.get_diagnostics(), inputs, error);
+	return 1;
+      }
+      std::cout << "program ok\n";
+      return 0;
+    }
 
     // Stage K: Other static analysis?
 
@@ -111,22 +320,125 @@ main(int argc, char* argv[])
     //
     // TODO: Build a packet stream evaluator that encapsulates this 
     // functionality.
+    std::unique_ptr<pip::flow_cache> cache;
+    if(cache_entries)
+      cache.reset(new pip::flow_cache(program, cache_entries, megaflow_entries));
+
+    pip::stats counters(program);
+    pip::meter_table meters(program);
+    pip::group_table groups(program);
+    pip::conntrack_table conntrack;
+    pip::controller_channel channel;
+    pip::rule_timeouts timeouts(program, counters, channel);
+    pip::port_model ports(port_model, physical_ports, port_seed);
+
+    std::unique_ptr<pip::stage_profile> profile;
+    if(print_latency) {
+      profile.reset(new pip::stage_profile(program));
+      std::signal(SIGUSR1, request_profile);
+    }
+
+    std::unique_ptr<pip::output_stage> output;
+    if(!output_prefix.empty())
+      output.reset(new pip::output_stage(output_prefix, direct_output));
+
+    pip::pacer pace(replay_speed);
+
+    // The live interfaces, if any, and the stage that sends to them.
+    std::vector<std::unique_ptr<pip::cap::device>> devices;
+    for(std::size_t i = 0; i < interfaces.size(); ++i) {
+      pip::cap::device_config config;
+      if(fanout >= 0)
+	config.fanout = (fanout + i) & 0xffff;
+      config.id = i;
+      devices.emplace_back(new pip::cap::device(interfaces[i].c_str(), config));
+    }
+    std::unique_ptr<pip::live_output> live_out;
+    if(live)
+      live_out.reset(new pip::live_output(devices));
+
     int partial = 0;
-    pip::cap::file in(argv[2]);
-    pip::cap::packet pkt;
-    while (in.get(pkt)) {
+    int unsupported = 0;
+    auto process = [&](pip::cap::packet& pkt) {
+      // Expire rules and connections up to the arrival of this packet.
+      std::uint64_t now = pkt.timestamp();
+      if(timeouts.advance(now) && cache)
+	cache->invalidate();
+      conntrack.advance(now);
+      pip::flow_removed removed;
+      while(channel.receive(removed))
+	std::cout << "Flow removed: table " << *removed.table->id
+		  << " rule " << removed.rule->index
+		  << (removed.reason == pip::rr_idle_timeout ? " (idle timeout)" : " (hard timeout)")
+		  << " after " << removed.duration / 1000000 << " ms"
+		  << ", packets=" << removed.packets
+		  << " bytes=" << removed.bytes << '\n';
 
-      for(auto d : program->decls) {
-	if(auto t = dynamic_cast<pip::table_decl*>(d)) {
-	  for(auto r : t->rules)
-	    if(auto i = dynamic_cast<pip::int_expr*>(r->key))
-	      std::cout << "rule key: " << i->val << '\n';
-	}
-      }
-      
-      pip::evaluator eval(cxt, program, pkt, physical_ports);
+      pip::evaluator eval(cxt, program, pkt, physical_ports, cache.get(),
+			  &counters.worker(0), profile.get(), &meters.worker(0),
+			  &groups, &conntrack, &ports);
       eval.run();
+      if(eval.is_truncated())
+	++partial;
+      if(eval.is_unsupported())
+	++unsupported;
+
+      if(output)
+	output->emit(pkt, eval.get_replicas());
+      if(live_out)
+	live_out->emit(eval.get_replicas());
 
+      if(dump_profile) {
+	dump_profile = 0;
+	profile->print(std::cerr);
+      }
+    };
+
+    // Follow the link state of the live interfaces, so that groups only
+    // choose buckets whose watched port is up. Port i + 1 is interface i.
+    auto check_links = [&]() {
+      for(std::size_t i = 0; i < devices.size(); ++i) {
+	bool up = devices[i]->link_up();
+	if(groups.port_live(i + 1) == up)
+	  continue;
+	std::cout << "Port " << i + 1 << " (" << interfaces[i] << ") is "
+		  << (up ? "up" : "down") << '\n';
+	if(groups.set_port_live(i + 1, up) && cache)
+	  cache->invalidate();
+      }
+    };
+
+    pip::cap::packet pkt;
+    if(live) {
+      std::signal(SIGINT, request_stop);
+      std::signal(SIGTERM, request_stop);
+      using link_clock = std::chrono::steady_clock;
+      auto links_checked = link_clock::now();
+      check_links();
+      while(!stop_requested) {
+	if(link_clock::now() - links_checked >= std::chrono::milliseconds(100)) {
+	  links_checked = link_clock::now();
+	  check_links();
+	}
+	// Take a batch from each interface in turn, so that a busy one
+	// does not starve the others, and then transmit the batch.
+	bool idle = true;
+	for(auto& dev : devices)
+	  for(int n = 0; n < live_batch && dev->get(pkt); ++n) {
+	    process(pkt);
+	    idle = false;
+	  }
+	live_out->flush();
+	if(idle)
+	  pip::cap::wait(devices, 100);
+      }
+    }
+    else {
+      pip::cap::file in(argv[2], read_ahead);
+      while (in.get(pkt)) {
+	pace.wait(pkt.timestamp());
+	process(pkt);
+      }
     }
       // TODO: This is where we could turn this into a debugger. Simply
       // allowing the user to invoke the step command would enable them
@@ -134,12 +446,47 @@ main(int argc, char* argv[])
       // eval.run();
 
     std::cout << "partial packets: " << partial << '\n';
+    std::cout << "unsupported packets: " << unsupported << '\n';
+    if(cache)
+      std::cout << "flow cache hits: " << cache->hits()
+		<< ", megaflow hits: " << cache->megaflow_hits()
+		<< ", misses: " << cache->misses() << '\n';
+    if(pace.paced()) {
+      const pip::histogram& late = pace.lateness();
+      std::cout << "replay lateness (ns): p50=" << std::uint64_t(late.percentile(0.5) * pip::ns_per_cycle())
+		<< " p99=" << std::uint64_t(late.percentile(0.99) * pip::ns_per_cycle())
+		<< " max=" << std::uint64_t(late.max() * pip::ns_per_cycle()) << '\n';
+    }
+    if(output) {
+      output->flush();
+      std::cout << "frames written: " << output->size()
+		<< ", not output: " << output->dropped() << '\n';
+    }
+    if(live_out) {
+      std::uint64_t drops = 0;
+      for(auto& dev : devices)
+	drops += dev->drops();
+      std::cout << "frames sent: " << live_out->size()
+		<< ", unrouted: " << live_out->unrouted()
+		<< ", receive drops: " << drops << '\n';
+    }
+    if(print_stats) {
+      counters.print(std::cout);
+      meters.print(std::cout);
+      std::cout << "connections: " << conntrack.size()
+		<< ", refused: " << conntrack.refused() << '\n';
+    }
+    if(profile)
+      profile->print(std::cout);
   }
   catch (cc::diagnosable_error& err) {
     diags.emit(err);
   }
 
   // Emit any errors.
-  if (diags.error_count())
+  if (diags.error_count()) {
     print(diags.get_diagnostics(), inputs, error);  
+    return 1;
+  }
+  return 0;
 }
@@ -0,0 +1,97 @@
+#include "port_model.hpp"
+#include "flow_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace pip
+{
+  port_model_kind
+  get_port_model(const std::string& name)
+  {
+    if (name == "random")
+      return pm_random;
+    if (name == "round-robin")
+      return pm_round_robin;
+    if (name == "hash")
+      return pm_hash;
+    if (name == "interface")
+      return pm_interface;
+
+    std::stringstream ss;
+    ss << "Invalid port model '" << name
+       << "'. Expected random, round-robin, hash, or interface.";
+    throw std::runtime_error(ss.str());
+  }
+
+  // Seeds the generator from a single value (splitmix64), as recommended
+  // for xoshiro.
+  static std::uint64_t
+  split_mix(std::uint64_t& x)
+  {
+    std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  static inline std::uint64_t
+  rotl(std::uint64_t x, int k)
+  {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  port_model::port_model(port_model_kind k, std::uint32_t ports, std::uint64_t seed)
+    : kind(k), ports(ports)
+  {
+    for (std::uint64_t& s : state)
+      s = split_mix(seed);
+  }
+
+  std::uint64_t
+  port_model::next()
+  {
+    // xoshiro256**
+    std::uint64_t result = rotl(state[1] * 5, 7) * 9;
+    std::uint64_t t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+    return result;
+  }
+
+  std::uint32_t
+  port_model::assign(const cap::packet& p)
+  {
+    switch (kind) {
+    case pm_random:
+      return reduce(next());
+
+    case pm_round_robin:
+      last = last % ports + 1;
+      return last;
+
+    case pm_hash: {
+      // The source MAC address and the IPv4 source address. Bytes past
+      // the end of the frame hash as zeros.
+      unsigned char buf[10] = {};
+      std::size_t n = p.size();
+      if (n > 6)
+        std::memcpy(buf, p.data() + 6, std::min<std::size_t>(n, 12) - 6);
+      if (n > 26)
+        std::memcpy(buf + 6, p.data() + 26, std::min<std::size_t>(n, 30) - 26);
+      return reduce(hash_key(buf, sizeof buf));
+    }
+
+    case pm_interface:
+      return p.interface_id() % ports + 1;
+    }
+    return 1;
+  }
+
+} // namespace pip
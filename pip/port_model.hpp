@@ -0,0 +1,62 @@
+#pragma once
+
+#include <pip/pcap.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace pip
+{
+  /// The ways of assigning the physical port on which a packet arrives.
+  enum port_model_kind : int
+  {
+    pm_random,      // Uniformly at random, from a seeded generator.
+    pm_round_robin, // Each port in turn.
+    pm_hash,        // By a hash of the source MAC and IPv4 addresses.
+    pm_interface,   // By the capture interface of the packet.
+  };
+
+  /// Returns the port model named `name`: "random", "round-robin", "hash",
+  /// or "interface". Throws std::runtime_error for any other name.
+  port_model_kind get_port_model(const std::string& name);
+
+  /// Assigns physical ports in [1, ports] to the packets of a capture.
+  ///
+  /// Captures do not record the port on which a switch would receive
+  /// each packet, so it is modeled. Every model is deterministic: the
+  /// random model draws from xoshiro256** with a fixed seed, so a replay
+  /// assigns the same ports each time. Each worker should have its own
+  /// model.
+  class port_model
+  {
+  public:
+    port_model(port_model_kind k, std::uint32_t ports, std::uint64_t seed = 0);
+
+    /// Returns the physical port of packet `p`.
+    std::uint32_t assign(const cap::packet& p);
+
+    /// Returns the number of physical ports.
+    std::uint32_t size() const { return ports; }
+
+  private:
+    /// Returns the next value of the generator.
+    std::uint64_t next();
+
+    /// Maps `h` to a port in [1, ports].
+    std::uint32_t
+    reduce(std::uint64_t h) const
+    {
+      return 1 + ((h >> 32) * ports >> 32);
+    }
+
+    port_model_kind kind;
+    std::uint32_t ports;
+
+    /// The last port assigned by the round-robin model.
+    std::uint32_t last = 0;
+
+    /// The state of the generator.
+    std::uint64_t state[4];
+  };
+
+} // namespace pip
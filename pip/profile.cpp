@@ -0,0 +1,67 @@
+#include "profile.hpp"
+#include "clock.hpp"
+#include "decl.hpp"
+
+#include <iomanip>
+#include <iostream>
+
+namespace pip
+{
+  stage_profile::stage_profile(program_decl* prog)
+  {
+    for (decl* d : prog->decls) {
+      if (get_kind(d) != dk_table)
+        continue;
+      table_decl* t = cast<table_decl>(d);
+      if (tables.size() <= t->index)
+        tables.resize(t->index + 1);
+      tables[t->index] = t;
+    }
+    key.resize(tables.size());
+    match.resize(tables.size());
+  }
+
+  void
+  stage_profile::merge(const stage_profile& p)
+  {
+    parse.merge(p.parse);
+    egress.merge(p.egress);
+    replay.merge(p.replay);
+    for (std::size_t i = 0; i < key.size(); ++i) {
+      key[i].merge(p.key[i]);
+      match[i].merge(p.match[i]);
+    }
+  }
+
+  static void
+  print_stage(std::ostream& os, const std::string& name, const histogram& h)
+  {
+    if (!h.size())
+      return;
+    double scale = ns_per_cycle();
+    os << "  " << std::left << std::setw(24) << name << std::right
+       << std::fixed << std::setprecision(0)
+       << " p50=" << std::setw(8) << h.percentile(0.5) * scale
+       << " p99=" << std::setw(8) << h.percentile(0.99) * scale
+       << " p999=" << std::setw(8) << h.percentile(0.999) * scale
+       << " max=" << std::setw(8) << h.max() * scale
+       << " (" << h.size() << " samples)\n";
+  }
+
+  void
+  stage_profile::print(std::ostream& os) const
+  {
+    os << "stage latency (ns):\n";
+    print_stage(os, "parse", parse);
+    for (table_decl* t : tables) {
+      if (!t)
+        continue;
+      std::string name = *t->id;
+      print_stage(os, name + " key", key[t->index]);
+      print_stage(os, name + " match", match[t->index]);
+    }
+    print_stage(os, "egress", egress);
+    print_stage(os, "replay", replay);
+  }
+
+} // namespace pip
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+#include <pip/histogram.hpp>
+
+#include <iosfwd>
+#include <vector>
+
+namespace pip
+{
+  /// Latency histograms for the stages of the evaluator, recorded in
+  /// cycles of read_cycles(). Each worker owns a profile; profiles are
+  /// merged for reporting.
+  ///
+  /// The stages are:
+  ///   - parse: constructing the evaluator for a packet, including the
+  ///     flow cache lookup.
+  ///   - key: executing a table's key actions, up to its match (per table).
+  ///   - match: the table lookup (per table).
+  ///   - egress: executing the egress action list.
+  ///   - replay: executing a trace from the flow cache.
+  struct stage_profile
+  {
+    stage_profile(program_decl* prog);
+
+    /// Adds the samples of another profile of the same program.
+    void merge(const stage_profile& p);
+
+    /// Writes p50/p99/p999 in nanoseconds for each stage to `os`.
+    void print(std::ostream& os) const;
+
+    histogram parse;
+    histogram egress;
+    histogram replay;
+
+    /// Per-table histograms, by table index.
+    std::vector<histogram> key;
+    std::vector<histogram> match;
+
+    /// The tables of the program, by index.
+    std::vector<table_decl*> tables;
+  };
+
+} // namespace pip
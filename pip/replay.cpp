@@ -0,0 +1,49 @@
+#include "replay.hpp"
+#include "clock.hpp"
+
+#include <ctime>
+
+namespace pip
+{
+  pacer::pacer(double speed)
+    : speed(speed), cycles_per_ns(speed > 0 ? 1 / (ns_per_cycle() * speed) : 0)
+  { }
+
+  void
+  pacer::wait(std::uint64_t ts)
+  {
+    if (!paced())
+      return;
+
+    std::int64_t ns = ts;
+    std::uint64_t now = read_cycles();
+    if (!started) {
+      started = true;
+      first_ns = ns;
+      first_cycles = now;
+      late.record(0);
+      return;
+    }
+
+    // Timestamps that go backwards are released immediately.
+    std::int64_t offset = ns - first_ns;
+    std::uint64_t due = first_cycles + (offset > 0 ? std::uint64_t(offset * cycles_per_ns) : 0);
+    if (now >= due) {
+      late.record(now - due);
+      return;
+    }
+
+    std::uint64_t gap = (due - now) * ns_per_cycle();
+    if (gap > sleep_threshold) {
+      std::uint64_t sleep = gap - sleep_threshold / 2;
+      timespec req { time_t(sleep / 1000000000), long(sleep % 1000000000) };
+      nanosleep(&req, nullptr);
+    }
+
+    do
+      now = read_cycles();
+    while (now < due);
+    late.record(now - due);
+  }
+
+} // namespace pip
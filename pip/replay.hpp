@@ -0,0 +1,52 @@
+#pragma once
+
+#include <pip/histogram.hpp>
+
+#include <cstdint>
+
+namespace pip
+{
+  /// Paces the replay of a capture by its timestamps. Each packet is
+  /// released when the time elapsed since the first packet, scaled by the
+  /// replay speed, has passed.
+  ///
+  /// Waiting is a busy-poll on read_cycles(), so packets are released
+  /// within tens of nanoseconds of their deadline. Gaps longer than
+  /// `sleep_threshold` sleep for most of the gap first so that idle
+  /// periods in a capture do not burn a core.
+  class pacer
+  {
+  public:
+    /// Gaps longer than this (in nanoseconds) sleep before spinning.
+    static constexpr std::uint64_t sleep_threshold = 2000000;
+
+    /// Constructs a pacer that replays at `speed` times the capture rate.
+    /// A speed of 0 replays as fast as possible.
+    explicit pacer(double speed);
+
+    /// Waits until the packet captured at `ts` (in nanoseconds) is due.
+    void wait(std::uint64_t ts);
+
+    /// Returns true if packets are paced.
+    bool paced() const { return speed > 0; }
+
+    /// Returns the distribution of how late packets were released, in
+    /// cycles of read_cycles().
+    const histogram& lateness() const { return late; }
+
+  private:
+    double speed;
+
+    /// Cycles of read_cycles() per nanosecond of capture time, scaled by
+    /// the replay speed.
+    double cycles_per_ns;
+
+    /// The capture time and cycle count of the first packet.
+    bool started = false;
+    std::int64_t first_ns;
+    std::uint64_t first_cycles;
+
+    histogram late;
+  };
+
+} // namespace pip
@@ -0,0 +1,129 @@
+#include "replica.hpp"
+#include "decl.hpp"
+#include "action.hpp"
+#include "expr.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace pip
+{
+  void
+  frame_view::copy(unsigned char* out) const
+  {
+    std::memcpy(out, base, size);
+    for (std::size_t i = 0; i < npatches; ++i)
+      std::memcpy(out + patches[i].offset, patches[i].data, patches[i].length);
+  }
+
+  void
+  replica_set::reset(std::shared_ptr<const unsigned char> b, std::uint32_t n)
+  {
+    base = std::move(b);
+    length = n;
+    replicas.clear();
+    undo.clear();
+    saved.clear();
+  }
+
+  void
+  replica_set::log(std::uint32_t first, std::uint32_t last)
+  {
+    last = std::min(last, length);
+    if (first >= last)
+      return;
+    undo.push_back({first, last - first, saved.size()});
+    saved.insert(saved.end(), base.get() + first, base.get() + last);
+  }
+
+  frame_view
+  replica_set::frame(std::size_t i)
+  {
+    std::size_t from = replicas[i].undo;
+    if (from == undo.size())
+      return {base.get(), length, nullptr, 0};
+
+    // Undo the later entries in reverse order onto a copy of the bytes
+    // they span, so that the oldest saved value of each byte wins.
+    std::uint32_t lo = length;
+    std::uint32_t hi = 0;
+    for (std::size_t k = from; k < undo.size(); ++k) {
+      lo = std::min(lo, undo[k].offset);
+      hi = std::max(hi, undo[k].offset + undo[k].length);
+    }
+    bytes.assign(base.get() + lo, base.get() + hi);
+    covered.assign(hi - lo, false);
+    for (std::size_t k = undo.size(); k-- > from; ) {
+      const undo_entry& e = undo[k];
+      std::memcpy(&bytes[e.offset - lo], &saved[e.data], e.length);
+      std::fill_n(covered.begin() + (e.offset - lo), e.length, true);
+    }
+
+    patches.clear();
+    for (std::uint32_t j = 0; j < hi - lo; ) {
+      if (!covered[j]) {
+        ++j;
+        continue;
+      }
+      std::uint32_t start = j;
+      while (j < hi - lo && covered[j])
+        ++j;
+      patches.push_back({lo + start, j - start, &bytes[start]});
+    }
+    return {base.get(), length, patches.data(), patches.size()};
+  }
+
+  namespace
+  {
+    bool
+    floods(const action* a)
+    {
+      switch (get_kind(a)) {
+      case ak_output: {
+        auto p = static_cast<const port_expr*>(cast<output_action>(a)->port);
+        return p->rp == rp_all;
+      }
+      case ak_write:
+        return floods(cast<write_action>(a)->act);
+      default:
+        return false;
+      }
+    }
+
+    bool
+    floods(const action_seq& as)
+    {
+      for (const action* a : as)
+        if (floods(a))
+          return true;
+      return false;
+    }
+  } // namespace
+
+  bool
+  floods(const program_decl* prog)
+  {
+    for (decl* d : prog->decls) {
+      switch (get_kind(d)) {
+      case dk_table: {
+        table_decl* t = cast<table_decl>(d);
+        if (floods(t->prep))
+          return true;
+        for (rule* r : t->rules)
+          if (floods(r->acts))
+            return true;
+        break;
+      }
+      case dk_group:
+        for (group_bucket& b : cast<group_decl>(d)->buckets)
+          if (floods(b.acts))
+            return true;
+        break;
+      default:
+        break;
+      }
+    }
+    return false;
+  }
+
+} // namespace pip
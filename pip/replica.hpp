@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pip
+{
+  struct program_decl;
+
+  /// A run of bytes in which a replica differs from its base frame.
+  struct frame_patch
+  {
+    std::uint32_t offset;
+    std::uint32_t length;
+    const unsigned char* data;
+  };
+
+  /// The frame of a replica: a base frame with patches applied. Patches
+  /// are sorted by offset and do not overlap.
+  struct frame_view
+  {
+    const unsigned char* base;
+    std::uint32_t size;
+    const frame_patch* patches;
+    std::size_t npatches;
+
+    /// Copies the frame into `out`, which must hold `size` bytes.
+    void copy(unsigned char* out) const;
+  };
+
+  /// The copies of a packet output by the pipeline.
+  ///
+  /// Every replica shares the frame buffer of the evaluator, which holds
+  /// the frame as it is at the end of the pipeline. When the frame is
+  /// modified after an output, the bytes about to be overwritten are saved
+  /// in an undo log. A replica's frame is the final frame with the entries
+  /// logged after its output undone, so a replica costs only the header
+  /// bytes modified after it, and copies of an unmodified frame (flooding,
+  /// mirroring) cost nothing.
+  class replica_set
+  {
+  public:
+    /// Starts replicating the `n`-byte frame in `base`. Any previous
+    /// replicas are discarded.
+    void reset(std::shared_ptr<const unsigned char> base, std::uint32_t n);
+
+    /// Adds a replica of the frame, as it is now, for `port`.
+    void add(std::int32_t port) { replicas.push_back({port, undo.size()}); }
+
+    /// Saves bytes [first, last) of the frame before they are overwritten.
+    /// This does nothing until there is a replica.
+    void
+    save(std::uint32_t first, std::uint32_t last)
+    {
+      if (!replicas.empty())
+        log(first, last);
+    }
+
+    /// Returns the number of replicas.
+    std::size_t size() const { return replicas.size(); }
+
+    /// Returns true if the packet was not output.
+    bool empty() const { return replicas.empty(); }
+
+    /// Returns the output port of replica `i`.
+    std::int32_t port(std::size_t i) const { return replicas[i].port; }
+
+    /// Returns the frame of replica `i`. The view is valid until the next
+    /// call to frame or reset.
+    frame_view frame(std::size_t i);
+
+  private:
+    void log(std::uint32_t first, std::uint32_t last);
+
+    struct replica
+    {
+      std::int32_t port;
+
+      /// The first undo entry logged after the replica was made.
+      std::size_t undo;
+    };
+
+    struct undo_entry
+    {
+      std::uint32_t offset;
+      std::uint32_t length;
+
+      /// The position of the saved bytes in `saved`.
+      std::size_t data;
+    };
+
+    /// The frame shared by the replicas.
+    std::shared_ptr<const unsigned char> base;
+    std::uint32_t length = 0;
+
+    std::vector<replica> replicas;
+    std::vector<undo_entry> undo;
+    std::vector<unsigned char> saved;
+
+    /// Scratch space for the patches of the last frame view.
+    std::vector<frame_patch> patches;
+    std::vector<unsigned char> bytes;
+    std::vector<bool> covered;
+  };
+
+  /// Returns true if an output action of `prog` floods to all ports,
+  /// which requires a finite number of physical ports.
+  bool floods(const program_decl* prog);
+
+} // namespace pip
@@ -17,6 +17,11 @@ namespace pip
         return resolve_decl(cast<program_decl>(d));
       case dk_table:
         return resolve_decl(cast<table_decl>(d));
+      case dk_meter:
+        // Nothing to do.
+        return;
+      case dk_group:
+        return resolve_decl(cast<group_decl>(d));
       default:
         break;
     }
@@ -48,6 +53,13 @@ namespace pip
     }
   }
 
+  void
+  resolver::resolve_decl(group_decl* g)
+  {
+    for (group_bucket& b : g->buckets)
+      resolve_actions(b.acts);
+  }
+
   void
   resolver::resolve_actions(action_seq& as)
   {
@@ -65,6 +77,10 @@ namespace pip
         return resolve_action(cast<copy_action>(a));
       case ak_set:
         return resolve_action(cast<set_action>(a));
+      case ak_meter:
+        return resolve_action(cast<meter_action>(a));
+      case ak_conntrack:
+        return;
       case ak_write:
         return resolve_action(cast<write_action>(a));
       case ak_clear:
@@ -77,13 +93,15 @@ namespace pip
         return resolve_action(cast<goto_action>(a));
       case ak_output:
         return resolve_action(cast<output_action>(a));
+      case ak_group:
+        return resolve_action(cast<group_action>(a));
     }
   }
 
   void 
   resolver::resolve_action(advance_action* a)
   {
-    throw std::logic_error("advance_action not implemented");
+    resolve_expr(a->amount);
   }
 
   void 
@@ -100,10 +118,23 @@ namespace pip
     resolve_expr(a->v);
   }
 
+  void 
+  resolver::resolve_action(meter_action* a)
+  {
+    resolve_expr(a->meter);
+
+    ref_expr* ref = cast<ref_expr>(a->meter);
+    if (get_kind(ref->ref) != dk_meter) {
+      std::stringstream ss;
+      ss << "'" << *ref->id << "' is not a meter";
+      throw lookup_error(get_location(ref), ss.str());
+    }
+  }
+
   void 
   resolver::resolve_action(write_action* a)
   {
-    throw std::logic_error("write_action not implemented");
+    resolve_action(a->act);
   }
 
   void 
@@ -137,6 +168,19 @@ namespace pip
     resolve_expr(a->port);
   }
 
+  void 
+  resolver::resolve_action(group_action* a)
+  {
+    resolve_expr(a->group);
+
+    ref_expr* ref = cast<ref_expr>(a->group);
+    if (get_kind(ref->ref) != dk_group) {
+      std::stringstream ss;
+      ss << "'" << *ref->id << "' is not a group";
+      throw lookup_error(get_location(ref), ss.str());
+    }
+  }
+
   void
   resolver::resolve_expr(expr* e)
   {
@@ -157,6 +201,8 @@ namespace pip
         return resolve_expr(cast<port_expr>(e));
       case ek_bitfield:
         return resolve_expr(cast<bitfield_expr>(e));
+      case ek_key:
+        return resolve_expr(cast<key_expr>(e));
     }
   }
 
@@ -213,6 +259,12 @@ namespace pip
     // TODO: implement me if I need it
   }
 
+  void
+  resolver::resolve_expr(key_expr* e)
+  {
+    // Nothing to do.
+  }
+
   void
   resolver::resolve_expr(bitfield_expr* e)
   {
@@ -24,18 +24,21 @@ namespace pip
     void resolve_decl(decl* d);
     void resolve_decl(program_decl* p);
     void resolve_decl(table_decl* t);
+    void resolve_decl(group_decl* g);
     
     void resolve_actions(action_seq& as);
     void resolve_action(action* a);
     void resolve_action(advance_action* a);
     void resolve_action(copy_action* a);
     void resolve_action(set_action* a);
+    void resolve_action(meter_action* a);
     void resolve_action(write_action* a);
     void resolve_action(clear_action* a);
     void resolve_action(drop_action* a);
     void resolve_action(match_action* a);
     void resolve_action(goto_action* a);
     void resolve_action(output_action* a);
+    void resolve_action(group_action* a);
 
     void resolve_expr(expr* e);
     void resolve_expr(int_expr* e);
@@ -46,6 +49,7 @@ namespace pip
     void resolve_expr(miss_expr* e);
     void resolve_expr(port_expr* e);
     void resolve_expr(bitfield_expr* e);
+    void resolve_expr(key_expr* e);
 
   private:
     context& cxt;
@@ -0,0 +1,105 @@
+#include "stats.hpp"
+#include "decl.hpp"
+#include "expr.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <new>
+
+namespace pip
+{
+  // Returns n rounded up to a multiple of the cache line size.
+  static std::size_t
+  round_to_line(std::size_t n)
+  {
+    return (n + cache_line_size - 1) / cache_line_size * cache_line_size;
+  }
+
+  worker_stats::worker_stats(std::size_t nrules, std::size_t ntables)
+  {
+    std::size_t rule_bytes = round_to_line(nrules * sizeof(rule_counters));
+    std::size_t table_bytes = round_to_line(ntables * sizeof(table_counters));
+
+    // Over-allocate by one line so that the arrays can be aligned.
+    storage.reset(new unsigned char[rule_bytes + table_bytes + cache_line_size]);
+    auto base = reinterpret_cast<std::uintptr_t>(storage.get());
+    unsigned char* p = storage.get() + (round_to_line(base) - base);
+
+    rules = new (p) rule_counters[nrules];
+    tables = new (p + rule_bytes) table_counters[ntables];
+  }
+
+  stats::stats(program_decl* prog, std::size_t n)
+  {
+    for (decl* d : prog->decls) {
+      if (get_kind(d) != dk_table)
+        continue;
+      table_decl* t = cast<table_decl>(d);
+      if (tables.size() <= t->index)
+        tables.resize(t->index + 1);
+      tables[t->index] = t;
+      for (const pip::rule* r : t->rules) {
+        if (rules.size() <= r->index)
+          rules.resize(r->index + 1);
+        rules[r->index] = r;
+      }
+    }
+
+    for (std::size_t i = 0; i < std::max<std::size_t>(n, 1); ++i)
+      workers.emplace_back(new worker_stats(rules.size(), tables.size()));
+  }
+
+  rule_counters
+  stats::rule(std::uint32_t n) const
+  {
+    rule_counters c;
+    for (const auto& w : workers) {
+      c.packets += w->rule(n).packets;
+      c.bytes += w->rule(n).bytes;
+      c.last_hit = std::max(c.last_hit, w->rule(n).last_hit);
+    }
+    return c;
+  }
+
+  table_counters
+  stats::table(std::uint32_t n) const
+  {
+    table_counters c;
+    for (const auto& w : workers) {
+      c.lookups += w->table(n).lookups;
+      c.matches += w->table(n).matches;
+      c.misses += w->table(n).misses;
+    }
+    return c;
+  }
+
+  void
+  stats::print(std::ostream& os) const
+  {
+    for (table_decl* t : tables) {
+      if (!t)
+        continue;
+      table_counters tc = table(t->index);
+      os << "table " << *t->id
+         << ": lookups=" << tc.lookups
+         << " matches=" << tc.matches
+         << " misses=" << tc.misses << '\n';
+      for (const pip::rule* r : t->rules) {
+        rule_counters rc = rule(r->index);
+        os << "  rule " << r->index << " (";
+        if (get_kind(r->key) == ek_miss)
+          os << "miss";
+        else if (get_kind(r->key) == ek_int)
+          os << cast<int_expr>(r->key)->val;
+        else if (get_kind(r->key) == ek_key)
+          os << cast<key_expr>(r->key)->value;
+        else
+          os << get_phrase_name(r->key);
+        os << "): packets=" << rc.packets
+           << " bytes=" << rc.bytes << '\n';
+      }
+    }
+  }
+
+} // namespace pip
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+namespace pip
+{
+  /// The size of a cache line. Counters owned by different workers never
+  /// share a line.
+  constexpr std::size_t cache_line_size = 64;
+
+  /// Indicates that a lookup did not select any rule.
+  constexpr std::uint32_t no_rule = -1;
+
+  /// Packet and byte counts for a rule.
+  struct rule_counters
+  {
+    std::uint64_t packets = 0;
+    std::uint64_t bytes = 0;
+
+    /// The arrival time (in ns) of the last packet to select the rule, or
+    /// 0 if none has.
+    std::uint64_t last_hit = 0;
+  };
+
+  /// Lookup counts for a table. Every lookup is either a match or a miss;
+  /// a lookup that selects the table-miss rule is a miss.
+  struct table_counters
+  {
+    std::uint64_t lookups = 0;
+    std::uint64_t matches = 0;
+    std::uint64_t misses = 0;
+  };
+
+  /// The counters updated by a single worker. Counters are plain integers
+  /// indexed by rule and table index; only the owning worker writes them.
+  /// Each array starts on its own cache line and is padded to a whole
+  /// number of lines, so workers never contend for a line.
+  class worker_stats
+  {
+  public:
+    worker_stats(std::size_t rules, std::size_t tables);
+
+    /// Records a lookup in `table` of a packet of `bytes` bytes, arriving
+    /// at `now` (in ns), that selected `rule` (possibly no_rule).
+    void lookup(std::uint32_t table, std::uint32_t rule, bool miss,
+                std::size_t bytes, std::uint64_t now)
+    {
+      table_counters& t = tables[table];
+      ++t.lookups;
+      if (miss)
+        ++t.misses;
+      else
+        ++t.matches;
+      if (rule != no_rule) {
+        ++rules[rule].packets;
+        rules[rule].bytes += bytes;
+        rules[rule].last_hit = now;
+      }
+    }
+
+    const rule_counters& rule(std::uint32_t n) const { return rules[n]; }
+    const table_counters& table(std::uint32_t n) const { return tables[n]; }
+
+  private:
+    std::unique_ptr<unsigned char[]> storage;
+    rule_counters* rules;
+    table_counters* tables;
+  };
+
+  /// The statistics of a program, accumulated separately by each worker
+  /// and aggregated on read.
+  class stats
+  {
+  public:
+    stats(program_decl* prog, std::size_t workers = 1);
+
+    /// Returns the counters of the nth worker.
+    worker_stats& worker(std::size_t n) { return *workers[n]; }
+
+    /// Returns the number of workers.
+    std::size_t size() const { return workers.size(); }
+
+    /// Returns the aggregated counters of a rule or table. The last hit of
+    /// a rule is the latest of any worker.
+    rule_counters rule(std::uint32_t n) const;
+    table_counters table(std::uint32_t n) const;
+
+    /// Writes the per-table and per-rule counters to `os`.
+    void print(std::ostream& os) const;
+
+  private:
+    /// The tables of the program, by index.
+    std::vector<table_decl*> tables;
+
+    /// The rules of the program, by index.
+    std::vector<const pip::rule*> rules;
+
+    std::vector<std::unique_ptr<worker_stats>> workers;
+  };
+
+} // namespace pip
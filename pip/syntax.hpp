@@ -40,6 +40,7 @@ namespace pip
   struct port_expr;
   struct miss_expr;
   struct bitfield_expr;
+  struct key_expr;
   using expr_seq = std::vector<expr*>;
 
   // Actions
@@ -48,6 +49,9 @@ namespace pip
   struct advance_action;
   struct copy_action;
   struct set_action;
+  struct meter_action;
+  struct conntrack_action;
+  struct group_action;
   struct write_action;
   struct clear_action;
   struct drop_action;
@@ -62,6 +66,7 @@ namespace pip
   struct program_decl;
   struct table_decl;
   struct meter_decl;
+  struct group_decl;
   using decl_seq = std::vector<decl*>;
 
   // Table rules.
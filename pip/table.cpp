@@ -0,0 +1,471 @@
+#include "table.hpp"
+#include "decl.hpp"
+#include "expr.hpp"
+#include "action.hpp"
+#include "bitfield.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace pip
+{
+  void
+  table_engine::find_miss(const rule_seq& rules)
+  {
+    auto iter = std::find_if(rules.begin(), rules.end(), [](const rule* r) {
+      return get_kind(r->key) == ek_miss;
+    });
+    miss_rule = iter != rules.end() ? *iter : nullptr;
+  }
+
+  std::size_t
+  key_width(const table_decl* t)
+  {
+    std::size_t width = 0;
+    for (const action* a : t->prep) {
+      if (get_kind(a) != ak_copy)
+        continue;
+      const bitfield_expr* dst = as<bitfield_expr>(cast<copy_action>(a)->dst);
+      if (!dst || dst->as != as_key)
+        continue;
+      std::size_t end = cast<int_expr>(dst->pos)->val + cast<int_expr>(dst->len)->val;
+      width = std::max(width, end);
+    }
+    return width;
+  }
+
+  namespace
+  {
+    using uint128 = unsigned __int128;
+
+    // Converts the key register to the key type of an engine. The key
+    // register has no bits set beyond the width of the table, so the
+    // conversion is exact.
+    template<typename Key>
+    struct key_traits
+    {
+      static constexpr std::size_t bits = sizeof(Key) * 8;
+      using hash = std::hash<Key>;
+
+      static Key get(const key_value& k) { return static_cast<Key>(k.words[0]); }
+    };
+
+    template<>
+    struct key_traits<uint128>
+    {
+      static constexpr std::size_t bits = 128;
+
+      struct hash
+      {
+        std::size_t
+        operator()(uint128 k) const
+        {
+          std::uint64_t lo = k;
+          std::uint64_t hi = k >> 64;
+          return std::hash<std::uint64_t>()(lo ^ (hi * 0x9e3779b97f4a7c15ull));
+        }
+      };
+
+      static uint128 get(const key_value& k) { return uint128(k.words[1]) << 64 | k.words[0]; }
+    };
+
+    template<>
+    struct key_traits<key_value>
+    {
+      static constexpr std::size_t bits = max_key_bits;
+      using hash = key_hash;
+
+      static const key_value& get(const key_value& k) { return k; }
+    };
+
+    // Returns true if no bit of `k` is at or above bit `bits`.
+    bool
+    fits(const key_value& k, std::size_t bits)
+    {
+      for (std::size_t i = 0; i < key_words; ++i) {
+        std::uint64_t allowed = i * 64 >= bits ? 0 : low_bits(std::min<std::size_t>(bits - i * 64, 64));
+        if (k.words[i] & ~allowed)
+          return false;
+      }
+      return true;
+    }
+
+    bool
+    has_value_key(const rule* r)
+    {
+      return get_kind(r->key) == ek_int || get_kind(r->key) == ek_key;
+    }
+
+    // Returns the first rule of `rest` whose key is `k`, or nullptr.
+    rule*
+    next_rule(const key_value& k, const rule_seq& rest)
+    {
+      auto next = std::find_if(rest.begin(), rest.end(), [&k](rule* o) {
+        return has_value_key(o) && get_key_value(o->key) == k;
+      });
+      return next != rest.end() ? *next : nullptr;
+    }
+
+    // The engine of a table of kind `Kind` whose keys have type `Key`.
+    template<typename Key, rule_kind Kind>
+    class basic_engine;
+
+    // Exact match: a hash table from each key to its first rule. A rule
+    // whose key is wider than the key register can never match, and is
+    // left out.
+    template<typename Key>
+    class basic_engine<Key, rk_exact> : public table_engine
+    {
+      using traits = key_traits<Key>;
+
+    public:
+      basic_engine(const rule_seq& rules)
+        : table_engine(traits::bits)
+      {
+        for (rule* r : rules)
+          if (has_value_key(r)) {
+            key_value k = get_key_value(r->key);
+            if (fits(k, traits::bits))
+              entries.emplace(traits::get(k), r);
+          }
+        find_miss(rules);
+      }
+
+      rule*
+      lookup(const key_value& k) const override
+      {
+        auto iter = entries.find(traits::get(k));
+        return iter != entries.end() ? iter->second : nullptr;
+      }
+
+      void
+      remove(rule* r, const rule_seq& rest) override
+      {
+        if (r == miss()) {
+          find_miss(rest);
+          return;
+        }
+        if (!has_value_key(r))
+          return;
+
+        // Hand the key to the next rule that matches it, if any.
+        key_value k = get_key_value(r->key);
+        auto entry = entries.find(traits::get(k));
+        if (entry == entries.end() || entry->second != r)
+          return;
+        if (rule* next = next_rule(k, rest))
+          entry->second = next;
+        else
+          entries.erase(entry);
+      }
+
+    private:
+      std::unordered_map<Key, rule*, typename traits::hash> entries;
+    };
+
+    // Range match: the first rule whose range [lo, hi] contains the key.
+    // An integer key is the range of one value. The type checker ensures
+    // that range literals fit the key.
+    template<typename Key>
+    class basic_engine<Key, rk_range> : public table_engine
+    {
+    public:
+      basic_engine(const rule_seq& rules)
+        : table_engine(key_traits<Key>::bits)
+      {
+        for (rule* r : rules) {
+          if (const range_expr* e = as<range_expr>(r->key))
+            entries.push_back({Key(e->lo), Key(e->hi), r});
+          else if (has_value_key(r)) {
+            key_value k = get_key_value(r->key);
+            if (fits(k, key_traits<Key>::bits))
+              entries.push_back({Key(k.words[0]), Key(k.words[0]), r});
+          }
+        }
+        find_miss(rules);
+      }
+
+      rule*
+      lookup(const key_value& k) const override
+      {
+        Key key = key_traits<Key>::get(k);
+        for (const entry& e : entries)
+          if (e.lo <= key && key <= e.hi)
+            return e.r;
+        return nullptr;
+      }
+
+      void
+      remove(rule* r, const rule_seq& rest) override
+      {
+        if (r == miss())
+          find_miss(rest);
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [r](const entry& e) {
+          return e.r == r;
+        }), entries.end());
+      }
+
+    private:
+      struct entry
+      {
+        Key lo;
+        Key hi;
+        rule* r;
+      };
+
+      std::vector<entry> entries;
+    };
+
+    // Wildcard match: the first rule for which `k & ~mask == val` (see
+    // wild_expr). An integer key has no don't-care bits. The type checker
+    // ensures that wildcard literals fit the key.
+    template<typename Key>
+    class basic_engine<Key, rk_wildcard> : public table_engine
+    {
+    public:
+      basic_engine(const rule_seq& rules)
+        : table_engine(key_traits<Key>::bits)
+      {
+        for (rule* r : rules) {
+          if (const wild_expr* e = as<wild_expr>(r->key))
+            entries.push_back({Key(e->val), Key(e->mask), r});
+          else if (has_value_key(r)) {
+            key_value k = get_key_value(r->key);
+            if (fits(k, key_traits<Key>::bits))
+              entries.push_back({Key(k.words[0]), Key(0), r});
+          }
+        }
+        find_miss(rules);
+      }
+
+      rule*
+      lookup(const key_value& k) const override
+      {
+        Key key = key_traits<Key>::get(k);
+        for (const entry& e : entries)
+          if (Key(key & ~e.mask) == e.val)
+            return e.r;
+        return nullptr;
+      }
+
+      void
+      remove(rule* r, const rule_seq& rest) override
+      {
+        if (r == miss())
+          find_miss(rest);
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [r](const entry& e) {
+          return e.r == r;
+        }), entries.end());
+      }
+
+    protected:
+      struct entry
+      {
+        Key val;
+        Key mask;
+        rule* r;
+      };
+
+      std::vector<entry> entries;
+    };
+
+    // Prefix match: a wildcard match in which the rules with the fewest
+    // don't-care bits, the longest prefixes, are tried first.
+    template<typename Key>
+    class basic_engine<Key, rk_prefix> : public basic_engine<Key, rk_wildcard>
+    {
+      using base = basic_engine<Key, rk_wildcard>;
+
+    public:
+      basic_engine(const rule_seq& rules)
+        : base(rules)
+      {
+        std::stable_sort(this->entries.begin(), this->entries.end(),
+                         [](const typename base::entry& a, const typename base::entry& b) {
+          return __builtin_popcountll(a.mask) < __builtin_popcountll(b.mask);
+        });
+      }
+    };
+
+    // Exact match over a small key domain: an array with a slot for every
+    // key of `Bits` bits, holding the key's first rule. A lookup is one
+    // indexed load. At 16 bits, the array has 64K slots.
+    template<std::size_t Bits>
+    class direct_engine : public table_engine
+    {
+    public:
+      direct_engine(const rule_seq& rules)
+        : table_engine(Bits), slots(std::size_t(1) << Bits)
+      {
+        for (rule* r : rules)
+          if (has_value_key(r)) {
+            key_value k = get_key_value(r->key);
+            if (fits(k, Bits) && !slots[k.words[0]])
+              slots[k.words[0]] = r;
+          }
+        find_miss(rules);
+      }
+
+      rule*
+      lookup(const key_value& k) const override
+      {
+        return slots[k.words[0]];
+      }
+
+      void
+      remove(rule* r, const rule_seq& rest) override
+      {
+        if (r == miss()) {
+          find_miss(rest);
+          return;
+        }
+        if (!has_value_key(r))
+          return;
+        key_value k = get_key_value(r->key);
+        if (fits(k, Bits) && slots[k.words[0]] == r)
+          slots[k.words[0]] = next_rule(k, rest);
+      }
+
+    private:
+      std::vector<rule*> slots;
+    };
+
+    // Exact match over a larger, sparse key domain: a two-level array. The
+    // high bits of a key select a page of 2^PageBits slots, and the low
+    // bits a slot within it. Pages are allocated only for the keys of some
+    // rule; the others share an empty page. A lookup is two indexed loads.
+    template<std::size_t Bits, std::size_t PageBits>
+    class paged_engine : public table_engine
+    {
+      static constexpr std::size_t page_size = std::size_t(1) << PageBits;
+      static constexpr std::uint64_t page_mask = page_size - 1;
+
+    public:
+      paged_engine(const rule_seq& rules)
+        : table_engine(Bits), pages(std::size_t(1) << (Bits - PageBits)), slots(page_size)
+      {
+        for (rule* r : rules)
+          if (has_value_key(r)) {
+            key_value k = get_key_value(r->key);
+            if (fits(k, Bits)) {
+              rule*& s = slot(k.words[0]);
+              if (!s)
+                s = r;
+            }
+          }
+        find_miss(rules);
+      }
+
+      rule*
+      lookup(const key_value& k) const override
+      {
+        std::uint64_t key = k.words[0];
+        return slots[pages[key >> PageBits] | (key & page_mask)];
+      }
+
+      void
+      remove(rule* r, const rule_seq& rest) override
+      {
+        if (r == miss()) {
+          find_miss(rest);
+          return;
+        }
+        if (!has_value_key(r))
+          return;
+        key_value k = get_key_value(r->key);
+        if (!fits(k, Bits))
+          return;
+        std::uint64_t key = k.words[0];
+        rule*& s = slots[pages[key >> PageBits] | (key & page_mask)];
+        if (s == r)
+          s = next_rule(k, rest);
+      }
+
+    private:
+      // Returns the slot of `key`, allocating its page if needed.
+      rule*&
+      slot(std::uint64_t key)
+      {
+        std::uint32_t& page = pages[key >> PageBits];
+        if (!page) {
+          page = slots.size();
+          slots.resize(slots.size() + page_size);
+        }
+        return slots[page | (key & page_mask)];
+      }
+
+      // The offset in `slots` of the page of each value of the high bits
+      // of a key. Offset 0 is the shared empty page.
+      std::vector<std::uint32_t> pages;
+
+      // The slots of all pages.
+      std::vector<rule*> slots;
+    };
+
+    // Instantiates the engine of kind `Kind` for keys of `width` bits.
+    template<rule_kind Kind>
+    std::unique_ptr<table_engine>
+    make_narrow_engine(std::size_t width, const rule_seq& rules)
+    {
+      if (width <= 8)
+        return std::unique_ptr<table_engine>(new basic_engine<std::uint8_t, Kind>(rules));
+      if (width <= 16)
+        return std::unique_ptr<table_engine>(new basic_engine<std::uint16_t, Kind>(rules));
+      if (width <= 32)
+        return std::unique_ptr<table_engine>(new basic_engine<std::uint32_t, Kind>(rules));
+      return std::unique_ptr<table_engine>(new basic_engine<std::uint64_t, Kind>(rules));
+    }
+  } // namespace
+
+  std::unique_ptr<table_engine>
+  make_table_engine(table_decl* t)
+  {
+    std::size_t width = key_width(t);
+
+    // The literals of range, wildcard and prefix rules are integers, and
+    // the type checker limits the keys of those tables to 64 bits. Other
+    // tables match exactly.
+    switch (t->rule) {
+    case rk_range:
+      return make_narrow_engine<rk_range>(width, t->rules);
+    case rk_wildcard:
+      return make_narrow_engine<rk_wildcard>(width, t->rules);
+    case rk_prefix:
+      return make_narrow_engine<rk_prefix>(width, t->rules);
+    default:
+      break;
+    }
+
+    // Small key domains, such as an ethertype or a port, index an array
+    // directly instead of hashing.
+    if (width <= 8)
+      return std::unique_ptr<table_engine>(new direct_engine<8>(t->rules));
+    if (width <= 16)
+      return std::unique_ptr<table_engine>(new direct_engine<16>(t->rules));
+    if (width <= 24)
+      return std::unique_ptr<table_engine>(new paged_engine<24, 12>(t->rules));
+    if (width <= 64)
+      return make_narrow_engine<rk_exact>(width, t->rules);
+    if (width <= 128)
+      return std::unique_ptr<table_engine>(new basic_engine<uint128, rk_exact>(t->rules));
+    return std::unique_ptr<table_engine>(new basic_engine<key_value, rk_exact>(t->rules));
+  }
+
+  void
+  build_tables(program_decl* prog)
+  {
+    prog->tables.clear();
+    for (decl* d : prog->decls)
+      if (get_kind(d) == dk_table) {
+        table_decl* t = cast<table_decl>(d);
+        t->engine = make_table_engine(t);
+        if (prog->tables.size() <= t->index)
+          prog->tables.resize(t->index + 1);
+        prog->tables[t->index] = t;
+      }
+    prog->entry = prog->tables.empty() ? nullptr : prog->tables.front();
+  }
+
+} // namespace pip
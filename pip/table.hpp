@@ -0,0 +1,68 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+#include <pip/key.hpp>
+
+#include <cstddef>
+#include <memory>
+
+namespace pip
+{
+  /// The lookup structure of a match table.
+  ///
+  /// An engine is specialized at compile time on the width of the table's
+  /// keys and on its match kind, and make_table_engine instantiates the
+  /// narrowest variant for a table. An exact table whose keys fit in 16
+  /// bits, such as one on the ethertype, indexes an array of rules
+  /// directly, and one of up to 24 bits a two-level array. Wider keys are
+  /// hashed, and only tables with wide keys, such as an IPv6 5-tuple, pay
+  /// for comparing and hashing the full key register.
+  ///
+  /// When several rules match a key, the engine selects the first of them
+  /// in the order of the table.
+  class table_engine
+  {
+  public:
+    virtual ~table_engine() = default;
+
+    /// Returns the rule matching `k`, or nullptr if there is none.
+    virtual rule* lookup(const key_value& k) const = 0;
+
+    /// Removes rule `r`. The rules of the table, not including `r`, are
+    /// `rest`; the engine may hand r's key to one of them.
+    virtual void remove(rule* r, const rule_seq& rest) = 0;
+
+    /// Returns the table-miss rule, or nullptr if there is none.
+    rule* miss() const { return miss_rule; }
+
+    /// Returns the width of the table's keys, in bits, rounded up to the
+    /// width of the variant.
+    std::size_t width() const { return bits; }
+
+  protected:
+    table_engine(std::size_t bits)
+      : bits(bits)
+    { }
+
+    /// Sets the table-miss rule to the first in `rules`, if any.
+    void find_miss(const rule_seq& rules);
+
+  private:
+    rule* miss_rule = nullptr;
+    std::size_t bits;
+  };
+
+  /// Returns the number of bits of the key register used by table `t`:
+  /// the extent of the copies into the key in its key actions. A rule
+  /// whose key is wider can never match, and is left out of the engine.
+  std::size_t key_width(const table_decl* t);
+
+  /// Builds the lookup structure of table `t` from its rules.
+  std::unique_ptr<table_engine> make_table_engine(table_decl* t);
+
+  /// Builds the lookup structure of each table of `prog`, and its table
+  /// array and entry table. This must run after type checking and before
+  /// evaluation.
+  void build_tables(program_decl* prog);
+
+} // namespace pip
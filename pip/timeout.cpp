@@ -0,0 +1,175 @@
+#include "timeout.hpp"
+#include "stats.hpp"
+#include "decl.hpp"
+#include "expr.hpp"
+
+#include <algorithm>
+
+namespace pip
+{
+  constexpr int timer_wheel::levels;
+  constexpr int timer_wheel::slot_bits;
+  constexpr std::size_t timer_wheel::slots;
+  constexpr std::uint64_t rule_timeouts::tick_ns;
+
+  void
+  timer_wheel::schedule(std::uint32_t id, std::uint64_t deadline)
+  {
+    const std::uint64_t range = std::uint64_t(1) << (slot_bits * levels);
+    deadline = std::max(deadline, current + 1);
+    deadline = std::min(deadline, current + range - 1);
+    place({deadline, id});
+    ++count;
+  }
+
+  // Puts a timer in the lowest level that covers its deadline. The
+  // deadline is not before the current tick.
+  void
+  timer_wheel::place(const timer& tm)
+  {
+    std::uint64_t diff = tm.deadline - current;
+    int l = 0;
+    while (l + 1 < levels && diff >= (std::uint64_t(1) << (slot_bits * (l + 1))))
+      ++l;
+    wheel[l][(tm.deadline >> (slot_bits * l)) & (slots - 1)].push_back(tm);
+  }
+
+  // Redistributes the timers in the current slot of a level to the levels
+  // below.
+  void
+  timer_wheel::cascade(int l)
+  {
+    std::vector<timer>& slot = wheel[l][(current >> (slot_bits * l)) & (slots - 1)];
+    std::vector<timer> due;
+    due.swap(slot);
+    for (const timer& tm : due)
+      place(tm);
+  }
+
+  void
+  timer_wheel::advance(std::uint64_t t, const expire_fn& expire)
+  {
+    while (current < t) {
+      // With nothing scheduled, there is nothing to step through.
+      if (!count) {
+        current = t;
+        break;
+      }
+      ++current;
+
+      // Cascade from the highest level that wrapped around, so that timers
+      // coming down from it are cascaded again if need be.
+      int top = 0;
+      while (top + 1 < levels &&
+             (current & ((std::uint64_t(1) << (slot_bits * (top + 1))) - 1)) == 0)
+        ++top;
+      for (int l = top; l > 0; --l)
+        cascade(l);
+
+      std::vector<timer>& slot = wheel[0][current & (slots - 1)];
+      if (slot.empty())
+        continue;
+      std::vector<timer> due;
+      due.swap(slot);
+      count -= due.size();
+      for (const timer& tm : due)
+        expire(tm);
+    }
+  }
+
+  rule_timeouts::rule_timeouts(program_decl* prog, const stats& counters,
+                               controller_channel& channel)
+    : counters(counters), channel(channel)
+  {
+    for (decl* d : prog->decls) {
+      if (get_kind(d) != dk_table)
+        continue;
+      table_decl* t = cast<table_decl>(d);
+      for (pip::rule* r : t->rules) {
+        if (!r->idle_timeout && !r->hard_timeout)
+          continue;
+        if (rules.size() <= r->index) {
+          rules.resize(r->index + 1);
+          tables.resize(r->index + 1);
+        }
+        rules[r->index] = r;
+        tables[r->index] = t;
+      }
+    }
+    removed.resize(rules.size());
+  }
+
+  // Returns the first tick at or after the time `ns`.
+  static std::uint64_t
+  to_tick(std::uint64_t ns)
+  {
+    return (ns + rule_timeouts::tick_ns - 1) / rule_timeouts::tick_ns;
+  }
+
+  bool
+  rule_timeouts::advance(std::uint64_t now)
+  {
+    auto expire = [this](const timer_wheel::timer& tm) { this->expire(tm); };
+
+    if (!started) {
+      started = true;
+      start = now;
+      wheel.advance(now / tick_ns, expire);
+      for (pip::rule* r : rules) {
+        if (!r)
+          continue;
+        if (r->idle_timeout)
+          wheel.schedule(r->index << 1 | idle_timer,
+                         to_tick(start + r->idle_timeout * 1000000000ull));
+        if (r->hard_timeout)
+          wheel.schedule(r->index << 1 | hard_timer,
+                         to_tick(start + r->hard_timeout * 1000000000ull));
+      }
+    }
+
+    last = std::max(last, now);
+    changed = false;
+    wheel.advance(now / tick_ns, expire);
+    return changed;
+  }
+
+  void
+  rule_timeouts::expire(const timer_wheel::timer& tm)
+  {
+    std::uint32_t n = tm.id >> 1;
+    if (removed[n])
+      return;
+    pip::rule* r = rules[n];
+
+    if ((tm.id & 1) == hard_timer) {
+      remove(n, rr_hard_timeout, start + r->hard_timeout * 1000000000ull);
+      return;
+    }
+
+    // Idle timers are scheduled from the last hit known at the time; the
+    // rule may have been hit since.
+    std::uint64_t hit = std::max(counters.rule(n).last_hit, start);
+    std::uint64_t due = hit + r->idle_timeout * 1000000000ull;
+    if (due <= last)
+      remove(n, rr_idle_timeout, due);
+    else
+      wheel.schedule(tm.id, to_tick(due));
+  }
+
+  void
+  rule_timeouts::remove(std::uint32_t n, removed_reason why, std::uint64_t when)
+  {
+    removed[n] = true;
+    changed = true;
+
+    table_decl* t = tables[n];
+    pip::rule* r = rules[n];
+    t->rules.erase(std::find(t->rules.begin(), t->rules.end(), r));
+
+    t->engine->remove(r, t->rules);
+
+    rule_counters c = counters.rule(n);
+    channel.send({t, r, why, when, when - start, c.packets, c.bytes});
+  }
+
+} // namespace pip
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <pip/syntax.hpp>
+#include <pip/channel.hpp>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace pip
+{
+  class stats;
+
+  /// A hierarchical timing wheel. Time is measured in ticks. Each level
+  /// has 256 slots, and a slot of level `l` spans 256^l ticks. A timer is
+  /// placed in the lowest level whose range covers its deadline; when the
+  /// lower levels wrap around, the timers in the next slot of the level
+  /// above are redistributed downward. Scheduling is O(1), and each timer
+  /// moves at most once per level, so expiry is O(1) amortized.
+  ///
+  /// Timers cannot be cancelled. Their owner checks whether they are still
+  /// relevant when they fire.
+  class timer_wheel
+  {
+  public:
+    /// The number of levels and slots per level.
+    static constexpr int levels = 4;
+    static constexpr int slot_bits = 8;
+    static constexpr std::size_t slots = 1 << slot_bits;
+
+    struct timer
+    {
+      /// The tick at which the timer fires.
+      std::uint64_t deadline;
+
+      /// The owner's identifier for the timer.
+      std::uint32_t id;
+    };
+
+    using expire_fn = std::function<void(const timer&)>;
+
+    /// Returns the current tick.
+    std::uint64_t now() const { return current; }
+
+    /// Returns the number of pending timers.
+    std::size_t size() const { return count; }
+
+    /// Schedules a timer. Deadlines that have passed fire on the next
+    /// tick; deadlines beyond the range of the wheel fire at its end.
+    void schedule(std::uint32_t id, std::uint64_t deadline);
+
+    /// Advances the wheel to tick `t`, calling `expire` for each timer
+    /// whose deadline has been reached. `expire` may schedule timers.
+    void advance(std::uint64_t t, const expire_fn& expire);
+
+  private:
+    void place(const timer& tm);
+    void cascade(int level);
+
+    std::array<std::array<std::vector<timer>, slots>, levels> wheel;
+    std::uint64_t current = 0;
+    std::size_t count = 0;
+  };
+
+  /// Expires rules whose idle or hard timeout has elapsed. Time is the
+  /// arrival time of packets, so a capture replays with the timing it was
+  /// recorded with. Timeouts are measured from the first packet.
+  ///
+  /// Nothing is done per packet: workers record the last hit of each rule
+  /// in their own counters (see worker_stats). A rule's idle timer is
+  /// scheduled for its timeout from the last known hit; when it fires, the
+  /// latest hit of any worker is read, and the timer is rescheduled if the
+  /// rule was hit in the meantime.
+  ///
+  /// Expired rules are removed from their tables and reported on the
+  /// controller channel. This modifies the program, so advance() must not
+  /// run concurrently with evaluation.
+  class rule_timeouts
+  {
+  public:
+    /// The length of a tick, in nanoseconds.
+    static constexpr std::uint64_t tick_ns = 100000000;
+
+    rule_timeouts(program_decl* prog, const stats& counters,
+                  controller_channel& channel);
+
+    /// Advances to the time `now` (in ns). Returns true if any rule was
+    /// removed, in which case cached flows are stale and the flow cache
+    /// must be invalidated.
+    bool advance(std::uint64_t now);
+
+  private:
+    /// The timer kinds, in the low bit of the timer identifier.
+    enum timer_kind { idle_timer, hard_timer };
+
+    void expire(const timer_wheel::timer& tm);
+    void remove(std::uint32_t n, removed_reason why, std::uint64_t when);
+
+    const stats& counters;
+    controller_channel& channel;
+    timer_wheel wheel;
+
+    /// The rules with timeouts and their tables, by rule index.
+    std::vector<pip::rule*> rules;
+    std::vector<table_decl*> tables;
+
+    /// True for rules that have been removed, by rule index.
+    std::vector<bool> removed;
+
+    /// The time of the first packet, at which all rules are installed.
+    std::uint64_t start = 0;
+    bool started = false;
+
+    /// The latest time advanced to, in ns.
+    std::uint64_t last = 0;
+
+    /// True if a rule was removed by the current advance.
+    bool changed = false;
+  };
+
+} // namespace pip
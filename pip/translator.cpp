@@ -5,6 +5,7 @@
 #include "expr.hpp"
 #include "action.hpp"
 #include "dumper.hpp"
+#include "type_checker.hpp"
 
 #include <string>
 
@@ -14,14 +15,6 @@
 
 namespace pip
 {
-  class type_error : public cc::diagnosable_error
-  {
-  public:
-    type_error(cc::location loc, const std::string& msg)
-      : cc::diagnosable_error(cc::dk_error, "type", loc, msg)
-    { }
-  };
-
   class syntax_error : public cc::diagnosable_error
   {
   public:
@@ -40,30 +33,32 @@ namespace pip
   translator::trans_program(const sexpr::expr* e)
   {
     if (const sexpr::list_expr* list = as<sexpr::list_expr>(e)) {
-      decl_seq decls;
-      match_list(list, "pip", &decls);
+      match_list(list, "pip");
+      decl_seq decls = trans_decls(list);
       
       return new program_decl(std::move(decls));
     }
     sexpr::throw_unexpected_term(e);
   }
   
-  /// decl-seq ::= (<decl*>)
+  /// decl-seq ::= <decl*>
+  ///
+  /// The declarations are the sublists of `e`.
   decl_seq
   translator::trans_decls(const sexpr::expr* e)
   {
     if (const sexpr::list_expr* list = as<sexpr::list_expr>(e)) {
       decl_seq decls;
-
-      decl* d = trans_decl(list);
-      decls.push_back(d);
-      
+      for(const sexpr::expr* el : list->exprs) {
+	if(const sexpr::list_expr* d = as<sexpr::list_expr>(el))
+	  decls.push_back(trans_decl(d));
+      }
       return decls;
     }
     sexpr::throw_unexpected_term(e);
   }
   
-  /// decl ::= table-decl | meter-decl
+  /// decl ::= table-decl | meter-decl | group-decl
   decl*
   translator::trans_decl(const sexpr::expr* e)
   {
@@ -72,6 +67,10 @@ namespace pip
       match_list(list, &sym);
       if (*sym == "table")
 	return trans_table(list);
+      if (*sym == "meter")
+	return trans_meter(list);
+      if (*sym == "group")
+	return trans_group(list);
       sexpr::throw_unexpected_id(cast<sexpr::id_expr>(list->exprs[0]));
     }
     sexpr::throw_unexpected_term(e);
@@ -98,7 +97,165 @@ namespace pip
 
     match_kind = it->second;
     
-    return new table_decl(id, match_kind, std::move(actions), std::move(rules));
+    auto t = new table_decl(id, match_kind, std::move(actions), std::move(rules));
+    t->index = table_count++;
+    return t;
+  }
+  
+  /// meter-decl ::= (meter id <meter-unit> <band-seq>)
+  ///
+  /// meter-unit ::= pps | kbps
+  decl*
+  translator::trans_meter(const sexpr::list_expr* e)
+  {
+    symbol* id;
+    symbol* unit;
+    band_seq bands;
+    match_list(e, "meter", &id, &unit, &bands);
+
+    auto it = meter_units.find(unit);
+    if(it == meter_units.end()) {
+      std::stringstream ss;
+      ss << "Invalid meter unit: " << *(unit);
+      throw syntax_error(cc::get_location(e), ss.str());
+    }
+
+    if(bands.empty())
+      throw syntax_error(cc::get_location(e), "Meter has no bands.");
+
+    auto m = new meter_decl(id, it->second, std::move(bands));
+    m->index = meter_count++;
+    return m;
+  }
+
+  /// band-seq ::= (bands <band*>)
+  band_seq
+  translator::trans_bands(const sexpr::expr* e)
+  {
+    if (const sexpr::list_expr* list = as<sexpr::list_expr>(e)) {
+      match_list(list, "bands");
+      band_seq bands;
+      for(const sexpr::expr* el : list->exprs) {
+	if(const sexpr::list_expr* b = as<sexpr::list_expr>(el))
+	  bands.push_back(trans_band(b));
+      }
+      return bands;
+    }
+    sexpr::throw_unexpected_term(e);
+  }
+
+  /// band ::= (band drop <rate> <burst>)
+  ///        | (band dscp_remark <rate> <burst> <prec-level>)
+  meter_band
+  translator::trans_band(const sexpr::list_expr* e)
+  {
+    symbol* kind;
+    match_list(e, "band", &kind);
+
+    auto it = band_kinds.find(kind);
+    if(it == band_kinds.end()) {
+      std::stringstream ss;
+      ss << "Invalid meter band: " << *(kind);
+      throw syntax_error(cc::get_location(e), ss.str());
+    }
+
+    int rate;
+    int burst;
+    int prec_level = 0;
+    if(it->second == bk_dscp_remark)
+      match_list(e, "band", &kind, &rate, &burst, &prec_level);
+    else
+      match_list(e, "band", &kind, &rate, &burst);
+
+    if(rate <= 0 || burst <= 0 || prec_level < 0) {
+      std::stringstream ss;
+      ss << "Meter band rate and burst must be positive.";
+      throw syntax_error(cc::get_location(e), ss.str());
+    }
+
+    meter_band b;
+    b.kind = it->second;
+    b.rate = rate;
+    b.burst = burst;
+    b.prec_level = prec_level;
+    return b;
+  }
+  
+  /// group-decl ::= (group id <group-kind> <bucket-seq>)
+  ///
+  /// group-kind ::= all | select | indirect | fast_failover
+  decl*
+  translator::trans_group(const sexpr::list_expr* e)
+  {
+    symbol* id;
+    symbol* kind;
+    bucket_seq buckets;
+    match_list(e, "group", &id, &kind, &buckets);
+
+    auto it = group_kinds.find(kind);
+    if(it == group_kinds.end()) {
+      std::stringstream ss;
+      ss << "Invalid group kind: " << *(kind);
+      throw syntax_error(cc::get_location(e), ss.str());
+    }
+
+    if(it->second == gk_indirect && buckets.size() != 1)
+      throw syntax_error(cc::get_location(e), "An indirect group must have exactly one bucket.");
+    if(buckets.size() > 65535)
+      throw syntax_error(cc::get_location(e), "Too many buckets in group.");
+
+    auto g = new group_decl(id, it->second, std::move(buckets));
+    g->index = group_count++;
+    return g;
+  }
+
+  /// bucket-seq ::= (buckets <bucket*>)
+  bucket_seq
+  translator::trans_buckets(const sexpr::expr* e)
+  {
+    if (const sexpr::list_expr* list = as<sexpr::list_expr>(e)) {
+      match_list(list, "buckets");
+      bucket_seq buckets;
+      for(const sexpr::expr* el : list->exprs) {
+	if(const sexpr::list_expr* b = as<sexpr::list_expr>(el))
+	  buckets.push_back(trans_bucket(b));
+      }
+      return buckets;
+    }
+    sexpr::throw_unexpected_term(e);
+  }
+
+  /// bucket ::= (bucket <action-seq>)
+  ///          | (bucket weight <int> <action-seq>)
+  ///          | (bucket watch <port> <action-seq>)
+  group_bucket
+  translator::trans_bucket(const sexpr::list_expr* e)
+  {
+    group_bucket b;
+    if(e->exprs.size() == 2) {
+      match_list(e, "bucket", &b.acts);
+      return b;
+    }
+
+    symbol* attr;
+    int value;
+    match_list(e, "bucket", &attr, &value, &b.acts);
+    if(*attr == "weight") {
+      if(value <= 0)
+	throw syntax_error(cc::get_location(e), "Bucket weight must be positive.");
+      b.weight = value;
+    }
+    else if(*attr == "watch") {
+      if(value < 0)
+	throw syntax_error(cc::get_location(e), "Watch port must be a non-negative integer.");
+      b.watch_port = value;
+    }
+    else {
+      std::stringstream ss;
+      ss << "Invalid bucket attribute: " << *(attr);
+      throw syntax_error(cc::get_location(e), ss.str());
+    }
+    return b;
   }
   
   /// rule_seq ::= (<rule*>)
@@ -134,22 +291,43 @@ namespace pip
       match_list(list, &key, &actions);
       
       auto r = new rule(match_kind, key, std::move(actions));
+      r->index = rule_count++;
       return r;
     }
     
     sexpr::throw_unexpected_term(e);
   }
   
+  /// rule ::= (rule <key> <action-seq>)
+  ///        | (rule <key> (timeouts <idle> <hard>) <action-seq>)
+  ///
+  /// Timeouts are in seconds; a timeout of 0 never expires.
   rule*
   translator::trans_rule(const sexpr::list_expr* e)
   {
     expr_seq exprs;
     expr* key;
     action_seq actions;
-    
-    match_list(e, "rule", &key, &actions);
+    int idle = 0;
+    int hard = 0;
+
+    if(e->exprs.size() == 4) {
+      match_list(e, "rule", &key);
+      if(const sexpr::list_expr* t = as<sexpr::list_expr>(e->exprs[2]))
+	match_list(t, "timeouts", &idle, &hard);
+      else
+	sexpr::throw_unexpected_term(e->exprs[2]);
+      if(idle < 0 || hard < 0)
+	throw syntax_error(cc::get_location(e), "Rule timeouts must be non-negative.");
+      actions = trans_actions(e->exprs[3]);
+    }
+    else
+      match_list(e, "rule", &key, &actions);
     
     auto r = new rule(match_kind, key, std::move(actions));
+    r->index = rule_count++;
+    r->idle_timeout = idle;
+    r->hard_timeout = hard;
 
     return r;
   }
@@ -227,6 +405,45 @@ namespace pip
       return cxt.make_set_action(f, v);
     }
     
+    if(*action_name == "conntrack") {
+      if(e->exprs.size() == 1)
+	return cxt.make_conntrack_action(false);
+      symbol* option;
+      match_list(e, "conntrack", &option);
+      if(!(*option == "commit")) {
+	std::stringstream ss;
+	ss << "Invalid conntrack option: " << *option;
+	throw syntax_error(cc::get_location(e), ss.str());
+      }
+      return cxt.make_conntrack_action(true);
+    }
+
+    if(*action_name == "meter") {
+      expr* m;
+      match_list(e, "meter", &m);
+
+      if(get_kind(m) != ek_ref) {
+	std::stringstream ss;
+	ss << "Meter action requires a reference to a meter.";
+	throw type_error(cc::get_location(e), ss.str());
+      }
+
+      return cxt.make_meter_action(m);
+    }
+    
+    if(*action_name == "group") {
+      expr* g;
+      match_list(e, "group", &g);
+
+      if(get_kind(g) != ek_ref) {
+	std::stringstream ss;
+	ss << "Group action requires a reference to a group.";
+	throw type_error(cc::get_location(e), ss.str());
+      }
+
+      return cxt.make_group_action(g);
+    }
+    
     if(*action_name == "write") {
       action* a;
       match_list(e, "write", &a);
@@ -299,6 +516,8 @@ namespace pip
 	return trans_named_field_expr(list);
       case es_ref:
 	return trans_ref_expr(list);
+      case es_key:
+	return trans_key_expr(list);
       }
     }
   }
@@ -495,6 +714,46 @@ namespace pip
     
     return cxt.make_int_expr(new int_type(w), value);
   }
+
+  // A key literal has the form (key f1 ... fn), where each field is an
+  // integer literal. The fields are laid out from the most significant,
+  // so that the last field ends at bit 0 of the key.
+  expr*
+  translator::trans_key_expr(const sexpr::list_expr* e)
+  {
+    expr_seq fields;
+    for (std::size_t i = 1; i < e->exprs.size(); ++i)
+      fields.push_back(trans_expr(e->exprs[i]));
+    if (fields.empty())
+      throw syntax_error(cc::get_location(e), "A key literal requires at least one field.");
+
+    std::size_t width = 0;
+    for (expr* f : fields) {
+      if (!as<int_expr>(f)) {
+	std::stringstream ss;
+	ss << "Key field not of int type. Currently of type: " << get_node_name(f->ty);
+	throw type_error(cc::get_location(e), ss.str());
+      }
+      width += static_cast<int_type*>(f->ty)->width;
+    }
+    if (width > max_key_bits) {
+      std::stringstream ss;
+      ss << "Key literal of " << width << " bits exceeds the key register of "
+	 << max_key_bits << " bits.";
+      throw type_error(cc::get_location(e), ss.str());
+    }
+
+    key_value value;
+    std::size_t pos = width;
+    for (expr* f : fields) {
+      int_expr* field = cast<int_expr>(f);
+      std::size_t w = static_cast<int_type*>(f->ty)->width;
+      pos -= w;
+      value.insert(pos, w, field->val);
+    }
+
+    return cxt.make_key_expr(new int_type(width), fields, value);
+  }
   
   // -------------------------------------------------------------------------- //
   // Matching
@@ -511,6 +770,18 @@ namespace pip
     *rules = trans_rules(get(list, n));
   }
   
+  void 
+  translator::match(const sexpr::list_expr* list, int n, band_seq* bands)
+  {
+    *bands = trans_bands(get(list, n));
+  }
+  
+  void 
+  translator::match(const sexpr::list_expr* list, int n, bucket_seq* buckets)
+  {
+    *buckets = trans_buckets(get(list, n));
+  }
+  
   void 
   translator::match(const sexpr::list_expr* list, int n, expr_seq* exprs)
   {
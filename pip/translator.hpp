@@ -28,6 +28,12 @@ namespace pip
     decl_seq trans_decls(const sexpr::expr* e);
     decl* trans_decl(const sexpr::expr* e);
     decl* trans_table(const sexpr::list_expr* e);
+    decl* trans_meter(const sexpr::list_expr* e);
+    band_seq trans_bands(const sexpr::expr* e);
+    meter_band trans_band(const sexpr::list_expr* e);
+    decl* trans_group(const sexpr::list_expr* e);
+    bucket_seq trans_buckets(const sexpr::expr* e);
+    group_bucket trans_bucket(const sexpr::list_expr* e);
     /// The match rule of the table currently being translated.
     rule_kind match_kind;
 
@@ -50,6 +56,7 @@ namespace pip
     expr* trans_reserved_port_expr(const sexpr::list_expr* e);
     expr* trans_bitfield_expr(const sexpr::list_expr* e);
     expr* trans_int_expr(const sexpr::list_expr* e);
+    expr* trans_key_expr(const sexpr::list_expr* e);
 
   private:
     // Matching extensions
@@ -57,6 +64,8 @@ namespace pip
 
     void match(const sexpr::list_expr* list, int n, decl_seq* decls);
     void match(const sexpr::list_expr* list, int n, rule_seq* rules);
+    void match(const sexpr::list_expr* list, int n, band_seq* bands);
+    void match(const sexpr::list_expr* list, int n, bucket_seq* buckets);
     void match(const sexpr::list_expr* list, int n, expr_seq* exprs);
     void match(const sexpr::list_expr* list, int n, expr** out);
     void match(const sexpr::list_expr* list, int n, action_seq* actions);
@@ -66,6 +75,13 @@ namespace pip
     context& cxt;
     decoder field_decoder;
 
+    /// The number of tables, rules, meters, and groups translated so far.
+    /// These assign program-wide indexes to each kind of entity.
+    std::uint32_t table_count = 0;
+    std::uint32_t rule_count = 0;
+    std::uint32_t meter_count = 0;
+    std::uint32_t group_count = 0;
+
   /// Various lookup tables for different symbols.
   private:
     const std::unordered_map<symbol*, address_space> address_spaces {
@@ -75,6 +91,7 @@ namespace pip
       {cxt.get_symbol("meta"), as_meta},
       {cxt.get_symbol("ingress_port"), as_ingress_port},
       {cxt.get_symbol("physical_port"), as_physical_port},
+      {cxt.get_symbol("ct_state"), as_ct_state},
     };
 
     /// Keywords in expression lists.
@@ -87,7 +104,8 @@ namespace pip
       es_bitfield,
       es_miss,
       es_named_field,
-      es_ref
+      es_ref,
+      es_key
     };
 
     const std::unordered_map<symbol*, expression_symbol> expression_symbols {
@@ -100,6 +118,7 @@ namespace pip
       {cxt.get_symbol("miss"), es_miss},
       {cxt.get_symbol("named_field"), es_named_field},
       {cxt.get_symbol("ref"), es_ref},
+      {cxt.get_symbol("key"), es_key},
     };
 
     const std::unordered_map<symbol*, rule_kind> match_kinds {
@@ -109,6 +128,23 @@ namespace pip
       {cxt.get_symbol("range"), rk_range},
     };
 
+    const std::unordered_map<symbol*, meter_unit> meter_units {
+      {cxt.get_symbol("pps"), mu_pps},
+      {cxt.get_symbol("kbps"), mu_kbps},
+    };
+
+    const std::unordered_map<symbol*, band_kind> band_kinds {
+      {cxt.get_symbol("drop"), bk_drop},
+      {cxt.get_symbol("dscp_remark"), bk_dscp_remark},
+    };
+
+    const std::unordered_map<symbol*, group_kind> group_kinds {
+      {cxt.get_symbol("all"), gk_all},
+      {cxt.get_symbol("select"), gk_select},
+      {cxt.get_symbol("indirect"), gk_indirect},
+      {cxt.get_symbol("fast_failover"), gk_fast_failover},
+    };
+
   };
 
 
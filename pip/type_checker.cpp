@@ -1,19 +1,78 @@
 #include <iostream>
+#include <sstream>
 
 #include "type_checker.hpp"
 
 #include "decl.hpp"
 #include "action.hpp"
+#include "table.hpp"
+
+#include <algorithm>
+#include <climits>
 
 namespace pip
 {
 
+// The width of the metadata and context registers, in bits. The key
+// register is wider (see max_key_bits).
+constexpr std::size_t register_width = 64;
+
+// The most (table, decode offset) pairs explored when bounding accesses.
+// A program that exceeds this advances without bound along some cycle of
+// gotos.
+constexpr std::size_t max_bound_states = 4096;
+
+static bool is_register(address_space as)
+{
+  return as != as_packet && as != as_header;
+}
+
+static std::size_t register_size(address_space as)
+{
+  return as == as_key ? max_key_bits : register_width;
+}
+
+static std::size_t int_value(const expr* e)
+{
+  return static_cast<const int_expr*>(e)->val;
+}
+
+// Returns true if the literal `v` has no bits beyond the first `width`.
+static bool fits_width(int v, std::size_t width)
+{
+  return v >= 0 && (width >= sizeof(int) * CHAR_BIT - 1 || (v >> width) == 0);
+}
+
 void type_checker::check()
 {
+  table_decl* first = nullptr;
   for(auto d : prog->decls) {
-    table_decl* td = static_cast<table_decl*>(d);
-    check_table_decl(td);
+    switch(get_kind(d)) {
+    case dk_table: {
+      table_decl* td = static_cast<table_decl*>(d);
+      check_table_decl(td);
+      if(!first)
+        first = td;
+      break;
+    }
+    case dk_group:
+      check_group_decl(static_cast<group_decl*>(d));
+      break;
+    default:
+      break;
+    }
   }
+
+  // Bound the frame accesses of every path from the first table. Written
+  // actions run at egress, after any advance on the path, and after each
+  // other; bounding them at the largest decode offset reached, in turn, is
+  // conservative since advances only move forward.
+  if(first)
+    bound_table(first, 0);
+  std::size_t decode = max_decode;
+  bound_actions(egress, decode);
+
+  prog->min_frame_size = (frame_bits + CHAR_BIT - 1) / CHAR_BIT;
 }
 
 void type_checker::check_table_decl(table_decl* d)
@@ -21,13 +80,52 @@ void type_checker::check_table_decl(table_decl* d)
   for(auto a : d->prep)
     check_action(a);
 
+  // The literals of range, wildcard, and prefix rules are integers, and
+  // must fit the key, or they would be truncated to it.
+  if(d->rule == rk_range || d->rule == rk_wildcard || d->rule == rk_prefix) {
+    std::size_t width = key_width(d);
+    if(width > register_width) {
+      std::stringstream ss;
+      ss << "Key of non-exact table '" << *d->id << "' is wider than "
+         << register_width << " bits";
+      throw type_error(get_location(d), ss.str());
+    }
+    for(auto r : d->rules) {
+      bool fits = true;
+      if(auto e = as<range_expr>(r->key))
+        fits = fits_width(e->lo, width) && fits_width(e->hi, width);
+      else if(auto e = as<wild_expr>(r->key))
+        fits = fits_width(e->val, width) && fits_width(e->mask, width);
+      if(!fits) {
+        std::stringstream ss;
+        ss << "Rule key in table '" << *d->id << "' is wider than the "
+           << width << "-bit key of the table";
+        throw type_error(get_location(r->key), ss.str());
+      }
+    }
+  }
+
   for(auto r : d->rules) {
     check_expr(r->key);
+    if(as<int_expr>(r->key) || as<key_expr>(r->key)) {
+      if(static_cast<std::size_t>(static_cast<int_type*>(r->key->ty)->width) > max_key_bits) {
+        std::stringstream ss;
+        ss << "Rule key in table '" << *d->id << "' is wider than the key register";
+        throw type_error(get_location(r->key), ss.str());
+      }
+    }
     for(auto a : r->acts)
       check_action(a);
   }
 }
 
+void type_checker::check_group_decl(group_decl* d)
+{
+  for(auto& b : d->buckets)
+    for(auto a : b.acts)
+      check_action(a);
+}
+
 // EXPRESSIONS
 
 void type_checker::check_expr(expr* e)
@@ -58,26 +156,40 @@ void type_checker::check_expr(expr* e)
   case ek_bitfield:
     check_bitfield_expr(static_cast<bitfield_expr*>(e));
     break;
+  case ek_key:
+    check_key_expr(static_cast<key_expr*>(e));
+    break;
   }
-    
+
 }
 
 void type_checker::check_int_expr(int_expr* e)
 {
   if(e->ty->kind != tk_int)
-    throw std::runtime_error("Integer expression of invalid type");
+    throw type_error(get_location(e), "Integer expression of invalid type");
+}
+
+void type_checker::check_key_expr(key_expr* e)
+{
+  if(e->ty->kind != tk_int)
+    throw type_error(get_location(e), "Key expression of invalid type");
+  for(auto f : e->fields) {
+    if(!as<int_expr>(f))
+      throw type_error(get_location(e), "Key fields must be integers");
+    check_int_expr(static_cast<int_expr*>(f));
+  }
 }
 
 void type_checker::check_range_expr(range_expr* e)
-{  
+{
   if(e->ty->kind != tk_range)
-    throw std::runtime_error("Range expression of invalid type");
+    throw type_error(get_location(e), "Range expression of invalid type");
 }
 
 void type_checker::check_wild_expr(wild_expr* e)
 {
   if(e->ty->kind != tk_wild)
-    throw std::runtime_error("Wildcard expression of invalid type");
+    throw type_error(get_location(e), "Wildcard expression of invalid type");
 }
 
 void type_checker::check_miss_expr(miss_expr* e)
@@ -87,27 +199,47 @@ void type_checker::check_miss_expr(miss_expr* e)
 
 void type_checker::check_ref_expr(ref_expr* e)
 {
-  // if(e->ty->kind != tk_ref)
-    throw std::runtime_error("Reference expression of invalid type");
+  if(e->ty->kind != tk_ref)
+    throw type_error(get_location(e), "Reference expression of invalid type");
+  if(!e->ref)
+    throw type_error(get_location(e), "Unresolved reference");
 }
 
 void type_checker::check_port_expr(port_expr* e)
 {
   if(e->ty->kind != tk_port)
-    throw std::runtime_error("Port expression of invalid type");
+    throw type_error(get_location(e), "Port expression of invalid type");
+  if(e->rp == rp_non_reserved) {
+    if(!as<int_expr>(e->port_num))
+      throw type_error(get_location(e), "Port number must be an integer");
+    check_expr(e->port_num);
+  }
 }
 
 void type_checker::check_named_field_expr(named_field_expr* e)
 {
   if(e->ty->kind != tk_loc)
-    throw std::runtime_error("Field expression of invalid type");
+    throw type_error(get_location(e), "Field expression of invalid type");
 }
 
 void type_checker::check_bitfield_expr(bitfield_expr* e)
 {
   if(e->ty->kind != tk_loc)
-    throw std::runtime_error("Bitfield expression of invalid type");
-}  
+    throw type_error(get_location(e), "Bitfield expression of invalid type");
+  if(!as<int_expr>(e->pos) || !as<int_expr>(e->len))
+    throw type_error(get_location(e), "Bitfield position and length must be integers");
+
+  std::size_t pos = int_value(e->pos);
+  std::size_t len = int_value(e->len);
+  if(len == 0)
+    throw type_error(get_location(e), "Bitfield must not be empty");
+  if(is_register(e->as) && pos + len > register_size(e->as)) {
+    std::stringstream ss;
+    ss << "Bitfield of " << len << " bits at position " << pos
+       << " exceeds a register of " << register_size(e->as) << " bits";
+    throw type_error(get_location(e), ss.str());
+  }
+}
 
 // ACTIONS
 void type_checker::check_action(action* a)
@@ -123,6 +255,12 @@ void type_checker::check_action(action* a)
   case ak_set:
     check_set_action(static_cast<set_action*>(a));
     break;
+  case ak_meter:
+    check_meter_action(static_cast<meter_action*>(a));
+    break;
+  case ak_group:
+    check_group_action(static_cast<group_action*>(a));
+    break;
   case ak_write:
     check_write_action(static_cast<write_action*>(a));
     break;
@@ -138,27 +276,91 @@ void type_checker::check_action(action* a)
 void type_checker::check_advance_action(advance_action* a)
 {
   if(a->amount->ty->kind != tk_int)
-    throw std::runtime_error("Argument in advance action must have type int.\n");
+    throw type_error(get_location(a), "Argument in advance action must have type int.\n");
+
+  // Headers are whole bytes, so the sub-byte alignment of a header field
+  // is that of its position.
+  if(int_value(a->amount) % CHAR_BIT)
+    throw type_error(get_location(a), "Advance must be a whole number of bytes.\n");
 }
 
 void type_checker::check_copy_action(copy_action* a)
 {
   if(a->src->ty->kind != tk_loc)
-    throw std::runtime_error("Source in copy action must be a location.\n");
+    throw type_error(get_location(a), "Source in copy action must be a location.\n");
   if(a->dst->ty->kind != tk_loc)
-    throw std::runtime_error("Destination in copy action must be a location.\n");
+    throw type_error(get_location(a), "Destination in copy action must be a location.\n");
+
+  auto src = as<bitfield_expr>(a->src);
+  auto dst = as<bitfield_expr>(a->dst);
+  if(!src || !dst)
+    throw type_error(get_location(a), "Copy source and destination must be bitfields.\n");
+  check_bitfield_expr(src);
+  check_bitfield_expr(dst);
+
+  if(src->as == as_key)
+    throw type_error(get_location(a), "Cannot copy from a key register.\n");
+  if(dst->as == as_ingress_port || dst->as == as_physical_port || dst->as == as_ct_state)
+    throw type_error(get_location(a), "Cannot copy into a context variable.\n");
+
+  // Frames are written from the other frame address space or from a
+  // register.
+  if((dst->as == as_packet && (src->as == as_packet || src->as == as_ct_state)) ||
+     (dst->as == as_header && (src->as == as_header || src->as == as_ct_state))) {
+    std::stringstream ss;
+    ss << "Cannot copy from " << (src->as == as_ct_state ? "ct_state" : "the same address space")
+       << " into a frame.\n";
+    throw type_error(get_location(a), ss.str());
+  }
+
+  std::size_t n = a->n->val;
+  std::size_t src_len = int_value(src->len);
+  std::size_t dst_len = int_value(dst->len);
+  if(src_len != dst_len)
+    throw type_error(get_location(a), "Length of copy source and destination must be equal.\n");
+  if(n > dst_len)
+    throw type_error(get_location(a), "Copy action overflows buffer.\n");
 
-  // TODO: specified is an amount to copy, is this correct?
+  // Frame-to-frame copies move whole bytes, so the fields must share their
+  // alignment within a byte.
+  if(!is_register(src->as) && !is_register(dst->as) &&
+     int_value(src->pos) % CHAR_BIT != int_value(dst->pos) % CHAR_BIT)
+    throw type_error(get_location(a), "Copy source and destination must have the same bit alignment.\n");
 }
 
 void type_checker::check_set_action(set_action* a)
 {
   if(a->f->ty->kind != tk_loc)
-    throw std::runtime_error("Field in set action must be a location.\n");
+    throw type_error(get_location(a), "Field in set action must be a location.\n");
 
   // TODO: allow this to be any kind of value?
   if(a->v->ty->kind != tk_int)
-    throw std::runtime_error("Value in set action must have type int.\n");
+    throw type_error(get_location(a), "Value in set action must have type int.\n");
+
+  auto f = as<bitfield_expr>(a->f);
+  if(!f)
+    throw type_error(get_location(a), "Field in set action must be a bitfield.\n");
+  check_bitfield_expr(f);
+  if(f->as != as_packet)
+    throw type_error(get_location(a), "Field in set action must be in the packet.\n");
+
+  std::size_t width = static_cast<int_type*>(a->v->ty)->width;
+  if(width != int_value(f->len)) {
+    std::stringstream ss;
+    ss << "Cannot set a field of " << int_value(f->len) << " bits to a value of "
+       << width << " bits.\n";
+    throw type_error(get_location(a), ss.str());
+  }
+}
+
+void type_checker::check_meter_action(meter_action* a)
+{
+  check_expr(a->meter);
+}
+
+void type_checker::check_group_action(group_action* a)
+{
+  check_expr(a->group);
 }
 
 void type_checker::check_write_action(write_action* a)
@@ -168,13 +370,99 @@ void type_checker::check_write_action(write_action* a)
 
 void type_checker::check_goto_action(goto_action* a)
 {
-  
+  auto dest = as<ref_expr>(a->dest);
+  if(!dest)
+    throw type_error(get_location(a), "Destination in goto action must be a reference.\n");
+  check_ref_expr(dest);
+  if(get_kind(dest->ref) != dk_table) {
+    std::stringstream ss;
+    ss << "'" << *dest->id << "' is not a table.\n";
+    throw type_error(get_location(a), ss.str());
+  }
 }
 
 void type_checker::check_output_action(output_action* a)
 {
   if(a->port->ty->kind != tk_port)
-    throw std::runtime_error("Destination in ouput action must be a port.\n");
+    throw type_error(get_location(a), "Destination in ouput action must be a port.\n");
+  check_port_expr(static_cast<port_expr*>(a->port));
+}
+
+// BOUNDS
+
+void type_checker::bound_table(table_decl* t, std::size_t decode)
+{
+  if(!visited.emplace(t, decode).second)
+    return;
+  if(visited.size() > max_bound_states) {
+    std::stringstream ss;
+    ss << "Cannot bound the decode offset of table '" << *t->id << "'";
+    throw type_error(get_location(t), ss.str());
+  }
+  max_decode = std::max(max_decode, decode);
+
+  // Rule actions run with the decode offset left by the key actions.
+  bound_actions(t->prep, decode);
+  for(rule* r : t->rules) {
+    std::size_t d = decode;
+    bound_actions(r->acts, d);
+  }
 }
-  
+
+void type_checker::bound_actions(const action_seq& as, std::size_t& decode)
+{
+  // A write appends to the egress actions, which may be the sequence being
+  // bounded, so iterate by index.
+  for(std::size_t i = 0; i < as.size(); ++i) {
+    action* a = as[i];
+    switch(get_kind(a)) {
+    case ak_advance:
+      decode += int_value(cast<advance_action>(a)->amount);
+      max_decode = std::max(max_decode, decode);
+      break;
+    case ak_copy: {
+      auto c = cast<copy_action>(a);
+      bound_access(static_cast<bitfield_expr*>(c->src), decode);
+      bound_access(static_cast<bitfield_expr*>(c->dst), decode);
+      break;
+    }
+    case ak_set:
+      bound_access(static_cast<bitfield_expr*>(cast<set_action>(a)->f), decode);
+      break;
+    case ak_write:
+      egress.push_back(cast<write_action>(a)->act);
+      break;
+    case ak_goto: {
+      auto dest = static_cast<ref_expr*>(cast<goto_action>(a)->dest);
+      bound_table(static_cast<table_decl*>(dest->ref), decode);
+      break;
+    }
+    case ak_group: {
+      // An all group runs each bucket in turn. Otherwise one bucket runs;
+      // continue from the furthest offset any of them leaves.
+      auto g = static_cast<group_decl*>(static_cast<ref_expr*>(cast<group_action>(a)->group)->ref);
+      std::size_t after = decode;
+      for(const group_bucket& b : g->buckets) {
+        std::size_t d = g->kind == gk_all ? after : decode;
+        bound_actions(b.acts, d);
+        after = std::max(after, d);
+      }
+      decode = after;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+void type_checker::bound_access(const bitfield_expr* e, std::size_t decode)
+{
+  std::size_t end = int_value(e->pos) + int_value(e->len);
+  if(e->as == as_packet)
+    frame_bits = std::max(frame_bits, end);
+  else if(e->as == as_header)
+    frame_bits = std::max(frame_bits, end + decode);
+}
+
 }
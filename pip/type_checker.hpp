@@ -5,10 +5,26 @@
 #include "type.hpp"
 #include "expr.hpp"
 
+#include <cc/diagnostics.hpp>
+
+#include <cstddef>
+#include <set>
+#include <utility>
+
 namespace pip
 {
 
-// Performs static analysis on a translated program to ensure well-typedness.
+// Performs static analysis on a resolved program to ensure well-typedness.
+//
+// Besides the types of expressions, this proves the properties that the
+// evaluator relies on without checking them per packet: that registers
+// are not read or written beyond their width, that the address spaces of
+// a copy are compatible, and that the lengths of a copy agree. Every
+// packet and header access is at a constant offset, so the checker also
+// finds the largest offset the program can touch, following gotos with
+// the decode offset in effect. That becomes the program's minimum frame
+// size (see program_decl::min_frame_size), the evaluator's only bounds
+// check.
 class type_checker
 {
 public:
@@ -19,7 +35,8 @@ public:
   void check();
 private:
   void check_table_decl(table_decl* d);
-  
+  void check_group_decl(group_decl* d);
+
   void check_expr(expr* e);
   void check_int_expr(int_expr* e);
   void check_range_expr(range_expr* e);
@@ -29,18 +46,49 @@ private:
   void check_port_expr(port_expr* e);
   void check_bitfield_expr(bitfield_expr* e);
   void check_miss_expr(miss_expr* e);
+  void check_key_expr(key_expr* e);
 
   void check_action(action* a);
   void check_advance_action(advance_action* a);
   void check_copy_action(copy_action* a);
   void check_set_action(set_action* a);
+  void check_meter_action(meter_action* a);
+  void check_group_action(group_action* a);
   void check_write_action(write_action* a);
   void check_goto_action(goto_action* a);
   void check_output_action(output_action* a);
-  
+
+  void bound_table(table_decl* t, std::size_t decode);
+  void bound_actions(const action_seq& as, std::size_t& decode);
+  void bound_access(const bitfield_expr* e, std::size_t decode);
+
 private:
   context& cxt;
   program_decl* prog;
+
+  /// The (table, decode offset) pairs reached so far.
+  std::set<std::pair<table_decl*, std::size_t>> visited;
+
+  /// The actions that may be written to the action list.
+  action_seq egress;
+
+  /// The largest decode offset reached, in bits.
+  std::size_t max_decode = 0;
+
+  /// The end of the furthest frame access, in bits.
+  std::size_t frame_bits = 0;
+};
+
+// -------------------------------------------------------------------------- //
+// Exceptions
+
+/// Represents a type error.
+class type_error : public cc::diagnosable_error
+{
+public:
+  type_error(cc::location loc, const std::string& msg)
+    : cc::diagnosable_error(cc::dk_error, "type", loc, msg)
+  { }
 };
-  
+
 } // namespace pip
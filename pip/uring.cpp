@@ -0,0 +1,367 @@
+#include "uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace pip
+{
+namespace cap
+{
+  namespace
+  {
+    /// The file header of a classic pcap file.
+    struct file_header
+    {
+      std::uint32_t magic;
+      std::uint16_t version_major;
+      std::uint16_t version_minor;
+      std::int32_t thiszone;
+      std::uint32_t sigfigs;
+      std::uint32_t snaplen;
+      std::uint32_t linktype;
+    };
+
+    /// The header of each record of a classic pcap file.
+    struct record_header
+    {
+      std::uint32_t ts_sec;
+      std::uint32_t ts_frac;
+      std::uint32_t caplen;
+      std::uint32_t len;
+    };
+
+    /// The alignment of chunk buffers.
+    constexpr std::size_t page_size = 4096;
+
+    [[noreturn]] void
+    io_error(const char* what, int err)
+    {
+      std::stringstream ss;
+      ss << what << ": " << std::strerror(err);
+      throw std::runtime_error(ss.str());
+    }
+
+    template<typename T>
+    T*
+    at(void* base, std::uint32_t off)
+    {
+      return reinterpret_cast<T*>(static_cast<char*>(base) + off);
+    }
+  } // namespace
+
+  ring_reader::ring_reader(const char* path, std::size_t chunk, unsigned depth)
+    : fd(::open(path, O_RDONLY)),
+      chunk((chunk + page_size - 1) / page_size * page_size)
+  {
+    if (fd < 0) {
+      std::stringstream ss;
+      ss << "cannot open '" << path << "': " << std::strerror(errno);
+      throw std::runtime_error(ss.str());
+    }
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    depth = std::max(depth, 2u);
+    slots.resize(depth);
+    for (slot& s : slots) {
+      s.buf = nullptr;
+      s.len = 0;
+      s.error = 0;
+      s.pending = false;
+    }
+
+    try {
+      for (slot& s : slots) {
+        void* p;
+        if (::posix_memalign(&p, page_size, this->chunk) != 0)
+          throw std::bad_alloc();
+        s.buf = static_cast<unsigned char*>(p);
+        s.iov = { s.buf, this->chunk };
+      }
+
+      setup_ring(depth);
+
+      // Start reading every chunk buffer.
+      for (unsigned n = 0; n < depth; ++n)
+        submit(n);
+      wait(cur);
+
+      const unsigned char* p = take(sizeof(file_header));
+      if (!p)
+        throw std::runtime_error("not a pcap file");
+      file_header h;
+      std::memcpy(&h, p, sizeof h);
+      switch (h.magic) {
+      case 0xa1b2c3d4:
+        break;
+      case 0xa1b23c4d:
+        nanosecond = true;
+        break;
+      case 0xd4c3b2a1:
+        swapped = true;
+        break;
+      case 0x4d3cb2a1:
+        swapped = nanosecond = true;
+        break;
+      default:
+        throw std::runtime_error("not a pcap file");
+      }
+      link = swapped ? __builtin_bswap32(h.linktype) : h.linktype;
+    }
+    catch (...) {
+      release();
+      throw;
+    }
+  }
+
+  ring_reader::~ring_reader()
+  {
+    release();
+  }
+
+  void
+  ring_reader::release()
+  {
+    // The kernel may still be writing into the buffers.
+    if (ring_fd >= 0) {
+      try {
+        for (unsigned n = 0; n < slots.size(); ++n)
+          while (slots[n].pending)
+            reap(true);
+      }
+      catch (...) { }
+      ::munmap(sqes, sqes_size);
+      if (cq_ring != sq_ring)
+        ::munmap(cq_ring, cq_ring_size);
+      ::munmap(sq_ring, sq_ring_size);
+      ::close(ring_fd);
+      ring_fd = -1;
+    }
+    for (slot& s : slots)
+      std::free(s.buf);
+    slots.clear();
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+  }
+
+  bool
+  ring_reader::setup_ring(unsigned depth)
+  {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof p);
+    int rfd = ::syscall(__NR_io_uring_setup, depth, &p);
+    if (rfd < 0)
+      return false;
+
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    void* sq = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+      ::close(rfd);
+      return false;
+    }
+    void* cq = sq;
+    if (!single) {
+      cq = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_CQ_RING);
+      if (cq == MAP_FAILED) {
+        ::munmap(sq, sq_ring_size);
+        ::close(rfd);
+        return false;
+      }
+    }
+    sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    void* e = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQES);
+    if (e == MAP_FAILED) {
+      if (cq != sq)
+        ::munmap(cq, cq_ring_size);
+      ::munmap(sq, sq_ring_size);
+      ::close(rfd);
+      return false;
+    }
+
+    ring_fd = rfd;
+    sq_ring = sq;
+    cq_ring = cq;
+    sqes = static_cast<io_uring_sqe*>(e);
+    sq_tail = at<unsigned>(sq, p.sq_off.tail);
+    sq_mask = at<unsigned>(sq, p.sq_off.ring_mask);
+    sq_array = at<unsigned>(sq, p.sq_off.array);
+    cq_head = at<unsigned>(cq, p.cq_off.head);
+    cq_tail = at<unsigned>(cq, p.cq_off.tail);
+    cq_mask = at<unsigned>(cq, p.cq_off.ring_mask);
+    cqes = at<io_uring_cqe>(cq, p.cq_off.cqes);
+    return true;
+  }
+
+  /// Starts reading the next chunk of the file into slot `n`.
+  void
+  ring_reader::submit(unsigned n)
+  {
+    slot& s = slots[n];
+    s.len = 0;
+    s.error = 0;
+    off_t off = offset;
+    offset += chunk;
+
+    if (ring_fd < 0) {
+      ssize_t k;
+      do
+        k = ::pread(fd, s.buf, chunk, off);
+      while (k < 0 && errno == EINTR);
+      if (k < 0)
+        s.error = errno;
+      else
+        s.len = k;
+      return;
+    }
+
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+    io_uring_sqe& e = sqes[index];
+    std::memset(&e, 0, sizeof e);
+    e.opcode = IORING_OP_READV;
+    e.fd = fd;
+    e.addr = reinterpret_cast<std::uint64_t>(&s.iov);
+    e.len = 1;
+    e.off = off;
+    e.user_data = n;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    s.pending = true;
+
+    int k;
+    do
+      k = ::syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0);
+    while (k < 0 && errno == EINTR);
+    if (k < 0)
+      io_error("io_uring_enter", errno);
+  }
+
+  /// Consumes available completions. If `block` is true, waits for at
+  /// least one.
+  void
+  ring_reader::reap(bool block)
+  {
+    unsigned head = *cq_head;
+    if (block && head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      int k = ::syscall(__NR_io_uring_enter, ring_fd, 0, 1,
+                        IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (k < 0 && errno != EINTR)
+        io_error("io_uring_enter", errno);
+    }
+    while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe& c = cqes[head & *cq_mask];
+      slot& s = slots[c.user_data];
+      if (c.res < 0)
+        s.error = -c.res;
+      else
+        s.len = c.res;
+      s.pending = false;
+      ++head;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  /// Waits for the read into slot `n` to complete.
+  void
+  ring_reader::wait(unsigned n)
+  {
+    while (slots[n].pending)
+      reap(true);
+    if (slots[n].error)
+      io_error("cannot read capture", slots[n].error);
+    if (slots[n].len < chunk)
+      eof = true;
+  }
+
+  /// Recycles the current chunk and moves to the next. Returns false if
+  /// there are no more chunks.
+  bool
+  ring_reader::advance()
+  {
+    if (eof)
+      return false;
+    submit(cur);
+    cur = (cur + 1) % slots.size();
+    pos = 0;
+    wait(cur);
+    return slots[cur].len != 0;
+  }
+
+  /// Returns a pointer to the next `n` contiguous bytes of the file, or
+  /// null if the file ends first.
+  const unsigned char*
+  ring_reader::take(std::size_t n)
+  {
+    slot* s = &slots[cur];
+    if (s->len - pos >= n) {
+      const unsigned char* p = s->buf + pos;
+      pos += n;
+      return p;
+    }
+
+    spill.resize(n);
+    std::size_t have = 0;
+    while (have < n) {
+      if (pos == s->len) {
+        if (!advance())
+          return nullptr;
+        s = &slots[cur];
+      }
+      std::size_t k = std::min(n - have, s->len - pos);
+      std::memcpy(spill.data() + have, s->buf + pos, k);
+      have += k;
+      pos += k;
+    }
+    return spill.data();
+  }
+
+  bool
+  ring_reader::next(pcap_pkthdr*& h, const unsigned char*& data)
+  {
+    if (pos == slots[cur].len && !advance())
+      return false;
+
+    const unsigned char* p = take(sizeof(record_header));
+    if (!p)
+      throw std::runtime_error("truncated capture");
+    record_header r;
+    std::memcpy(&r, p, sizeof r);
+    if (swapped) {
+      r.ts_sec = __builtin_bswap32(r.ts_sec);
+      r.ts_frac = __builtin_bswap32(r.ts_frac);
+      r.caplen = __builtin_bswap32(r.caplen);
+      r.len = __builtin_bswap32(r.len);
+    }
+
+    data = take(r.caplen);
+    if (!data)
+      throw std::runtime_error("truncated capture");
+
+    hdr.ts.tv_sec = r.ts_sec;
+    hdr.ts.tv_usec = nanosecond ? r.ts_frac : r.ts_frac * 1000;
+    hdr.caplen = r.caplen;
+    hdr.len = r.len;
+    h = &hdr;
+    return true;
+  }
+
+} // namespace cap
+} // namespace pip
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <pcap/pcap.h>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace pip
+{
+namespace cap
+{
+  /// Reads a classic pcap file ahead of the parser. The file is read in
+  /// large aligned chunks into a ring of buffers; while the records of one
+  /// chunk are parsed, reads of the following chunks are in flight.
+  ///
+  /// Reads are submitted through io_uring using the raw system calls. If
+  /// io_uring is unavailable (old kernels, seccomp), chunks are read
+  /// synchronously with pread, which still parses records in place.
+  ///
+  /// As with libpcap's nanosecond precision, the tv_usec field of each
+  /// record holds nanoseconds.
+  ///
+  /// Records are returned directly from the chunk buffers. A record that
+  /// straddles two chunks is copied into a spill buffer. The returned
+  /// record is valid until the next call to next().
+  class ring_reader
+  {
+  public:
+    /// The default size of each chunk.
+    static constexpr std::size_t default_chunk = 1 << 20;
+
+    /// The default number of chunk buffers (triple buffering).
+    static constexpr unsigned default_depth = 3;
+
+    ring_reader(const char* path, std::size_t chunk = default_chunk,
+                unsigned depth = default_depth);
+    ~ring_reader();
+
+    ring_reader(const ring_reader&) = delete;
+    ring_reader& operator=(const ring_reader&) = delete;
+
+    /// Parses the next record. Returns false at the end of the file.
+    bool next(pcap_pkthdr*& hdr, const unsigned char*& data);
+
+    /// Returns true if reads are submitted asynchronously.
+    bool asynchronous() const { return ring_fd >= 0; }
+
+    /// Returns the link type of the capture.
+    std::uint32_t linktype() const { return link; }
+
+  private:
+    /// A chunk buffer and the read that fills it.
+    struct slot
+    {
+      unsigned char* buf;
+      iovec iov;
+      std::size_t len;
+      int error;
+      bool pending;
+    };
+
+    bool setup_ring(unsigned depth);
+    void release();
+    void submit(unsigned n);
+    void wait(unsigned n);
+    void reap(bool block);
+    bool advance();
+    const unsigned char* take(std::size_t n);
+
+    /// The capture file.
+    int fd;
+    std::size_t chunk;
+
+    /// The chunk buffers, in file order starting at `cur`.
+    std::vector<slot> slots;
+    unsigned cur = 0;
+    std::size_t pos = 0;
+
+    /// The file offset of the next chunk to submit.
+    off_t offset = 0;
+
+    /// True once a short read has been observed.
+    bool eof = false;
+
+    /// Holds records that straddle chunks.
+    std::vector<unsigned char> spill;
+
+    /// The header of the current record.
+    pcap_pkthdr hdr;
+
+    /// Properties of the file header.
+    bool swapped = false;
+    bool nanosecond = false;
+    std::uint32_t link = 0;
+
+    /// The io_uring, if any.
+    int ring_fd = -1;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    std::size_t sq_ring_size = 0;
+    std::size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    std::size_t sqes_size = 0;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+  };
+
+} // namespace cap
+} // namespace pip
@@ -0,0 +1,156 @@
+#include <pip/bitfield.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Checks the bitfield kernels against a bit-at-a-time reference, at every
+// alignment and near the end of a frame, where whole words cannot be
+// loaded.
+
+using namespace pip;
+
+namespace
+{
+  int failures = 0;
+
+  void
+  expect(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAIL: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  // A reproducible random number generator (splitmix64).
+  std::uint64_t
+  next(std::uint64_t& state)
+  {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  bool
+  get_bit(const std::vector<unsigned char>& f, std::size_t i)
+  {
+    return f[i / 8] & (0x80 >> (i % 8));
+  }
+
+  void
+  set_bit(std::vector<unsigned char>& f, std::size_t i, bool b)
+  {
+    if (b)
+      f[i / 8] |= 0x80 >> (i % 8);
+    else
+      f[i / 8] &= ~(0x80 >> (i % 8));
+  }
+
+  std::string
+  field(std::size_t pos, std::size_t n)
+  {
+    std::stringstream ss;
+    ss << "field at bit " << pos << " of " << n << " bits";
+    return ss.str();
+  }
+
+  // Inserts a random value into every field of a 12-byte frame, and
+  // checks that it reads back, that the frame matches the reference, and
+  // that no other bit changed.
+  void
+  check_round_trips()
+  {
+    const std::size_t size = 12;
+    std::uint64_t state = 1;
+    for (std::size_t n = 1; n <= 64; ++n) {
+      for (std::size_t pos = 0; pos + n <= size * 8; ++pos) {
+        std::vector<unsigned char> frame(size);
+        for (auto& b : frame)
+          b = next(state);
+        std::uint64_t value = next(state) & low_bits(n);
+
+        std::vector<unsigned char> expected = frame;
+        for (std::size_t i = 0; i < n; ++i)
+          set_bit(expected, pos + i, (value >> (n - 1 - i)) & 1);
+
+        insert_bits(frame.data(), size, pos, n, value);
+        if (frame != expected) {
+          expect(false, field(pos, n) + ": insert_bits");
+          continue;
+        }
+        expect(extract_bits(frame.data(), size, pos, n) == value,
+               field(pos, n) + ": extract_bits");
+      }
+    }
+  }
+
+  // Extracts every field of a random frame and compares it against the
+  // reference.
+  void
+  check_extract()
+  {
+    const std::size_t size = 11;
+    std::uint64_t state = 2;
+    std::vector<unsigned char> frame(size);
+    for (auto& b : frame)
+      b = next(state);
+    for (std::size_t n = 1; n <= 64; ++n)
+      for (std::size_t pos = 0; pos + n <= size * 8; ++pos) {
+        std::uint64_t v = 0;
+        for (std::size_t i = 0; i < n; ++i)
+          v = v << 1 | get_bit(frame, pos + i);
+        expect(extract_bits(frame.data(), size, pos, n) == v,
+               field(pos, n) + ": extract_bits of a random frame");
+      }
+  }
+
+  // Copies fields between random frames and checks that only the field
+  // changed.
+  void
+  check_copy()
+  {
+    const std::size_t size = 16;
+    std::uint64_t state = 3;
+    for (std::size_t n = 1; n <= 80; ++n)
+      for (std::size_t pos = 0; pos + n <= size * 8; pos += 3) {
+        std::vector<unsigned char> src(size), dst(size);
+        for (auto& b : src)
+          b = next(state);
+        for (auto& b : dst)
+          b = next(state);
+        std::vector<unsigned char> expected = dst;
+        for (std::size_t i = pos; i < pos + n; ++i)
+          set_bit(expected, i, get_bit(src, i));
+        copy_bits(&dst[pos / 8], &src[pos / 8], pos, n);
+        expect(dst == expected, field(pos, n) + ": copy_bits");
+      }
+  }
+
+  void
+  check_registers()
+  {
+    expect(register_bits(0xabcd, 4, 8) == 0xbc, "register_bits");
+    expect(merge_bits(0xff0, 0x1234, 4, 8) == 0x1ff4, "merge_bits");
+    expect(merge_bits(~0ull, 0, 0, 64) == ~0ull, "merge_bits of a whole register");
+    expect((extract_bits<4, 12>(reinterpret_cast<const unsigned char*>("\x12\x34"), 2)) == 0x234,
+           "extract_bits with a fixed field");
+  }
+} // namespace
+
+int
+main()
+{
+  check_round_trips();
+  check_extract();
+  check_copy();
+  check_registers();
+
+  if (failures) {
+    std::cerr << failures << " failures\n";
+    return 1;
+  }
+  std::cout << "bitfield: ok\n";
+  return 0;
+}
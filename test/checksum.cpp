@@ -0,0 +1,124 @@
+#include <pip/checksum.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Checks that updating checksums incrementally after a write gives the
+// same frame as recomputing them from scratch.
+
+using namespace pip;
+
+namespace
+{
+  int failures = 0;
+
+  void
+  expect(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAIL: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  // Returns the one's-complement sum of the big-endian words of `n`
+  // bytes, computed the obvious way.
+  std::uint32_t
+  reference_sum(const unsigned char* p, std::size_t n, std::uint32_t sum = 0)
+  {
+    for (std::size_t i = 0; i < n; i += 2)
+      sum += p[i] << 8 | (i + 1 < n ? p[i + 1] : 0);
+    while (sum >> 16)
+      sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+  }
+
+  // Sets the IPv4 and TCP checksums of an Ethernet/IPv4/TCP frame.
+  void
+  reference_checksums(std::vector<unsigned char>& f)
+  {
+    f[24] = f[25] = 0;
+    std::uint16_t ip = ~reference_sum(&f[14], 20);
+    f[24] = ip >> 8;
+    f[25] = ip;
+
+    std::size_t segment = f.size() - 34;
+    f[50] = f[51] = 0;
+    std::uint32_t sum = reference_sum(&f[26], 8);
+    sum = reference_sum(&f[34], segment, sum + 6 + segment);
+    std::uint16_t tcp = ~sum;
+    f[50] = tcp >> 8;
+    f[51] = tcp;
+  }
+
+  // Returns a 64-byte Ethernet/IPv4/TCP frame with valid checksums.
+  std::vector<unsigned char>
+  make_frame()
+  {
+    std::vector<unsigned char> f(64);
+    for (std::size_t i = 0; i < f.size(); ++i)
+      f[i] = i * 37 + 11;
+    f[12] = 0x08;
+    f[13] = 0x00;
+    f[14] = 0x45;
+    f[16] = 0;
+    f[17] = 50;
+    f[20] = f[21] = 0;
+    f[23] = 6;
+    reference_checksums(f);
+    return f;
+  }
+
+  // Writes `bytes` at `pos`, updates the checksums incrementally as the
+  // evaluator does, and compares the result against a full recompute.
+  void
+  check_write(const std::string& name, std::size_t pos,
+              const std::vector<unsigned char>& bytes)
+  {
+    std::vector<unsigned char> f = make_frame();
+    expect(frame_checksums(f.data(), f.size()) == (cs_ipv4 | cs_tcp),
+           name + ": frame has both checksums");
+
+    // The saved range is widened to 16-bit words.
+    std::size_t first = pos & ~std::size_t(1);
+    std::size_t last = (pos + bytes.size() + 1) & ~std::size_t(1);
+    std::vector<unsigned char> old(f.begin() + first, f.begin() + last);
+
+    std::memcpy(&f[pos], bytes.data(), bytes.size());
+    std::uint8_t cs = covering_checksums(pos, pos + bytes.size());
+    update_checksums(f.data(), f.size(), cs, first, last, old.data());
+
+    std::vector<unsigned char> expected = f;
+    reference_checksums(expected);
+    expect(f == expected, name + ": incremental update matches recompute");
+
+    std::vector<unsigned char> recomputed = f;
+    recompute_checksums(recomputed.data(), recomputed.size(), cs_ipv4 | cs_tcp);
+    expect(recomputed == expected, name + ": recompute matches reference");
+  }
+} // namespace
+
+int
+main()
+{
+  check_write("ipv4.src", 26, {10, 0, 0, 1});
+  check_write("ipv4.dst", 30, {192, 168, 7, 200});
+  check_write("ipv4.ttl", 22, {17});
+  check_write("tcp.src", 34, {0x1f, 0x90});
+  check_write("tcp.dst", 36, {0x00, 0x50});
+  check_write("ipv4.dst and tcp.src", 30, {1, 2, 3, 4, 5, 6});
+  check_write("odd span across addresses", 27, {0xde, 0xad, 0xbe});
+
+  expect(covering_checksums(22, 23) == cs_ipv4, "ttl is covered by ipv4 only");
+  expect(covering_checksums(34, 36) == cs_tcp, "ports are covered by tcp only");
+  expect(covering_checksums(26, 30) == (cs_ipv4 | cs_tcp),
+         "addresses are covered by both");
+  expect(covering_checksums(24, 26) == cs_none,
+         "a write to the ipv4 checksum sets it");
+
+  if (failures)
+    return 1;
+  std::cout << "checksum: ok\n";
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include <pip/conntrack.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <netinet/in.h>
+
+// Checks the connection states reported for a TCP connection from its
+// handshake to its reset, and for a UDP exchange, and that connections
+// expire on packet time.
+
+using namespace pip;
+
+namespace
+{
+  int failures = 0;
+
+  void
+  expect(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAIL: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  constexpr std::uint64_t seconds = 1000000000;
+
+  // TCP flags.
+  constexpr std::uint8_t fin = 0x01;
+  constexpr std::uint8_t syn = 0x02;
+  constexpr std::uint8_t rst = 0x04;
+  constexpr std::uint8_t ack = 0x10;
+
+  // The endpoints of the connections.
+  constexpr std::uint32_t client = 0x0a000001;
+  constexpr std::uint32_t server = 0x0a000002;
+
+  void
+  store(std::vector<unsigned char>& f, std::size_t pos, std::uint32_t v, int n)
+  {
+    for (int i = 0; i < n; ++i)
+      f[pos + i] = v >> (8 * (n - 1 - i));
+  }
+
+  // Returns an Ethernet/IPv4 frame carrying a TCP or UDP header.
+  std::vector<unsigned char>
+  make_frame(std::uint8_t proto, std::uint32_t src, std::uint16_t sport,
+             std::uint32_t dst, std::uint16_t dport, std::uint8_t flags = 0)
+  {
+    std::vector<unsigned char> f(proto == IPPROTO_TCP ? 54 : 42);
+    store(f, 12, 0x0800, 2);
+    f[14] = 0x45;
+    f[23] = proto;
+    store(f, 26, src, 4);
+    store(f, 30, dst, 4);
+    store(f, 34, sport, 2);
+    store(f, 36, dport, 2);
+    if (proto == IPPROTO_TCP)
+      f[47] = flags;
+    return f;
+  }
+
+  std::string
+  describe(std::uint32_t state)
+  {
+    std::stringstream ss;
+    ss << "0x" << std::hex << state;
+    return ss.str();
+  }
+
+  // Tracks a packet and checks its ct_state.
+  void
+  check(conntrack_table& ct, const std::string& name,
+        const std::vector<unsigned char>& f, std::uint64_t now,
+        std::uint32_t expected, bool commit = true)
+  {
+    std::uint32_t state = ct.track(f.data(), f.size(), now, commit);
+    expect(state == (ct_trk | expected),
+           name + ": state " + describe(state) + ", expected " +
+           describe(ct_trk | expected));
+  }
+
+  void
+  check_tcp()
+  {
+    conntrack_table ct;
+    auto to_server = [](std::uint8_t flags) {
+      return make_frame(IPPROTO_TCP, client, 40000, server, 80, flags);
+    };
+    auto to_client = [](std::uint8_t flags) {
+      return make_frame(IPPROTO_TCP, server, 80, client, 40000, flags);
+    };
+
+    std::uint64_t t = 1 * seconds;
+    check(ct, "mid-stream ack", to_server(ack), t, ct_inv);
+    check(ct, "uncommitted syn", to_server(syn), t, ct_new, false);
+    expect(ct.size() == 0, "an uncommitted syn adds no connection");
+
+    check(ct, "syn", to_server(syn), t, ct_new);
+    expect(ct.size() == 1, "a committed syn adds a connection");
+    check(ct, "retransmitted syn", to_server(syn), t, ct_new);
+    check(ct, "ack before syn-ack", to_server(ack), t, ct_inv);
+    check(ct, "syn-ack", to_client(syn | ack), t, ct_est | ct_rpl);
+    check(ct, "ack", to_server(ack), t, ct_est);
+    check(ct, "data", to_client(ack), t, ct_est | ct_rpl);
+    check(ct, "syn when established", to_server(syn), t, ct_inv);
+    check(ct, "fin", to_server(fin | ack), t, ct_est);
+    check(ct, "reply fin", to_client(fin | ack), t, ct_est | ct_rpl);
+    check(ct, "rst", to_server(rst), t, ct_est);
+    check(ct, "ack after rst", to_server(ack), t, ct_inv);
+
+    // A closed connection times out after 10 seconds.
+    ct.advance(t + 9 * seconds);
+    expect(ct.size() == 1, "a closed connection is kept until its timeout");
+    ct.advance(t + 11 * seconds);
+    expect(ct.size() == 0, "a closed connection expires");
+    check(ct, "ack after expiry", to_server(ack), t + 11 * seconds, ct_inv);
+  }
+
+  void
+  check_udp()
+  {
+    conntrack_table ct;
+    auto request = make_frame(IPPROTO_UDP, client, 5353, server, 53);
+    auto reply = make_frame(IPPROTO_UDP, server, 53, client, 5353);
+
+    std::uint64_t t = 5 * seconds;
+    check(ct, "udp request", request, t, ct_new);
+    check(ct, "repeated udp request", request, t, ct_new);
+    check(ct, "udp reply", reply, t + 1 * seconds, ct_est | ct_rpl);
+    check(ct, "udp request after reply", request, t + 1 * seconds, ct_est);
+
+    // The reply extended the timeout from 30 to 180 seconds, so the timer
+    // set for the request is rescheduled when it fires.
+    ct.advance(t + 40 * seconds);
+    expect(ct.size() == 1, "a replied udp connection outlives the unreplied timeout");
+
+    // Traffic renews the connection.
+    check(ct, "udp request later", request, t + 100 * seconds, ct_est);
+    ct.advance(t + 200 * seconds);
+    expect(ct.size() == 1, "traffic renews a udp connection");
+    ct.advance(t + 281 * seconds);
+    expect(ct.size() == 0, "an idle udp connection expires");
+    check(ct, "udp request after expiry", request, t + 281 * seconds, ct_new);
+  }
+
+  void
+  check_untrackable()
+  {
+    conntrack_table ct;
+    auto f = make_frame(IPPROTO_UDP, client, 1, server, 2);
+    f[23] = IPPROTO_ICMP;
+    check(ct, "icmp", f, 0, ct_inv);
+    f = make_frame(IPPROTO_UDP, client, 1, server, 2);
+    store(f, 20, 0x0001, 2);
+    check(ct, "later fragment", f, 0, ct_inv);
+    f = make_frame(IPPROTO_TCP, client, 1, server, 2, syn);
+    f.resize(40);
+    check(ct, "short tcp header", f, 0, ct_inv);
+    expect(ct.size() == 0, "untrackable packets add no connection");
+  }
+} // namespace
+
+int
+main()
+{
+  check_tcp();
+  check_udp();
+  check_untrackable();
+
+  if (failures)
+    return 1;
+  std::cout << "conntrack: ok\n";
+  return 0;
+}
@@ -0,0 +1,70 @@
+# Replays a synthetic capture through a program twice, without and then
+# with the flow cache, and checks that both runs write the same frames to
+# every egress port. Run with cmake -P and these variables:
+#
+#   PIP       The pip driver
+#   PCAPGEN   The capture generator
+#   PROGRAM   The program to evaluate
+#   WORK      A scratch directory
+#   CACHE     The cache options of the second run, e.g. "-c 1024"
+#   MEGAFLOWS If true, the second run must also hit megaflows
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+
+# 4000 packets at 500 packets per second span 8 seconds, long enough for
+# rules to time out partway through.
+execute_process(
+  COMMAND ${PCAPGEN} -o ${WORK}/input.pcap --packets 4000 --flows 256
+          --zipf 1.0 --mix tcp=3,udp=1 --rate 500
+  RESULT_VARIABLE status)
+if(status)
+  message(FATAL_ERROR "pcapgen failed: ${status}")
+endif()
+
+function(replay name)
+  execute_process(
+    COMMAND ${PIP} ${PROGRAM} ${WORK}/input.pcap -p 4 -o ${WORK}/${name} ${ARGN}
+    OUTPUT_FILE ${WORK}/${name}.log
+    ERROR_FILE ${WORK}/${name}.err
+    RESULT_VARIABLE status)
+  if(status)
+    message(FATAL_ERROR "pip failed on the ${name} run: ${status}")
+  endif()
+endfunction()
+
+separate_arguments(cache_options UNIX_COMMAND "${CACHE}")
+replay(traversed)
+replay(cached ${cache_options})
+
+# A test that never hits the cache compares nothing.
+file(STRINGS ${WORK}/cached.log hits REGEX "^flow cache hits: ")
+if(NOT hits MATCHES "^flow cache hits: ([0-9]+), megaflow hits: ([0-9]+)")
+  message(FATAL_ERROR "the cached run reports no cache hits")
+endif()
+if(CMAKE_MATCH_1 EQUAL 0)
+  message(FATAL_ERROR "the flow cache was never hit")
+endif()
+if(MEGAFLOWS AND CMAKE_MATCH_2 EQUAL 0)
+  message(FATAL_ERROR "no megaflow was ever hit")
+endif()
+
+# Each run writes <name>-<port>.pcap for every port it output to.
+file(GLOB traversed RELATIVE ${WORK} ${WORK}/traversed-*.pcap)
+file(GLOB cached RELATIVE ${WORK} ${WORK}/cached-*.pcap)
+if(NOT traversed)
+  message(FATAL_ERROR "no frames were output")
+endif()
+string(REPLACE "traversed-" "cached-" expected "${traversed}")
+if(NOT expected STREQUAL cached)
+  message(FATAL_ERROR "the runs output to different ports: ${traversed} and ${cached}")
+endif()
+foreach(file ${traversed})
+  string(REPLACE "traversed-" "cached-" other ${file})
+  execute_process(
+    COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}/${file} ${WORK}/${other}
+    RESULT_VARIABLE status)
+  if(status)
+    message(FATAL_ERROR "${other} differs from ${file}")
+  endif()
+endforeach()
@@ -0,0 +1,143 @@
+#include <pip/group.hpp>
+#include <pip/decl.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Checks that port liveness drives the choice of bucket: a fast-failover
+// group moves to its next live bucket, and a select group moves only the
+// flows of a bucket that went down, spreading them over the others.
+
+using namespace pip;
+
+namespace
+{
+  int failures = 0;
+
+  void
+  expect(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAIL: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  // A reproducible random number generator (splitmix64).
+  std::uint64_t
+  next(std::uint64_t& state)
+  {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // Returns a group of `kind` with a bucket watching each port.
+  group_decl*
+  make_group(group_kind kind, std::uint32_t index,
+             const std::vector<std::int32_t>& ports)
+  {
+    bucket_seq buckets(ports.size());
+    for (std::size_t i = 0; i < ports.size(); ++i)
+      buckets[i].watch_port = ports[i];
+    group_decl* g = new group_decl(nullptr, kind, std::move(buckets));
+    g->index = index;
+    return g;
+  }
+
+  void
+  check_failover()
+  {
+    program_decl prog({make_group(gk_fast_failover, 0, {1, 2, 3})});
+    group_table groups(&prog);
+
+    expect(groups.failover(0) == 0, "the first bucket is live initially");
+    expect(!groups.set_port_live(9, false), "an unwatched port changes no group");
+    expect(groups.set_port_live(1, false), "a watched port changes its group");
+    expect(!groups.port_live(1), "the port is down");
+    expect(groups.failover(0) == 1, "failover to the second bucket");
+    expect(!groups.set_port_live(1, false), "downing a port twice changes nothing");
+    groups.set_port_live(2, false);
+    groups.set_port_live(3, false);
+    expect(groups.failover(0) == no_bucket, "no bucket is live");
+    expect(groups.set_port_live(2, true), "a port comes back");
+    expect(groups.failover(0) == 1, "failover to the bucket that came back");
+    groups.set_port_live(1, true);
+    expect(groups.failover(0) == 0, "failback to the first bucket");
+  }
+
+  void
+  check_select()
+  {
+    const std::uint32_t buckets = 8;
+    std::vector<std::int32_t> ports;
+    for (std::uint32_t i = 0; i < buckets; ++i)
+      ports.push_back(10 + i);
+    program_decl prog({make_group(gk_select, 0, ports)});
+    group_table groups(&prog);
+
+    const std::size_t flows = 100000;
+    std::vector<std::uint64_t> hashes(flows);
+    std::uint64_t state = 1;
+    for (auto& h : hashes)
+      h = next(state);
+
+    std::vector<std::uint32_t> before(flows);
+    std::vector<std::size_t> share(buckets);
+    for (std::size_t i = 0; i < flows; ++i) {
+      before[i] = groups.select(0, hashes[i]);
+      ++share[before[i]];
+    }
+    for (std::uint32_t b = 0; b < buckets; ++b)
+      expect(share[b] > flows / buckets * 9 / 10 && share[b] < flows / buckets * 11 / 10,
+             "bucket " + std::to_string(b) + " has its share of flows");
+
+    // Down the port of bucket 3.
+    expect(groups.set_port_live(13, false), "a select bucket goes down");
+    std::size_t moved = 0;
+    std::size_t stranded = 0;
+    std::vector<std::size_t> after(buckets);
+    for (std::size_t i = 0; i < flows; ++i) {
+      std::uint32_t b = groups.select(0, hashes[i]);
+      ++after[b];
+      if (b == 3)
+        ++stranded;
+      else if (before[i] != 3 && b != before[i])
+        ++moved;
+    }
+    std::stringstream ss;
+    ss << moved << " of " << flows - share[3] << " unaffected flows moved";
+    expect(stranded == 0, "no flow selects the bucket that is down");
+    expect(moved == 0, ss.str());
+    for (std::uint32_t b = 0; b < buckets; ++b)
+      if (b != 3)
+        expect(after[b] > flows / (buckets - 1) * 9 / 10 &&
+               after[b] < flows / (buckets - 1) * 11 / 10,
+               "bucket " + std::to_string(b) + " takes its share of the moved flows");
+
+    // Bringing the port back restores every flow.
+    expect(groups.set_port_live(13, true), "the select bucket comes back");
+    std::size_t restored = 0;
+    for (std::size_t i = 0; i < flows; ++i)
+      restored += groups.select(0, hashes[i]) == before[i];
+    expect(restored == flows, "every flow returns to its bucket");
+
+    for (std::int32_t p : ports)
+      groups.set_port_live(p, false);
+    expect(groups.select(0, hashes[0]) == no_bucket, "no select bucket is live");
+  }
+} // namespace
+
+int
+main()
+{
+  check_failover();
+  check_select();
+
+  if (failures)
+    return 1;
+  std::cout << "group: ok\n";
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include <pip/megaflow.hpp>
+
+#include <iostream>
+#include <vector>
+
+// Checks that a megaflow covers exactly the keys that agree with it on the
+// bits of its mask, whole bytes or not, and that megaflows are retired by
+// invalidation and reclaimed by revalidation.
+
+using namespace pip;
+
+namespace
+{
+  int failures = 0;
+
+  void
+  expect(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAIL: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  using key = std::vector<unsigned char>;
+
+  // Returns a trace identified by the rule of its only lookup.
+  flow_trace
+  make_trace(std::uint32_t rule)
+  {
+    flow_trace t;
+    t.lookups.push_back({0, rule, false});
+    return t;
+  }
+
+  // Returns the rule of the trace covering `k`, or -1 if none does.
+  std::int64_t
+  lookup(tuple_space& ts, const key& k)
+  {
+    const flow_trace* t = ts.lookup(k.data());
+    return t ? std::int64_t(t->lookups[0].rule) : -1;
+  }
+
+  void
+  check_masks()
+  {
+    tuple_space ts(4, 64);
+
+    // A megaflow that only consulted the first byte.
+    expect(ts.insert(key{10, 0, 0, 1}.data(), key{0xff, 0, 0, 0}.data(), make_trace(1)),
+           "a megaflow is installed");
+    expect(lookup(ts, {10, 0, 0, 1}) == 1, "the megaflow covers its own key");
+    expect(lookup(ts, {10, 9, 8, 7}) == 1, "the megaflow covers keys differing in unmasked bits");
+    expect(lookup(ts, {11, 0, 0, 1}) == -1, "the megaflow does not cover keys differing in masked bits");
+
+    // A megaflow that consulted the high nibble of the first byte and the
+    // second byte lives in another subtable.
+    ts.insert(key{0xc5, 2, 0, 0}.data(), key{0xf0, 0xff, 0, 0}.data(), make_trace(2));
+    expect(ts.subtables() == 2, "each mask has its own subtable");
+    expect(lookup(ts, {0xcf, 2, 3, 4}) == 2, "a partial byte is wildcarded below the mask");
+    expect(lookup(ts, {0xd5, 2, 0, 0}) == -1, "a partial byte is matched within the mask");
+    expect(lookup(ts, {0xc5, 3, 0, 0}) == -1, "a second masked byte is matched");
+    expect(lookup(ts, {10, 2, 0, 0}) == 1, "the first subtable still covers its keys");
+
+    // A megaflow with the same mask and masked key is refreshed in place.
+    ts.insert(key{10, 5, 5, 5}.data(), key{0xff, 0, 0, 0}.data(), make_trace(3));
+    expect(ts.size() == 2, "a megaflow with the same masked key is not added");
+    expect(lookup(ts, {10, 0, 0, 1}) == 3, "the megaflow takes the new trace");
+
+    // Many megaflows in one subtable remain reachable as it grows.
+    for (std::uint32_t i = 0; i < 50; ++i)
+      ts.insert(key{0x20, 0, std::uint8_t(i), 0}.data(), key{0xff, 0, 0xff, 0}.data(),
+                make_trace(100 + i));
+    std::uint32_t found = 0;
+    for (std::uint32_t i = 0; i < 50; ++i)
+      found += lookup(ts, {0x20, 7, std::uint8_t(i), 7}) == 100 + i;
+    expect(found == 50, "every megaflow of a growing subtable is found");
+  }
+
+  void
+  check_generations()
+  {
+    tuple_space ts(2, 2);
+    ts.insert(key{1, 0}.data(), key{0xff, 0}.data(), make_trace(1));
+    ts.insert(key{0, 2}.data(), key{0, 0xff}.data(), make_trace(2));
+    expect(!ts.insert(key{3, 3}.data(), key{0xff, 0xff}.data(), make_trace(3)),
+           "a full classifier refuses a megaflow");
+
+    ts.invalidate();
+    expect(lookup(ts, {1, 0}) == -1 && lookup(ts, {0, 2}) == -1,
+           "invalidation retires every megaflow");
+    expect(ts.size() == 2, "retired megaflows are held until revalidation");
+
+    // A retired megaflow is refreshed by a new insertion.
+    ts.insert(key{1, 5}.data(), key{0xff, 0}.data(), make_trace(4));
+    expect(lookup(ts, {1, 0}) == 4, "a refreshed megaflow is current");
+    expect(lookup(ts, {0, 2}) == -1, "other megaflows remain retired");
+
+    // A full classifier reclaims retired megaflows before refusing.
+    expect(ts.insert(key{3, 3}.data(), key{0xff, 0xff}.data(), make_trace(3)),
+           "retired megaflows make room");
+    expect(ts.size() == 2 && ts.subtables() == 2, "the retired megaflow and its subtable are reclaimed");
+    expect(lookup(ts, {3, 3}) == 3 && lookup(ts, {1, 9}) == 4, "current megaflows survive reclamation");
+
+    ts.invalidate();
+    ts.revalidate();
+    expect(ts.size() == 0 && ts.subtables() == 0, "revalidation reclaims everything retired");
+    expect(lookup(ts, {3, 3}) == -1, "an empty classifier covers nothing");
+  }
+} // namespace
+
+int
+main()
+{
+  check_masks();
+  check_generations();
+
+  if (failures)
+    return 1;
+  std::cout << "megaflow: ok\n";
+  return 0;
+}
@@ -0,0 +1,180 @@
+#include <pip/meter.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Checks that meters let a burst through, apply their bands above the
+// rate, and refill from packet arrival times, with one worker and with
+// the credit of a band spread across several.
+
+using namespace pip;
+
+namespace
+{
+  int failures = 0;
+
+  void
+  expect(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAIL: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  constexpr std::uint64_t ms = 1000000;
+  constexpr std::uint64_t seconds = 1000 * ms;
+
+  meter_decl*
+  make_meter(meter_unit unit, std::uint32_t index, band_seq bands)
+  {
+    meter_decl* m = new meter_decl(nullptr, unit, std::move(bands));
+    m->index = index;
+    return m;
+  }
+
+  // Applies `n` packets of `bytes` bytes at `now` and returns the number
+  // that conformed.
+  std::size_t
+  burst(worker_meters& w, std::uint32_t meter, std::uint64_t now, std::size_t n,
+        std::size_t bytes = 64)
+  {
+    std::size_t conformed = 0;
+    for (std::size_t i = 0; i < n; ++i)
+      conformed += !w.apply(meter, now, bytes);
+    return conformed;
+  }
+
+  std::string
+  count(const std::string& what, std::size_t n)
+  {
+    std::stringstream ss;
+    ss << what << " (" << n << ")";
+    return ss.str();
+  }
+
+  void
+  check_pps()
+  {
+    // 1000 packets per second, with a burst of 10 packets.
+    program_decl prog({make_meter(mu_pps, 0, {{bk_drop, 1000, 10, 0}})});
+    meter_table meters(&prog);
+    worker_meters& w = meters.worker(0);
+
+    std::uint64_t t = 1 * seconds;
+    std::size_t n = burst(w, 0, t, 20);
+    expect(n == 10, count("a burst passes up to its size", n));
+    expect(w.band(0, 0).packets == 10 && w.band(0, 0).bytes == 640,
+           "the drop band counts the excess");
+
+    // After 5 ms, 5 packets have been earned.
+    n = burst(w, 0, t + 5 * ms, 20);
+    expect(n == 5, count("the bucket refills at the rate", n));
+
+    // The bucket refills no further than the burst.
+    n = burst(w, 0, t + 10 * seconds, 20);
+    expect(n == 10, count("the bucket refills up to the burst", n));
+
+    // At twice the rate for a second, half the packets pass.
+    t += 20 * seconds;
+    n = 0;
+    for (std::uint64_t i = 0; i < 2000; ++i)
+      n += burst(w, 0, t + i * (seconds / 2000), 1);
+    expect(n >= 1000 && n <= 1010, count("the rate holds over a second", n));
+  }
+
+  void
+  check_bands()
+  {
+    // A remark band below a drop band: packets over the lower rate are
+    // remarked, and those over the higher rate are dropped.
+    program_decl prog({make_meter(mu_pps, 0, {
+      {bk_drop, 1000, 10, 0},
+      {bk_dscp_remark, 100, 2, 1},
+    })});
+    meter_table meters(&prog);
+    worker_meters& w = meters.worker(0);
+    const meter_decl* m = static_cast<meter_decl*>(prog.decls[0]);
+
+    std::uint64_t t = 1 * seconds;
+    std::vector<const meter_band*> applied;
+    for (int i = 0; i < 12; ++i)
+      applied.push_back(w.apply(0, t, 64));
+    expect(!applied[0] && !applied[1], "packets within both bursts conform");
+    for (int i = 2; i < 10; ++i)
+      expect(applied[i] == &m->bands[1], "packets over the lower rate are remarked");
+    for (int i = 10; i < 12; ++i)
+      expect(applied[i] == &m->bands[0], "packets over the higher rate are dropped");
+    expect(w.band(0, 0).packets == 2 && w.band(0, 1).packets == 8,
+           "each band counts the packets it was applied to");
+  }
+
+  void
+  check_kbps()
+  {
+    // 8 kbps (1000 bytes per second), with a burst of 8 kilobits.
+    program_decl prog({make_meter(mu_kbps, 0, {{bk_drop, 8, 8, 0}})});
+    meter_table meters(&prog);
+    worker_meters& w = meters.worker(0);
+
+    std::size_t n = burst(w, 0, 1 * seconds, 20, 100);
+    expect(n == 10, count("a burst of bytes passes up to its size", n));
+    n = burst(w, 0, 1 * seconds + 500 * ms, 20, 100);
+    expect(n == 5, count("the byte bucket refills at the rate", n));
+  }
+
+  void
+  check_workers()
+  {
+    // With two workers, each takes a grant of half the burst, and the
+    // rate holds across both.
+    program_decl prog({make_meter(mu_pps, 0, {{bk_drop, 1000, 10, 0}})});
+    meter_table meters(&prog, 2);
+    worker_meters& w0 = meters.worker(0);
+    worker_meters& w1 = meters.worker(1);
+
+    std::uint64_t t = 1 * seconds;
+    std::size_t n0 = burst(w0, 0, t, 10);
+    std::size_t n1 = burst(w1, 0, t, 10);
+    expect(n0 == 5 && n1 == 5, "each worker takes half the burst");
+
+    // A shortage rebalances no sooner than min_retry, and then finds the
+    // shared bucket drained.
+    expect(burst(w0, 0, t + worker_meters::min_retry, 1) == 0,
+           "the other worker's grant is not available");
+
+    // A worker returns unspent tokens when it rebalances, and the other
+    // can take them. Here the 4 tokens returned and the 2 earned in 2 ms
+    // exceed a grant by one packet.
+    t += 10 * seconds;
+    expect(burst(w0, 0, t, 1) == 1, "a worker takes a grant");
+    expect(burst(w1, 0, t, 10) == 5, "the other takes the rest");
+    std::uint64_t later = t + 2 * worker_meters::interval;
+    expect(burst(w0, 0, later, 1) == 1, "a worker rebalances after an interval");
+    std::size_t n = burst(w1, 0, later + worker_meters::min_retry, 10);
+    expect(n == 1, count("the unspent tokens returned are taken by the other worker", n));
+
+    // At twice the rate, spread across both workers for a second, the
+    // rate holds within a grant.
+    t += 10 * seconds;
+    n = 0;
+    for (std::uint64_t i = 0; i < 2000; ++i)
+      n += burst(i % 2 ? w1 : w0, 0, t + i * (seconds / 2000), 1);
+    expect(n >= 1000 && n <= 1015, count("the rate holds across workers", n));
+  }
+} // namespace
+
+int
+main()
+{
+  check_pps();
+  check_bands();
+  check_kbps();
+  check_workers();
+
+  if (failures)
+    return 1;
+  std::cout << "meter: ok\n";
+  return 0;
+}
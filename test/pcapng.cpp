@@ -0,0 +1,199 @@
+#include <pip/pcapng.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Checks the pcapng reader on a file with two sections of opposite byte
+// order, one of which records timestamps in units of 2^-10 seconds.
+
+using namespace pip::cap;
+
+namespace
+{
+  int failures = 0;
+
+  void
+  expect(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAIL: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  // Builds the blocks of a section in a given byte order.
+  class section_writer
+  {
+  public:
+    section_writer(std::vector<unsigned char>& out, bool big)
+      : out(out), big(big)
+    { }
+
+    void
+    section()
+    {
+      std::vector<unsigned char> b;
+      put32(b, 0x1a2b3c4d);
+      put16(b, 1);
+      put16(b, 0);
+      put32(b, 0xffffffff);
+      put32(b, 0xffffffff);
+      block(0x0a0d0d0a, b);
+    }
+
+    // An interface with the given timestamp resolution (if_tsresol) and
+    // offset (if_tsoffset), if nonzero.
+    void
+    interface(std::uint16_t link, int tsresol = -1, std::int64_t tsoffset = 0)
+    {
+      std::vector<unsigned char> b;
+      put16(b, link);
+      put16(b, 0);
+      put32(b, 65535);
+      if (tsresol >= 0) {
+        put16(b, 9);
+        put16(b, 1);
+        b.push_back(tsresol);
+        b.resize(b.size() + 3);
+      }
+      if (tsoffset) {
+        put16(b, 14);
+        put16(b, 8);
+        put64(b, tsoffset);
+      }
+      put16(b, 0);
+      put16(b, 0);
+      block(1, b);
+    }
+
+    void
+    packet(std::uint32_t iface, std::uint64_t ts, const std::string& data)
+    {
+      std::vector<unsigned char> b;
+      put32(b, iface);
+      put32(b, ts >> 32);
+      put32(b, ts);
+      put32(b, data.size());
+      put32(b, data.size() + 100);
+      b.insert(b.end(), data.begin(), data.end());
+      b.resize((b.size() + 3) & ~3);
+      block(6, b);
+    }
+
+    // A block of a type that the reader skips.
+    void
+    unknown()
+    {
+      block(5, std::vector<unsigned char>(8, 0xee));
+    }
+
+  private:
+    void
+    block(std::uint32_t type, const std::vector<unsigned char>& body)
+    {
+      std::vector<unsigned char> b;
+      put32(b, type);
+      put32(b, body.size() + 12);
+      b.insert(b.end(), body.begin(), body.end());
+      put32(b, body.size() + 12);
+      out.insert(out.end(), b.begin(), b.end());
+    }
+
+    void
+    put(std::vector<unsigned char>& b, std::uint64_t v, int n)
+    {
+      for (int i = 0; i < n; ++i)
+        b.push_back(big ? v >> (8 * (n - 1 - i)) : v >> (8 * i));
+    }
+
+    void put16(std::vector<unsigned char>& b, std::uint16_t v) { put(b, v, 2); }
+    void put32(std::vector<unsigned char>& b, std::uint32_t v) { put(b, v, 4); }
+    void put64(std::vector<unsigned char>& b, std::uint64_t v) { put(b, v, 8); }
+
+    std::vector<unsigned char>& out;
+    bool big;
+  };
+
+  bool
+  host_is_big()
+  {
+    std::uint16_t x = 1;
+    return *reinterpret_cast<unsigned char*>(&x) == 0;
+  }
+} // namespace
+
+int
+main()
+{
+  // The first section is in host order, with the default resolution of
+  // microseconds. The second is byte-swapped, with a resolution of 2^-10
+  // seconds and an offset of 100 seconds.
+  std::vector<unsigned char> file;
+  section_writer native(file, host_is_big());
+  native.section();
+  native.interface(1);
+  native.interface(101, 9);
+  native.packet(0, 1500000, "abc");
+  native.unknown();
+  native.packet(1, 2000000123, "de");
+
+  section_writer swapped(file, !host_is_big());
+  swapped.section();
+  swapped.interface(1, 0x80 | 10, 100);
+  swapped.packet(0, 5 * 1024 + 512, "fghij");
+
+  char path[] = "/tmp/pcapng-test-XXXXXX";
+  int fd = ::mkstemp(path);
+  if (fd < 0 || ::write(fd, file.data(), file.size()) != ssize_t(file.size())) {
+    std::cerr << "cannot write " << path << '\n';
+    return 1;
+  }
+  ::close(fd);
+
+  struct
+  {
+    std::uint32_t iface;
+    std::uint32_t link;
+    std::uint64_t ns;
+    std::string data;
+  } const expected[] = {
+    {0, 1, 1500000000, "abc"},
+    {1, 101, 2000000123, "de"},
+    {2, 1, 105500000000, "fghij"},
+  };
+
+  try {
+    pcapng_reader r(path);
+    pcap_pkthdr* h;
+    const unsigned char* data;
+    for (const auto& e : expected) {
+      std::string n = "packet '" + e.data + "'";
+      if (!r.next(h, data)) {
+        expect(false, n + ": read");
+        break;
+      }
+      expect(r.interface_id() == e.iface, n + ": interface");
+      expect(r.linktype() == e.link, n + ": link type");
+      expect(r.timestamp() == e.ns, n + ": timestamp");
+      expect(h->caplen == e.data.size(), n + ": captured length");
+      expect(h->len == e.data.size() + 100, n + ": length");
+      expect(std::string(reinterpret_cast<const char*>(data), h->caplen) == e.data,
+             n + ": data");
+    }
+    expect(!r.next(h, data), "end of file");
+  }
+  catch (std::exception& err) {
+    expect(false, err.what());
+  }
+  std::remove(path);
+
+  if (failures)
+    return 1;
+  std::cout << "pcapng: ok\n";
+  return 0;
+}
@@ -0,0 +1,186 @@
+#include <pip/timeout.hpp>
+#include <pip/decl.hpp>
+#include <pip/expr.hpp>
+#include <pip/stats.hpp>
+#include <pip/table.hpp>
+#include <pip/type.hpp>
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+// Checks that the timing wheel fires each timer on its deadline, across
+// the cascades between levels, and that rules expire on packet time: idle
+// timers are rescheduled by later hits, and each removal is reported on
+// the controller channel.
+
+using namespace pip;
+
+namespace
+{
+  int failures = 0;
+
+  void
+  expect(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAIL: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  constexpr std::uint64_t seconds = 1000000000;
+
+  std::string
+  deadline(std::uint64_t t)
+  {
+    std::stringstream ss;
+    ss << "timer due at tick " << t;
+    return ss.str();
+  }
+
+  // Schedules timers at deadlines on either side of each level boundary,
+  // advances to `end` in steps of `step` ticks, and checks that each fired
+  // once, on the tick of its deadline.
+  void
+  check_wheel(std::uint64_t step)
+  {
+    const std::uint64_t deadlines[] = {
+      1, 2, 255, 256, 257, 511, 65535, 65536, 65537, 70000,
+      (1 << 24) - 1, 1 << 24, (1 << 24) + 12345,
+    };
+    const std::uint64_t end = (1 << 24) + 20000;
+
+    timer_wheel wheel;
+    for (std::uint32_t i = 0; i < sizeof deadlines / sizeof *deadlines; ++i)
+      wheel.schedule(i, deadlines[i]);
+    expect(wheel.size() == sizeof deadlines / sizeof *deadlines, "every timer is pending");
+
+    std::map<std::uint32_t, std::vector<std::uint64_t>> fired;
+    for (std::uint64_t t = step; t < end + step; t += step) {
+      std::uint64_t to = std::min(t, end);
+      wheel.advance(to, [&](const timer_wheel::timer& tm) {
+        expect(tm.deadline <= to, deadline(tm.deadline) + ": fires after its deadline");
+        fired[tm.id].push_back(tm.deadline);
+      });
+    }
+    expect(wheel.now() == end, "the wheel advances to the end");
+    expect(wheel.size() == 0, "no timer is pending");
+    for (std::uint32_t i = 0; i < sizeof deadlines / sizeof *deadlines; ++i)
+      expect(fired[i].size() == 1 && fired[i][0] == deadlines[i],
+             deadline(deadlines[i]) + ": fires once on its deadline");
+  }
+
+  // Checks that the wheel fires timers at the tick they are due, one tick
+  // at a time, and that a timer can be rescheduled as it fires.
+  void
+  check_reschedule()
+  {
+    timer_wheel wheel;
+    wheel.advance(1000, [](const timer_wheel::timer&) { });
+    expect(wheel.now() == 1000, "an empty wheel jumps ahead");
+
+    wheel.schedule(1, 10);
+    expect(wheel.size() == 1, "a past deadline is pending");
+    std::vector<std::uint64_t> ticks;
+    wheel.advance(1001, [&](const timer_wheel::timer& tm) { ticks.push_back(wheel.now()); });
+    expect(ticks.size() == 1 && ticks[0] == 1001, "a past deadline fires on the next tick");
+
+    // A timer that reschedules itself 300 ticks later, three times.
+    wheel.schedule(2, 1100);
+    ticks.clear();
+    for (std::uint64_t t = 1001; t <= 2100; ++t)
+      wheel.advance(t, [&](const timer_wheel::timer& tm) {
+        ticks.push_back(wheel.now());
+        if (ticks.size() < 4)
+          wheel.schedule(tm.id, wheel.now() + 300);
+      });
+    expect(ticks == std::vector<std::uint64_t>({1100, 1400, 1700, 2000}),
+           "a rescheduled timer fires again");
+  }
+
+  rule*
+  make_rule(std::uint64_t key, std::uint32_t index, std::uint32_t idle, std::uint32_t hard)
+  {
+    rule* r = new rule(rk_exact, new int_expr(new int_type(8), key), action_seq());
+    r->index = index;
+    r->idle_timeout = idle;
+    r->hard_timeout = hard;
+    return r;
+  }
+
+  void
+  check_rules()
+  {
+    // Rule 0 idles out after 2 seconds, rule 1 is removed after 5, rule 2
+    // idles out after 3 seconds but is hit, and rule 3 is permanent.
+    rule_seq rules = {
+      make_rule(1, 0, 2, 0),
+      make_rule(2, 1, 0, 5),
+      make_rule(3, 2, 3, 0),
+      make_rule(4, 3, 0, 0),
+    };
+    table_decl* t = new table_decl(nullptr, rk_exact, action_seq(), rule_seq(rules));
+    program_decl prog({t});
+    build_tables(&prog);
+
+    stats counters(&prog);
+    controller_channel channel;
+    rule_timeouts timeouts(&prog, counters, channel);
+
+    const std::uint64_t start = 10 * seconds;
+    expect(!timeouts.advance(start), "no rule expires at the start");
+
+    expect(!timeouts.advance(start + 1900000000), "no rule expires before its timeout");
+    expect(channel.empty(), "nothing is reported before a timeout");
+
+    flow_removed m;
+    expect(timeouts.advance(start + 2100000000), "an idle rule expires");
+    expect(channel.receive(m) && m.rule == rules[0] && m.reason == rr_idle_timeout &&
+           m.time == start + 2 * seconds && m.duration == 2 * seconds,
+           "the idle timeout is reported");
+    expect(t->rules.size() == 3, "the rule is removed from its table");
+    expect(!t->engine->lookup(key_value(1)), "the rule is removed from the engine");
+    expect(t->engine->lookup(key_value(4)) == rules[3], "other rules remain");
+
+    counters.worker(0).lookup(0, 2, false, 100, start + 2500000000);
+    expect(!timeouts.advance(start + 3100000000), "a rule hit since its timer was set does not expire");
+    expect(channel.empty(), "nothing is reported for a rule that was hit");
+
+    expect(timeouts.advance(start + 5100000000), "a hard timeout expires");
+    expect(channel.receive(m) && m.rule == rules[1] && m.reason == rr_hard_timeout &&
+           m.time == start + 5 * seconds && m.packets == 0,
+           "the hard timeout is reported");
+
+    expect(timeouts.advance(start + 5600000000), "a rescheduled idle timer expires");
+    expect(channel.receive(m) && m.rule == rules[2] && m.reason == rr_idle_timeout &&
+           m.time == start + 5500000000 && m.packets == 1 && m.bytes == 100,
+           "the idle timeout is reported from the last hit");
+
+    expect(!timeouts.advance(start + 1000 * seconds), "a permanent rule does not expire");
+    expect(channel.empty() && t->rules.size() == 1, "only the permanent rule remains");
+
+    // The table deletes the rule it still holds; rules do not own keys.
+    for (rule* r : rules) {
+      delete r->key;
+      if (r != rules[3])
+        delete r;
+    }
+  }
+} // namespace
+
+int
+main()
+{
+  check_wheel(1);
+  check_wheel(97);
+  check_wheel(70000);
+  check_reschedule();
+  check_rules();
+
+  if (failures)
+    return 1;
+  std::cout << "timeout: ok\n";
+  return 0;
+}